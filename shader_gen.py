@@ -22,6 +22,8 @@
 # file: https://github.com/godotengine/godot/blob/master/glsl_builders.py
 
 import os.path
+import subprocess
+import tempfile
 from typing import Optional, Iterable
 
 
@@ -43,6 +45,55 @@ def generate_inline_code(
     return ",".join(output)
 
 
+def generate_spirv_code(
+    input_lines: Iterable[str], stage: str, compiler: str,
+    defines: Iterable[str] = ()
+) -> tuple:
+    """Compile shader lines to SPIR-V with the build time shader compiler
+
+    :param: input_lines: GLSL lines of a single stage
+    :param: stage: vert, frag or comp
+    :param: compiler: path of the shader_compiler program
+    :param: defines: macros defined for this variant
+    :return: (str, int) - generated inline words and their count
+    """
+    # same text the runtime compiler would see, see generate_inline_code
+    source = "".join(line + "\n" for line in input_lines)
+
+    with tempfile.TemporaryDirectory() as directory:
+        input_file = os.path.join(directory, "shader." + stage)
+        output_file = os.path.join(directory, "shader.spv")
+
+        with open(input_file, "w") as fd:
+            fd.write(source)
+
+        arguments = [compiler, stage, input_file, output_file]
+        arguments += ["-D" + define for define in defines]
+
+        result = subprocess.run(arguments, capture_output=True, text=True)
+
+        if result.returncode != 0:
+            raise RuntimeError(result.stdout + result.stderr)
+
+        with open(output_file, "rb") as fd:
+            data = fd.read()
+
+    words = [int.from_bytes(data[i:i + 4], "little")
+             for i in range(0, len(data), 4)]
+
+    output = []
+    for i in range(0, len(words), 8):
+        output.append(",".join("0x%08x" % word for word in words[i:i + 8]))
+    return ",\n".join(output), len(words)
+
+
+# order of ShaderStage in glsl_compiler.h
+STAGE_NAMES = ["vertex", "fragment", "compute"]
+
+# 2^n variants are compiled at build time
+MAX_FEATURES = 4
+
+
 class HeaderStruct:
     def __init__(self):
         self.vertex_lines = []
@@ -53,6 +104,8 @@ class HeaderStruct:
         self.fragment_included_files = []
         self.compute_included_files = []
 
+        self.features = []
+
         self.reading = ""
         self.line_offset = 0
         self.vertex_offset = 0
@@ -71,6 +124,12 @@ def include_file_in_header(
         if index != -1:
             line = line[:index]
 
+        if line.find("#[FEATURES]") != -1:
+            header_data.reading = "features"
+            line = fs.readline()
+            header_data.line_offset += 1
+            continue
+
         if line.find("#[VERTEX]") != -1:
             header_data.reading = "vertex"
             line = fs.readline()
@@ -122,6 +181,8 @@ def include_file_in_header(
 
         line = line.replace("\r", "").replace("\n", "")
 
+        if header_data.reading == "features" and line.strip():
+            header_data.features += [line.strip()]
         if header_data.reading == "vertex":
             header_data.vertex_lines += [line]
         if header_data.reading == "fragment":
@@ -138,8 +199,14 @@ def include_file_in_header(
 
 
 def build_header(
-    filename: str, header_data: Optional[HeaderStruct] = None
+    filename: str, header_data: Optional[HeaderStruct] = None,
+    compiler: Optional[str] = None
 ) -> None:
+    """Generate <filename>.gen.h
+
+    :param: compiler: shader_compiler program, embeds SPIR-V when given and
+        the GLSL source for runtime compilation otherwise
+    """
     header_data = header_data or HeaderStruct()
     include_file_in_header(filename, header_data, 0)
 
@@ -152,20 +219,77 @@ def build_header(
     out_file_class = out_file_base.replace(".glsl.gen.h", "").title().replace(
         "_", "").replace(".", "") + "ShaderRD"
 
+    # every combination of features is a variant, the mask is its index
+    features = header_data.features
+    if len(features) > MAX_FEATURES:
+        raise RuntimeError("%s: at most %d features are supported" %
+                           (filename, MAX_FEATURES))
+
+    defines = ["FEATURE_" + feature for feature in features]
+    variant_count = 1 << len(features)
+
     if header_data.compute_lines:
-        body_parts = [
-            "static const char _computeCode[] = {\n%s\n\t\t};" %
-            generate_inline_code(header_data.compute_lines),
-            f'setup(nullptr, nullptr, _computeCode, "{out_file_class}");',
-        ]
+        stages = [("compute", "comp", header_data.compute_lines)]
     else:
-        body_parts = [
-            "static const char _vertexCode[] = {\n%s\n\t\t};" %
-            generate_inline_code(header_data.vertex_lines),
-            "static const char _fragmentCode[] = {\n%s\n\t\t};" %
-            generate_inline_code(header_data.fragment_lines),
-            f'setup(_vertexCode, _fragmentCode, nullptr, "{out_file_class}");',
-        ]
+        stages = [("vertex", "vert", header_data.vertex_lines),
+                  ("fragment", "frag", header_data.fragment_lines)]
+
+    body_parts = []
+
+    if defines:
+        body_parts.append("static const char *_features[] = { %s };" %
+                          ", ".join('"%s"' % define for define in defines))
+        features_argument = "_features"
+    else:
+        features_argument = "nullptr"
+
+    if compiler:
+        variants = []
+        # stages a feature doesn't touch compile to the same words, embed once
+        arrays = {}
+        for variant in range(variant_count):
+            variant_defines = [define for i, define in enumerate(defines)
+                               if variant & (1 << i)]
+            array = {}
+            size = {}
+            for name, stage, lines in stages:
+                code, size[name] = generate_spirv_code(
+                    lines, stage, compiler, variant_defines)
+                if code not in arrays:
+                    arrays[code] = "_%sCode%d" % (name, variant)
+                    body_parts.append(
+                        "static const uint32_t %s[] = {\n%s\n\t\t};" %
+                        (arrays[code], code))
+                array[name] = arrays[code]
+            pointers = ", ".join(array.get(name, "nullptr")
+                                 for name in STAGE_NAMES)
+            sizes = ", ".join(str(size.get(name, 0)) for name in STAGE_NAMES)
+            variants.append("{ { %s }, { %s } }" % (pointers, sizes))
+        body_parts.append(
+            "static const ShaderSpirvVariant _variants[] = {\n\t\t\t%s\n\t\t};" %
+            ",\n\t\t\t".join(variants))
+        body_parts.append(
+            f'setupSpirv(_variants, {features_argument}, {len(features)}, "{out_file_class}");')
+    else:
+        for name, stage, lines in stages:
+            body_parts.append("static const char _%sCode[] = {\n%s\n\t\t};" %
+                              (name, generate_inline_code(lines)))
+        sources = ", ".join("_%sCode" % name if name in [x[0] for x in stages]
+                            else "nullptr" for name in STAGE_NAMES)
+        # the file is parsed again at runtime when it changes
+        path = os.path.relpath(filename).replace("\\", "/")
+        body_parts.append(
+            f'setup({sources}, {features_argument}, {len(features)}, "{out_file_class}", "{path}");')
+
+    if features:
+        enum_values = "".join("\n        FEATURE_%s = 1 << %d," % (feature, i)
+                              for i, feature in enumerate(features))
+        enum_content = f"""
+    enum Feature {{{enum_values}
+    }};
+"""
+    else:
+        enum_content = ""
 
     body_content = "\n\t\t".join(body_parts)
 
@@ -177,7 +301,7 @@ def build_header(
 #include "shader_rd.h"
 
 class {out_file_class} : public ShaderRD {{
-public:
+public:{enum_content}
     {out_file_class}() {{
         {body_content}
     }}
@@ -190,7 +314,15 @@ public:
         fd.write(shader_template)
 
 
-def build_headers(source):
+def build_headers(source, compiler: Optional[str] = None):
     for x in source:
-        build_header(filename=str(x))
+        build_header(filename=str(x), compiler=compiler)
+
+
+def get_included_files(filename: str) -> list:
+    """Files a shader includes, so the build can depend on them"""
+    header_data = include_file_in_header(filename, HeaderStruct(), 0)
+    return sorted(set(header_data.vertex_included_files +
+                      header_data.fragment_included_files +
+                      header_data.compute_included_files))
 
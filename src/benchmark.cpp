@@ -0,0 +1,385 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <random>
+
+#include <glm/gtc/constants.hpp>
+#include <imgui.h>
+#include <imgui_impl_vulkan.h>
+
+#include "benchmark.h"
+#include "camera_controller.h"
+#include "loader.h"
+#include "rendering/scene.h"
+
+// distance between neighbouring instances
+const float BENCHMARK_SPACING = 3.0f;
+
+// the offscreen size, matches the default window
+const uint32_t BENCHMARK_DISPLAY_WIDTH = 800;
+const uint32_t BENCHMARK_DISPLAY_HEIGHT = 600;
+
+static const char *LAYOUT_NAMES[] = { "grid", "volume", "random" };
+static const char *CULLING_MODE_NAMES[] = { "none", "cpu", "gpu", "gpu_occlusion" };
+
+struct Percentiles {
+	double p50;
+	double p95;
+	double p99;
+};
+
+struct SceneResult {
+	const BenchmarkScene *pScene;
+	CullingMode cullingMode;
+
+	Percentiles frameTime;
+	Percentiles cpuTime;
+	// empty without timestamps
+	std::vector<double> gpuTimes;
+	Percentiles gpuTime;
+
+	// averaged over the measured frames
+	double drawCalls;
+	double triangles;
+
+	bool pipelineStatistics;
+	PipelineStatistics statistics;
+
+	MemoryStatistics memory;
+};
+
+static Percentiles computePercentiles(std::vector<double> values) {
+	if (values.empty()) {
+		return {};
+	}
+
+	std::sort(values.begin(), values.end());
+
+	// nearest rank
+	auto percentile = [&values](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * values.size()));
+		return values[std::min(values.size() - 1, std::max<size_t>(rank, 1) - 1)];
+	};
+
+	return { percentile(50.0), percentile(95.0), percentile(99.0) };
+}
+
+// Returns the center and radius of the instances.
+static void buildScene(Scene *pScene, Mesh *pMesh, const BenchmarkScene &description, glm::vec3 *pCenter, float *pRadius) {
+	pScene->clear();
+
+	NodeId root = pScene->createNode(NODE_NONE, glm::mat4(1.0f));
+
+	uint32_t count = description.instanceCount;
+	glm::vec3 extent(0.0f);
+
+	if (description.layout == BENCHMARK_LAYOUT_RANDOM) {
+		float size = std::cbrt(static_cast<float>(count)) * BENCHMARK_SPACING;
+
+		// fixed seed, every run renders the same scene
+		std::mt19937 generator(1337);
+		std::uniform_real_distribution<float> position(0.0f, size);
+		std::uniform_real_distribution<float> angle(0.0f, glm::two_pi<float>());
+
+		for (uint32_t i = 0; i < count; i++) {
+			glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(position(generator), position(generator), position(generator)));
+			transform = glm::rotate(transform, angle(generator), glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f)));
+
+			pScene->createNode(root, transform, pMesh);
+		}
+
+		extent = glm::vec3(size);
+	} else {
+		bool volume = description.layout == BENCHMARK_LAYOUT_VOLUME;
+		uint32_t side = static_cast<uint32_t>(std::ceil(volume ? std::cbrt(static_cast<double>(count)) : std::sqrt(static_cast<double>(count))));
+
+		for (uint32_t i = 0; i < count; i++) {
+			glm::vec3 cell(i % side, (i / side) % side, volume ? i / (side * side) : 0);
+
+			pScene->createNode(root, glm::translate(glm::mat4(1.0f), cell * BENCHMARK_SPACING), pMesh);
+			extent = glm::max(extent, cell * BENCHMARK_SPACING);
+		}
+	}
+
+	*pCenter = extent * 0.5f;
+	*pRadius = glm::length(extent) * 0.5f;
+}
+
+static void writePercentiles(std::ofstream &file, const char *pName, const Percentiles &percentiles) {
+	file << "\t\t\t\"" << pName << "\": { \"p50\": " << percentiles.p50 << ", \"p95\": " << percentiles.p95 << ", \"p99\": " << percentiles.p99 << " },\n";
+}
+
+static bool writeResults(const std::string &path, const std::string &deviceName, const BenchmarkOptions &options, const std::vector<SceneResult> &results) {
+	std::ofstream file(path, std::ios::trunc);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\n";
+	file << "\t\"device\": \"" << deviceName << "\",\n";
+	file << "\t\"warmupFrames\": " << options.warmupFrames << ",\n";
+	file << "\t\"measuredFrames\": " << options.measuredFrames << ",\n";
+	file << "\t\"scenes\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const SceneResult &result = results[i];
+
+		file << "\t\t{\n";
+		file << "\t\t\t\"name\": \"" << result.pScene->name << "\",\n";
+		file << "\t\t\t\"mesh\": \"" << result.pScene->meshPath << "\",\n";
+		file << "\t\t\t\"instances\": " << result.pScene->instanceCount << ",\n";
+		file << "\t\t\t\"layout\": \"" << LAYOUT_NAMES[result.pScene->layout] << "\",\n";
+		file << "\t\t\t\"culling\": \"" << CULLING_MODE_NAMES[result.cullingMode] << "\",\n";
+
+		// milliseconds, cpu is the frame without waiting for the GPU
+		writePercentiles(file, "frameMs", result.frameTime);
+		writePercentiles(file, "cpuMs", result.cpuTime);
+
+		if (result.gpuTimes.empty()) {
+			file << "\t\t\t\"gpuMs\": null,\n";
+		} else {
+			writePercentiles(file, "gpuMs", result.gpuTime);
+		}
+
+		file << "\t\t\t\"drawCalls\": " << result.drawCalls << ",\n";
+		file << "\t\t\t\"triangles\": " << result.triangles << ",\n";
+
+		// what is left after GPU culling, of the last frame
+		if (result.pipelineStatistics) {
+			file << "\t\t\t\"clippingPrimitives\": " << result.statistics.clippingPrimitives << ",\n";
+		} else {
+			file << "\t\t\t\"clippingPrimitives\": null,\n";
+		}
+
+		file << "\t\t\t\"memory\": { \"allocations\": " << result.memory.allocationCount << ", \"allocationBytes\": " << result.memory.allocationBytes
+			 << ", \"blockBytes\": " << result.memory.blockBytes << " }\n";
+		file << "\t\t}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	file << "\t]\n}\n";
+
+	if (!file.good()) {
+		printf("Failed to write %s\n", path.c_str());
+		return false;
+	}
+
+	printf("Benchmark: wrote %zu scenes to %s\n", results.size(), path.c_str());
+	return true;
+}
+
+glm::vec3 CameraPath::evaluate(float t) {
+	uint32_t count = static_cast<uint32_t>(_points.size());
+
+	float position = (t - std::floor(t)) * count;
+	uint32_t segment = std::min(static_cast<uint32_t>(position), count - 1);
+	float f = position - segment;
+
+	const glm::vec3 &p0 = _points[(segment + count - 1) % count];
+	const glm::vec3 &p1 = _points[segment];
+	const glm::vec3 &p2 = _points[(segment + 1) % count];
+	const glm::vec3 &p3 = _points[(segment + 2) % count];
+
+	return 0.5f * (2.0f * p1 + (p2 - p0) * f + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * f * f + (3.0f * p1 - p0 - 3.0f * p2 + p3) * f * f * f);
+}
+
+CameraPath CameraPath::orbit(const glm::vec3 &center, float radius) {
+	// small scenes still get a view from outside
+	radius = std::max(radius, 5.0f);
+
+	std::vector<glm::vec3> points;
+
+	for (uint32_t i = 0; i < 8; i++) {
+		float angle = glm::two_pi<float>() * i / 8.0f;
+		// in close and back out, low and high
+		float distance = radius * (i % 2 == 0 ? 1.2f : 0.6f);
+		float height = radius * (0.3f + 0.2f * (i % 3));
+
+		points.push_back(center + glm::vec3(std::cos(angle) * distance, std::sin(angle) * distance, height));
+	}
+
+	return CameraPath(points);
+}
+
+CameraPath::CameraPath(const std::vector<glm::vec3> &points) {
+	_points = points;
+}
+
+const std::vector<BenchmarkScene> &Benchmark::getScenes() {
+	static const std::vector<BenchmarkScene> scenes = {
+		{ "grid_1k", "models/cube.obj", 1000, BENCHMARK_LAYOUT_GRID, CULLING_MODE_NONE },
+		{ "grid_100k_cpu", "models/cube.obj", 100000, BENCHMARK_LAYOUT_GRID, CULLING_MODE_CPU },
+		{ "grid_100k_gpu", "models/cube.obj", 100000, BENCHMARK_LAYOUT_GRID, CULLING_MODE_GPU },
+		{ "volume_100k_occlusion", "models/cube.obj", 100000, BENCHMARK_LAYOUT_VOLUME, CULLING_MODE_GPU_OCCLUSION },
+		{ "spheres_10k_random", "models/sphere.obj", 10000, BENCHMARK_LAYOUT_RANDOM, CULLING_MODE_GPU },
+	};
+
+	return scenes;
+}
+
+// Once no frame draws them anymore.
+static void destroyMeshes(Renderer *pRenderer, std::map<std::string, Mesh> *pMeshes) {
+	pRenderer->waitIdle();
+
+	for (auto &entry : *pMeshes) {
+		pRenderer->meshDestroy(&entry.second);
+	}
+
+	pMeshes->clear();
+}
+
+bool Benchmark::run(Renderer *pRenderer, ThreadPool *pThreadPool, const BenchmarkOptions &options) {
+	std::vector<const BenchmarkScene *> scenes;
+
+	for (const BenchmarkScene &scene : getScenes()) {
+		if (options.sceneName.empty() || options.sceneName == scene.name) {
+			scenes.push_back(&scene);
+		}
+	}
+
+	if (scenes.empty()) {
+		printf("Unknown benchmark scene %s\n", options.sceneName.c_str());
+		return false;
+	}
+
+	if (options.measuredFrames == 0) {
+		printf("A benchmark needs at least one measured frame\n");
+		return false;
+	}
+
+	IMGUI_CHECKVERSION();
+	ImGui::CreateContext();
+
+	// nothing is drawn, but the renderer records ImGui's draw data every frame
+	ImGui::GetIO().DisplaySize = ImVec2(static_cast<float>(BENCHMARK_DISPLAY_WIDTH), static_cast<float>(BENCHMARK_DISPLAY_HEIGHT));
+	pRenderer->initImGui();
+
+	GpuProfiler *pGpuProfiler = pRenderer->getGpuProfiler();
+
+	// timestamps lag behind by the frames in flight, render until they are in
+	uint32_t trailingFrames = pGpuProfiler->hasTimestamps() ? MAX_FRAMES_IN_FLIGHT : 0;
+
+	uint32_t frameIndex = 0;
+
+	std::map<std::string, Mesh> meshes;
+	std::vector<SceneResult> results;
+
+	for (const BenchmarkScene *pDescription : scenes) {
+		if (meshes.find(pDescription->meshPath) == meshes.end()) {
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+
+			if (!Loader::load_mesh(pDescription->meshPath, &vertices, &indices)) {
+				printf("Failed to load %s\n", pDescription->meshPath);
+				destroyMeshes(pRenderer, &meshes);
+				return false;
+			}
+
+			meshes[pDescription->meshPath] = pRenderer->meshCreate(vertices, indices);
+		}
+
+		Scene scene(pThreadPool);
+		glm::vec3 center;
+		float radius;
+
+		buildScene(&scene, &meshes[pDescription->meshPath], *pDescription, &center, &radius);
+
+		// unsupported modes are reported and leave the previous one
+		pRenderer->setCullingMode(pDescription->cullingMode);
+
+		CameraController cameraController;
+		cameraController.setCamera(pRenderer->getCamera());
+
+		CameraPath path = CameraPath::orbit(center, radius);
+
+		SceneResult result{};
+		result.pScene = pDescription;
+		result.cullingMode = pRenderer->getCullingMode();
+
+		std::vector<double> frameTimes;
+		std::vector<double> cpuTimes;
+		uint64_t drawCalls = 0;
+		uint64_t triangles = 0;
+
+		uint32_t firstMeasured = frameIndex + options.warmupFrames;
+		uint32_t frameCount = options.warmupFrames + options.measuredFrames + trailingFrames;
+		uint32_t collected = pGpuProfiler->getCollectedFrameCount();
+
+		// profiler numbers of the measured frames, a frame that wasn't drawn
+		// has none and the profiler skips frames it can't read back, so they
+		// don't follow frameIndex or the collected count
+		uint32_t firstMeasuredNumber = UINT32_MAX;
+		uint32_t endMeasuredNumber = 0;
+
+		for (uint32_t frame = 0; frame < frameCount; frame++, frameIndex++) {
+			// warm up at the start of the path, the measured frames go around once
+			float t = frame < options.warmupFrames ? 0.0f : static_cast<float>(frame - options.warmupFrames) / options.measuredFrames;
+
+			cameraController.setPosition(path.evaluate(t));
+			cameraController.lookAt(center);
+
+			auto start = std::chrono::steady_clock::now();
+			uint32_t frameNumber = pGpuProfiler->getFrameNumber();
+
+			ImGui_ImplVulkan_NewFrame();
+			ImGui::NewFrame();
+			ImGui::Render();
+
+			pRenderer->drawBegin();
+			pRenderer->drawScene(&scene);
+			pRenderer->drawEnd();
+
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			bool measured = frameIndex >= firstMeasured && frameIndex < firstMeasured + options.measuredFrames;
+
+			if (measured) {
+				FrameStatistics statistics = pRenderer->getFrameStatistics();
+
+				frameTimes.push_back(milliseconds);
+				cpuTimes.push_back(milliseconds - statistics.waitMilliseconds);
+				drawCalls += statistics.drawCalls;
+				triangles += statistics.triangles;
+
+				if (pGpuProfiler->getFrameNumber() > frameNumber) {
+					firstMeasuredNumber = std::min(firstMeasuredNumber, frameNumber);
+					endMeasuredNumber = frameNumber + 1;
+				}
+			}
+
+			// drawBegin() collected an earlier frame
+			for (; collected < pGpuProfiler->getCollectedFrameCount(); collected++) {
+				uint32_t number = pGpuProfiler->getCollectedFrameNumber(collected);
+
+				if (number >= firstMeasuredNumber && number < endMeasuredNumber) {
+					result.gpuTimes.push_back(pGpuProfiler->getFrameMilliseconds(collected));
+				}
+			}
+		}
+
+		result.frameTime = computePercentiles(frameTimes);
+		result.cpuTime = computePercentiles(cpuTimes);
+		result.gpuTime = computePercentiles(result.gpuTimes);
+		result.drawCalls = static_cast<double>(drawCalls) / options.measuredFrames;
+		result.triangles = static_cast<double>(triangles) / options.measuredFrames;
+		result.pipelineStatistics = pRenderer->getPipelineStatistics(&result.statistics);
+		result.memory = pRenderer->getMemoryStatistics();
+
+		printf("%-24s frame %7.3f / %7.3f / %7.3f ms, cpu %7.3f / %7.3f / %7.3f ms, gpu %7.3f / %7.3f / %7.3f ms (p50 / p95 / p99)\n",
+				pDescription->name, result.frameTime.p50, result.frameTime.p95, result.frameTime.p99,
+				result.cpuTime.p50, result.cpuTime.p95, result.cpuTime.p99,
+				result.gpuTime.p50, result.gpuTime.p95, result.gpuTime.p99);
+
+		results.push_back(result);
+	}
+
+	destroyMeshes(pRenderer, &meshes);
+
+	return writeResults(options.path, pRenderer->getDeviceName(), options, results);
+}
@@ -0,0 +1,75 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "rendering/renderer.h"
+
+class ThreadPool;
+
+// Frames rendered before measuring, until caches, pipelines and the GPU clock
+// have settled.
+const uint32_t BENCHMARK_WARMUP_FRAMES = 60;
+const uint32_t BENCHMARK_MEASURED_FRAMES = 600;
+
+enum BenchmarkLayout {
+	// a square in the xy plane
+	BENCHMARK_LAYOUT_GRID,
+	// a cube of instances
+	BENCHMARK_LAYOUT_VOLUME,
+	// scattered with a fixed seed, randomly rotated
+	BENCHMARK_LAYOUT_RANDOM,
+};
+
+// What a benchmark renders.
+struct BenchmarkScene {
+	const char *name;
+	const char *meshPath;
+	uint32_t instanceCount;
+	BenchmarkLayout layout;
+	CullingMode cullingMode;
+};
+
+struct BenchmarkOptions {
+	// JSON results
+	std::string path;
+	// runs every built in scene when empty
+	std::string sceneName;
+	uint32_t warmupFrames = BENCHMARK_WARMUP_FRAMES;
+	uint32_t measuredFrames = BENCHMARK_MEASURED_FRAMES;
+};
+
+// A closed Catmull-Rom spline through the points.
+class CameraPath {
+private:
+	std::vector<glm::vec3> _points;
+
+public:
+	// t in [0, 1] is one loop, the speed between points varies with their
+	// distance.
+	glm::vec3 evaluate(float t);
+
+	// Circles center at changing distances and heights, radius is the
+	// scene's extent.
+	static CameraPath orbit(const glm::vec3 &center, float radius);
+
+	CameraPath(const std::vector<glm::vec3> &points);
+};
+
+// Renders scenes along a fixed camera path and reports frame time
+// percentiles. Everything depends on the frame index only, never on time, so
+// runs on the same device render the same frames.
+class Benchmark {
+public:
+	static const std::vector<BenchmarkScene> &getScenes();
+
+	// pRenderer must be initialized and mustn't have drawn a frame yet, the
+	// ImGui context is created here.
+	static bool run(Renderer *pRenderer, ThreadPool *pThreadPool, const BenchmarkOptions &options);
+};
+
+#endif // !BENCHMARK_H
@@ -1,4 +1,5 @@
 #include "camera_controller.h"
+#include <cmath>
 #include <glm/common.hpp>
 
 void CameraController::_setCameraTransform(const glm::vec3 &position, const glm::vec3 &rotation) {
@@ -55,3 +56,19 @@ void CameraController::setRotation(const glm::vec3 &rotation) {
 glm::vec3 CameraController::getRotation() {
 	return _rotation;
 }
+
+void CameraController::lookAt(const glm::vec3 &target) {
+	glm::vec3 offset = target - _position;
+
+	if (glm::dot(offset, offset) == 0.0f) {
+		return;
+	}
+
+	glm::vec3 direction = glm::normalize(offset);
+
+	// unrotated the camera looks along -y, see Camera::getViewMatrix()
+	_rotation.x = glm::clamp(std::asin(-direction.z), glm::radians(-89.9f), glm::radians(89.9f));
+	_rotation.z = std::atan2(direction.x, -direction.y);
+
+	_setCameraTransform(_position, _rotation);
+}
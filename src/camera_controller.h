@@ -28,6 +28,9 @@ public:
 
 	void setRotation(const glm::vec3 &rotation);
 	glm::vec3 getRotation();
+
+	// Turns towards target from the current position.
+	void lookAt(const glm::vec3 &target);
 };
 
 #endif // !CAMERA_CONTROLLER_H
@@ -0,0 +1,202 @@
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
+#include "cpu_profiler.h"
+
+// The zones of one thread. Only the owning thread writes zones and only the
+// frame mark reads them, each side publishes its index to the other.
+struct ThreadBuffer {
+	uint32_t index;
+	// guarded by threadsMutex, the frame mark copies it
+	std::string name;
+
+	CpuZone zones[CPU_PROFILER_BUFFER_SIZE];
+	std::atomic<uint64_t> written = 0;
+	std::atomic<uint64_t> read = 0;
+
+	// open zones, owning thread only
+	uint32_t depth = 0;
+};
+
+// never freed, a thread's last zones are read after it has exited
+static std::mutex threadsMutex;
+static std::vector<ThreadBuffer *> threads;
+static thread_local ThreadBuffer *threadBuffer = nullptr;
+
+static std::atomic<uint64_t> droppedZones = 0;
+
+// the rest belongs to the thread calling frameMark()
+static uint64_t frameStart = 0;
+static CpuFrame lastFrame;
+
+static uint32_t captureFramesLeft = 0;
+static std::string capturePath;
+static std::vector<CpuFrame> capturedFrames;
+
+static ThreadBuffer *getThreadBuffer() {
+	if (threadBuffer == nullptr) {
+		threadBuffer = new ThreadBuffer;
+
+		std::lock_guard<std::mutex> lock(threadsMutex);
+
+		threadBuffer->index = static_cast<uint32_t>(threads.size());
+		threadBuffer->name = "Thread " + std::to_string(threadBuffer->index);
+		threads.push_back(threadBuffer);
+	}
+
+	return threadBuffer;
+}
+
+static void writeTrace(const std::string &path, const std::vector<CpuFrame> &frames, uint32_t frameThread) {
+	std::ofstream file(path, std::ios::trunc);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s\n", path.c_str());
+		return;
+	}
+
+	// microseconds with nanosecond precision
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	std::vector<std::string> names;
+
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+
+		for (ThreadBuffer *pBuffer : threads) {
+			names.push_back(pBuffer->name);
+		}
+	}
+
+	for (uint32_t i = 0; i < names.size(); i++) {
+		file << (i > 0 ? "," : "") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+			 << ",\"args\":{\"name\":\"" << names[i] << "\"}}";
+	}
+
+	size_t zoneCount = 0;
+
+	// complete events, the viewer nests them by time, names are literals and
+	// need no escaping
+	auto writeEvent = [&file](const char *pName, uint64_t start, uint64_t end, uint32_t thread) {
+		file << ",\n{\"name\":\"" << pName << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread
+			 << ",\"ts\":" << start / 1000.0 << ",\"dur\":" << (end - start) / 1000.0 << "}";
+	};
+
+	for (const CpuFrame &frame : frames) {
+		writeEvent("Frame", frame.start, frame.end, frameThread);
+
+		for (uint32_t i = 0; i < frame.threads.size(); i++) {
+			for (const CpuZone &zone : frame.threads[i].zones) {
+				writeEvent(zone.pName, zone.start, zone.end, i);
+			}
+
+			zoneCount += frame.threads[i].zones.size();
+		}
+	}
+
+	file << "\n]}\n";
+
+	if (!file.good()) {
+		printf("Failed to write %s\n", path.c_str());
+		return;
+	}
+
+	printf("CPU trace: wrote %zu frames (%zu zones) to %s\n", frames.size(), zoneCount, path.c_str());
+}
+
+uint64_t CpuProfiler::beginZone() {
+	getThreadBuffer()->depth++;
+	return now();
+}
+
+void CpuProfiler::endZone(const char *pName, uint64_t start) {
+	uint64_t end = now();
+	ThreadBuffer *pBuffer = getThreadBuffer();
+
+	pBuffer->depth--;
+
+	uint64_t written = pBuffer->written.load(std::memory_order_relaxed);
+
+	// the frame mark hasn't caught up, don't overwrite what it is reading
+	if (written - pBuffer->read.load(std::memory_order_acquire) >= CPU_PROFILER_BUFFER_SIZE) {
+		droppedZones.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	pBuffer->zones[written % CPU_PROFILER_BUFFER_SIZE] = { pName, start, end, pBuffer->depth };
+	pBuffer->written.store(written + 1, std::memory_order_release);
+}
+
+void CpuProfiler::setThreadName(const char *pName) {
+	ThreadBuffer *pBuffer = getThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(threadsMutex);
+	pBuffer->name = pName;
+}
+
+void CpuProfiler::frameMark() {
+	uint64_t time = now();
+	uint32_t frameThread = getThreadBuffer()->index;
+
+	lastFrame.start = frameStart;
+	lastFrame.end = time;
+
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+
+		lastFrame.threads.resize(threads.size());
+
+		for (uint32_t i = 0; i < threads.size(); i++) {
+			ThreadBuffer *pBuffer = threads[i];
+			CpuThreadZones *pZones = &lastFrame.threads[i];
+
+			pZones->name = pBuffer->name;
+			pZones->zones.clear();
+
+			uint64_t written = pBuffer->written.load(std::memory_order_acquire);
+			uint64_t read = pBuffer->read.load(std::memory_order_relaxed);
+
+			for (uint64_t j = read; j < written; j++) {
+				pZones->zones.push_back(pBuffer->zones[j % CPU_PROFILER_BUFFER_SIZE]);
+			}
+
+			pBuffer->read.store(written, std::memory_order_release);
+		}
+	}
+
+	frameStart = time;
+
+	if (captureFramesLeft == 0) {
+		return;
+	}
+
+	capturedFrames.push_back(lastFrame);
+
+	if (--captureFramesLeft == 0) {
+		writeTrace(capturePath, capturedFrames, frameThread);
+		capturedFrames.clear();
+	}
+}
+
+void CpuProfiler::capture(uint32_t frameCount, const std::string &path) {
+	captureFramesLeft = frameCount;
+	capturePath = path;
+	capturedFrames.clear();
+	capturedFrames.reserve(frameCount);
+}
+
+bool CpuProfiler::isCapturing() {
+	return captureFramesLeft > 0;
+}
+
+const CpuFrame &CpuProfiler::getLastFrame() {
+	return lastFrame;
+}
+
+uint64_t CpuProfiler::getDroppedZoneCount() {
+	return droppedZones.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,95 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Zones a thread can record between two frame marks, later ones are dropped.
+const uint32_t CPU_PROFILER_BUFFER_SIZE = 16384;
+
+// A timed scope, times are nanoseconds since the process started.
+struct CpuZone {
+	const char *pName;
+	uint64_t start;
+	uint64_t end;
+	// nesting level on its thread, 0 for zones that aren't inside another one
+	uint32_t depth;
+};
+
+struct CpuThreadZones {
+	std::string name;
+	// in the order they ended, nested zones before the zone around them
+	std::vector<CpuZone> zones;
+};
+
+// Everything that ended between two frame marks.
+struct CpuFrame {
+	uint64_t start = 0;
+	uint64_t end = 0;
+	// indexed like the threads of the trace, empty for threads that were idle
+	std::vector<CpuThreadZones> threads;
+};
+
+// Measures CPU time with scoped zones. Every thread records into a ring
+// buffer of its own without locking, the thread calling frameMark() moves
+// the zones out once per frame. Use the macros below, they compile to
+// nothing unless the build defines CPU_PROFILER (scons profiler=1).
+class CpuProfiler {
+public:
+	static uint64_t now() {
+		static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+	}
+
+	// Returns the start time endZone() takes.
+	static uint64_t beginZone();
+	// pName must outlive the profiler, e.g. a string literal.
+	static void endZone(const char *pName, uint64_t start);
+
+	// Shown in the trace instead of the thread's index.
+	static void setThreadName(const char *pName);
+
+	// Ends the current frame, call once per frame from the same thread.
+	static void frameMark();
+
+	// Writes the next frameCount frames as a Chrome trace (chrome://tracing,
+	// Perfetto) once they have ended. Replaces a capture in progress.
+	static void capture(uint32_t frameCount, const std::string &path);
+	static bool isCapturing();
+
+	// The last frame that ended, for the flame view.
+	static const CpuFrame &getLastFrame();
+
+	// zones lost to full ring buffers so far
+	static uint64_t getDroppedZoneCount();
+};
+
+// Times its own lifetime.
+class CpuProfileZone {
+private:
+	const char *_pName;
+	uint64_t _start;
+
+public:
+	CpuProfileZone(const char *pName) :
+			_pName(pName), _start(CpuProfiler::beginZone()) {}
+
+	~CpuProfileZone() { CpuProfiler::endZone(_pName, _start); }
+};
+
+#define CPU_PROFILER_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_INNER(a, b)
+
+#ifdef CPU_PROFILER
+#define PROFILE_ZONE(name) CpuProfileZone CPU_PROFILER_CONCAT(_profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) CpuProfiler::setThreadName(name)
+#define PROFILE_FRAME() CpuProfiler::frameMark()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_FRAME()
+#endif
+
+#endif // !CPU_PROFILER_H
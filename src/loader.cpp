@@ -1,9 +1,12 @@
 #include <stb_image.h>
 #include <tiny_obj_loader.h>
 
+#include "cpu_profiler.h"
 #include "loader.h"
 
 bool Loader::load_mesh(const char *p_path, std::vector<Vertex> *pVertices, std::vector<uint32_t> *pIndices) {
+	PROFILE_ZONE("Loader::load_mesh");
+
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
@@ -59,6 +62,8 @@ bool Loader::load_mesh(const char *p_path, std::vector<Vertex> *pVertices, std::
 }
 
 Image Loader::load_image(const char *p_path) {
+	PROFILE_ZONE("Loader::load_image");
+
 	int texWidth, texHeight, texChannels;
 	stbi_uc *pixels = stbi_load(p_path, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 
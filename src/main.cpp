@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <string>
 #include <vector>
 
 #include <SDL2/SDL.h>
@@ -9,14 +14,54 @@
 #include <imgui_impl_sdl2.h>
 #include <imgui_impl_vulkan.h>
 
+#include "benchmark.h"
 #include "camera_controller.h"
+#include "cpu_profiler.h"
 #include "loader.h"
+#include "rendering/object_transforms.h"
 #include "rendering/renderer.h"
+#include "rendering/scene.h"
+#include "rendering/shaders/shader_cache.h"
+#include "thread_pool.h"
 #include "time.h"
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+// frames a headless run renders before it exits, unless --frames is given
+const uint32_t HEADLESS_FRAME_COUNT = 300;
+
+// --resize-stress changes the size every frame for a while, like a dragged
+// window edge, then rests long enough for the debounced resize to happen
+const double RESIZE_STRESS_DRAG_SECONDS = 0.5;
+const double RESIZE_STRESS_REST_SECONDS = 0.5;
+
+// frames this many times slower than the median count as hitches
+const double HITCH_THRESHOLD = 2.0;
+
+// written by the GPU profilers' export buttons
+const char *GPU_PROFILE_PATH = "gpu_profile.csv";
+const char *POST_PROFILE_PATH = "post_profile.csv";
+
+// written by the CPU profiler's capture button, frames a capture covers
+// unless --trace-frames is given
+const char *CPU_TRACE_PATH = "cpu_trace.json";
+const uint32_t CPU_TRACE_FRAMES = 10;
+
+// What run() does besides rendering the scene.
+struct RunOptions {
+	// stops after this many frames, 0 runs until the window is closed
+	uint32_t frameCount = 0;
+	// simulates window resizes, only meaningful headless where the size
+	// isn't dictated by a surface
+	bool resizeStress = false;
+	// GPU profile CSV written when the run ends, none when empty
+	std::string gpuProfilePath;
+	// Chrome trace of the first frames, none when empty
+	std::string cpuTracePath;
+	uint32_t cpuTraceFrames = CPU_TRACE_FRAMES;
+};
+
 std::vector<const char *> getRequiredExtensions() {
 	uint32_t extensionCount = 0;
 	SDL_Vulkan_GetInstanceExtensions(nullptr, &extensionCount, nullptr);
@@ -27,7 +72,160 @@ std::vector<const char *> getRequiredExtensions() {
 	return extensions;
 }
 
-int run(SDL_Window *pWindow, Renderer *pRenderer) {
+void buildScene(Scene *pScene, Mesh *pMesh, int cubeCount, NodeId *pRoot) {
+	pScene->clear();
+
+	*pRoot = pScene->createNode(NODE_NONE, glm::mat4(1.0f));
+
+	int gridSize = (int)std::ceil(std::sqrt((double)cubeCount));
+
+	for (int i = 0; i < cubeCount; i++) {
+		glm::vec3 position = glm::vec3(i % gridSize, i / gridSize, 0.0f) * 3.0f;
+		pScene->createNode(*pRoot, glm::translate(glm::mat4(1.0f), position), pMesh);
+	}
+}
+
+void printResizeStress(Renderer *pRenderer, std::vector<double> frameTimes, uint32_t resizeCount) {
+	if (frameTimes.empty()) {
+		return;
+	}
+
+	std::sort(frameTimes.begin(), frameTimes.end());
+
+	double median = frameTimes[frameTimes.size() / 2];
+	double p99 = frameTimes[std::min(frameTimes.size() - 1, frameTimes.size() * 99 / 100)];
+
+	uint32_t hitches = 0;
+	for (double frameTime : frameTimes) {
+		if (frameTime > median * HITCH_THRESHOLD) {
+			hitches++;
+		}
+	}
+
+	SwapchainStatistics statistics = pRenderer->getSwapchainStatistics();
+	double average = statistics.recreations > 0 ? statistics.totalMilliseconds / statistics.recreations : 0.0;
+
+	printf("Resize stress: %u resizes, %u swapchain recreations (%u render pass), %.3f ms average, %.3f ms max\n",
+			resizeCount, statistics.recreations, statistics.renderPassRecreations, average, statistics.maxMilliseconds);
+	printf("Frame times: %.3f ms median, %.3f ms p99, %.3f ms max, %u hitches over %.1fx the median\n",
+			median, p99, frameTimes.back(), hitches, HITCH_THRESHOLD);
+}
+
+// Rolling graph of the first scope's GPU time and a table of every scope.
+void drawGpuProfiler(const char *pTitle, GpuProfiler *pProfiler, const char *pCsvPath) {
+	ImGui::Begin(pTitle);
+
+	const std::vector<GpuScopeHistory> &history = pProfiler->getHistory();
+	uint32_t count = pProfiler->getHistoryCount();
+	uint32_t offset = pProfiler->getHistoryOffset();
+
+	if (count > 0) {
+		// the renderer's first scope covers everything recorded for the queue
+		std::string label = history[0].name + " (ms)";
+		ImGui::PlotLines("##frame", history[0].milliseconds, count, offset, label.c_str(), 0.0f, FLT_MAX, ImVec2(0.0f, 80.0f));
+
+		uint32_t last = (offset + count - 1) % GPU_PROFILER_HISTORY;
+
+		if (ImGui::BeginTable("scopes", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+			ImGui::TableSetupColumn("Scope");
+			ImGui::TableSetupColumn("Last (ms)");
+			ImGui::TableSetupColumn("Average (ms)");
+			ImGui::TableSetupColumn("Max (ms)");
+			ImGui::TableHeadersRow();
+
+			for (const GpuScopeHistory &scope : history) {
+				float sum = 0.0f;
+				float max = 0.0f;
+
+				for (uint32_t i = 0; i < count; i++) {
+					sum += scope.milliseconds[i];
+					max = std::max(max, scope.milliseconds[i]);
+				}
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%*s%s", static_cast<int>(scope.depth * 2), "", scope.name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", scope.milliseconds[last]);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", sum / count);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", max);
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	if (ImGui::Button("Export CSV")) {
+		pProfiler->exportCsv(pCsvPath);
+	}
+
+	ImGui::End();
+}
+
+#ifdef CPU_PROFILER
+// Flame view of the last frame, a row per nesting level of every thread that
+// recorded zones.
+void drawCpuProfiler() {
+	ImGui::Begin("CPU profiler");
+
+	const CpuFrame &frame = CpuProfiler::getLastFrame();
+	uint64_t duration = frame.end - frame.start;
+
+	ImGui::Text("Frame: %.3f ms", duration / 1000000.0);
+	ImGui::Text("Dropped zones: %llu", (unsigned long long)CpuProfiler::getDroppedZoneCount());
+
+	if (CpuProfiler::isCapturing()) {
+		ImGui::Text("Capturing...");
+	} else if (ImGui::Button("Capture trace")) {
+		CpuProfiler::capture(CPU_TRACE_FRAMES, CPU_TRACE_PATH);
+	}
+
+	float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+	float width = ImGui::GetContentRegionAvail().x;
+	ImDrawList *pDrawList = ImGui::GetWindowDrawList();
+
+	for (const CpuThreadZones &thread : frame.threads) {
+		if (thread.zones.empty() || duration == 0) {
+			continue;
+		}
+
+		ImGui::TextUnformatted(thread.name.c_str());
+
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		uint32_t maxDepth = 0;
+
+		for (const CpuZone &zone : thread.zones) {
+			maxDepth = std::max(maxDepth, zone.depth);
+
+			// zones that started in an earlier frame are cut off
+			uint64_t start = std::max(zone.start, frame.start) - frame.start;
+			uint64_t end = std::min(zone.end, frame.end) - frame.start;
+
+			ImVec2 min(origin.x + width * start / duration, origin.y + rowHeight * zone.depth);
+			ImVec2 max(std::max(origin.x + width * end / duration, min.x + 1.0f), min.y + rowHeight - 1.0f);
+
+			pDrawList->AddRectFilled(min, max, ImColor::HSV(zone.depth * 0.15f, 0.5f, 0.6f));
+
+			pDrawList->PushClipRect(min, max, true);
+			pDrawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32_WHITE, zone.pName);
+			pDrawList->PopClipRect();
+
+			if (ImGui::IsMouseHoveringRect(min, max)) {
+				ImGui::SetTooltip("%s: %.3f ms", zone.pName, (zone.end - zone.start) / 1000000.0);
+			}
+		}
+
+		ImGui::Dummy(ImVec2(width, rowHeight * (maxDepth + 1)));
+	}
+
+	ImGui::End();
+}
+#endif
+
+// Without a window (headless) there is no input, the overlay is still drawn.
+int run(SDL_Window *pWindow, Renderer *pRenderer, ThreadPool *pThreadPool, const RunOptions &options) {
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
 
@@ -35,7 +233,15 @@ int run(SDL_Window *pWindow, Renderer *pRenderer) {
 	pIo->ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
 	pIo->ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad; // Enable Gamepad Controls
 
-	ImGui_ImplSDL2_InitForVulkan(pWindow);
+	if (pWindow != nullptr) {
+		ImGui_ImplSDL2_InitForVulkan(pWindow);
+	} else if (options.resizeStress) {
+		// the smallest simulated size, the overlay has to fit every extent
+		pIo->DisplaySize = ImVec2(static_cast<float>(WIDTH) * 0.5f, static_cast<float>(HEIGHT) * 0.5f);
+	} else {
+		pIo->DisplaySize = ImVec2(static_cast<float>(WIDTH), static_cast<float>(HEIGHT));
+	}
+
 	pRenderer->initImGui();
 
 	CameraController *pCameraController = new CameraController();
@@ -50,6 +256,16 @@ int run(SDL_Window *pWindow, Renderer *pRenderer) {
 
 	Image image = Loader::load_image("textures/raw_plank_wall_diff_1k.png");
 	Texture texture = pRenderer->textureCreate(image.width, image.height, image.format, image.data);
+	mesh.textureIndex = texture.index;
+
+	Scene *pScene = new Scene(pThreadPool);
+
+	int cubeCount = 1;
+	int sceneCubeCount = 0;
+	bool spin = false;
+	float angle = 0.0f;
+
+	NodeId root = NODE_NONE;
 
 	bool quit = false;
 
@@ -57,13 +273,29 @@ int run(SDL_Window *pWindow, Renderer *pRenderer) {
 
 	Time *pTime = new Time();
 
+	uint32_t frame = 0;
+	bool traceStarted = false;
+	uint64_t start = SDL_GetPerformanceCounter();
+
+	double elapsed = 0.0;
+	uint32_t resizeCount = 0;
+	std::vector<double> frameTimes;
+
 	while (!quit) {
+		PROFILE_FRAME();
+
+		// the frames before were loading
+		if (!traceStarted && !options.cpuTracePath.empty()) {
+			CpuProfiler::capture(options.cpuTraceFrames, options.cpuTracePath);
+			traceStarted = true;
+		}
+
 		pTime->startNewFrame();
 
 		double deltaTime = pTime->getDeltaTime();
 
 		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
+		while (pWindow != nullptr && SDL_PollEvent(&event)) {
 			if (event.type == SDL_QUIT) {
 				quit = true;
 			}
@@ -95,7 +327,7 @@ int run(SDL_Window *pWindow, Renderer *pRenderer) {
 			}
 		}
 
-		SDL_bool handleInput = SDL_GetRelativeMouseMode();
+		SDL_bool handleInput = pWindow != nullptr ? SDL_GetRelativeMouseMode() : SDL_FALSE;
 
 		if (handleInput) {
 			int x, y;
@@ -122,7 +354,14 @@ int run(SDL_Window *pWindow, Renderer *pRenderer) {
 		}
 
 		ImGui_ImplVulkan_NewFrame();
-		ImGui_ImplSDL2_NewFrame();
+
+		if (pWindow != nullptr) {
+			ImGui_ImplSDL2_NewFrame();
+		} else {
+			// ImGui wants time to pass, the first frame has no delta yet
+			pIo->DeltaTime = std::max(static_cast<float>(deltaTime), 1e-4f);
+		}
+
 		ImGui::NewFrame();
 
 		{
@@ -134,67 +373,403 @@ int run(SDL_Window *pWindow, Renderer *pRenderer) {
 			glm::vec3 position = pCameraController->getPosition();
 			ImGui::Text("Camera position: (%.2f, %.2f, %.2f)", position.x, position.y, position.z);
 
+			ImGui::SliderInt("Cubes", &cubeCount, 1, 100000, "%d", ImGuiSliderFlags_Logarithmic);
+			ImGui::Checkbox("Spin", &spin);
+
+			const char *cullingModes[] = { "None", "CPU", "GPU", "GPU + occlusion" };
+
+			int cullingMode = pRenderer->getCullingMode();
+			if (ImGui::Combo("Culling", &cullingMode, cullingModes, IM_ARRAYSIZE(cullingModes))) {
+				pRenderer->setCullingMode((CullingMode)cullingMode);
+			}
+
+			// each combination is a shader variant, built on first use
+			ImGui::CheckboxFlags("Texture", &mesh.materialFeatures, MATERIAL_FEATURE_TEXTURE);
+			ImGui::CheckboxFlags("Vertex color", &mesh.materialFeatures, MATERIAL_FEATURE_VERTEX_COLOR);
+
+			const char *debugViews[] = { "None", "Normals", "Texture coordinates" };
+
+			int debugView = pRenderer->getDebugView();
+			if (ImGui::Combo("Debug view", &debugView, debugViews, IM_ARRAYSIZE(debugViews))) {
+				pRenderer->setDebugView((MaterialDebugView)debugView);
+			}
+
+			// the upscale attachments only exist with --dynamic-resolution or --render-scale
+			if (pRenderer->hasDynamicResolution()) {
+				float budget = pRenderer->getFrameBudget();
+				if (ImGui::SliderFloat("GPU budget (ms)", &budget, 0.0f, 33.3f, budget > 0.0f ? "%.1f" : "off")) {
+					pRenderer->setFrameBudget(budget);
+				}
+
+				// picked by the budget while there is one
+				float scale = pRenderer->getRenderScale();
+				ImGui::BeginDisabled(budget > 0.0f);
+				if (ImGui::SliderFloat("Render scale", &scale, DYNAMIC_RESOLUTION_MIN_SCALE, DYNAMIC_RESOLUTION_MAX_SCALE, "%.2f")) {
+					pRenderer->setRenderScale(scale);
+				}
+				ImGui::EndDisabled();
+
+				VkExtent2D renderExtent = pRenderer->getRenderExtent();
+				ImGui::Text("Render extent: %ux%u", renderExtent.width, renderExtent.height);
+
+				const char *upscaleFilters[] = { "Bilinear", "Edge aware" };
+
+				int upscaleFilter = pRenderer->getUpscaleFilter();
+				if (ImGui::Combo("Upscale filter", &upscaleFilter, upscaleFilters, IM_ARRAYSIZE(upscaleFilters))) {
+					pRenderer->setUpscaleFilter((UpscaleFilter)upscaleFilter);
+				}
+			}
+
+			// the chain only exists with --post-process
+			if (pRenderer->hasPostProcessing()) {
+				PostProcessSettings settings = pRenderer->getPostProcessSettings();
+				bool changed = false;
+
+				changed |= ImGui::Checkbox("Bloom", &settings.bloom);
+				changed |= ImGui::SliderFloat("Bloom threshold", &settings.bloomThreshold, 0.0f, 4.0f, "%.2f");
+				changed |= ImGui::SliderFloat("Bloom intensity", &settings.bloomIntensity, 0.0f, 2.0f, "%.2f");
+				changed |= ImGui::Checkbox("Sharpen", &settings.sharpen);
+				changed |= ImGui::SliderFloat("Sharpness", &settings.sharpness, 0.0f, 1.0f, "%.2f");
+
+				if (changed) {
+					pRenderer->setPostProcessSettings(settings);
+				}
+
+				// the output shown is a frame late with async compute
+				ImGui::Text("Async compute: %s", pRenderer->hasAsyncCompute() ? "on" : "off, on the graphics queue");
+			}
+
+			// vertex invocations follow the instances drawn, compare culling modes
+			PipelineStatistics statistics;
+			if (pRenderer->getPipelineStatistics(&statistics)) {
+				ImGui::Text("Vertex invocations: %llu", (unsigned long long)statistics.vertexInvocations);
+				ImGui::Text("Fragment invocations: %llu", (unsigned long long)statistics.fragmentInvocations);
+				ImGui::Text("Compute invocations: %llu", (unsigned long long)statistics.computeInvocations);
+			}
+
+			// compare against --legacy-render-pass
+			AttachmentTraffic traffic = pRenderer->getAttachmentTraffic();
+			ImGui::Text("Attachment loads: %u (%.2f MB)", traffic.loads, traffic.loadBytes / (1024.0 * 1024.0));
+			ImGui::Text("Attachment stores: %u (%.2f MB)", traffic.stores, traffic.storeBytes / (1024.0 * 1024.0));
+
+			ImGui::End();
+		}
+
+		GpuProfiler *pGpuProfiler = pRenderer->getGpuProfiler();
+
+		if (pGpuProfiler->hasTimestamps()) {
+			drawGpuProfiler("GPU profiler", pGpuProfiler, GPU_PROFILE_PATH);
+		}
+
+		GpuProfiler *pPostProfiler = pRenderer->getPostProcessProfiler();
+
+		if (pPostProfiler != nullptr && pPostProfiler->hasTimestamps()) {
+			drawGpuProfiler("Post-processing profiler", pPostProfiler, POST_PROFILE_PATH);
+		}
+
+#ifdef CPU_PROFILER
+		drawCpuProfiler();
+#endif
+
+		// hot reloaded shaders that failed, the previous version is still in use
+		std::vector<std::string> shaderErrors = pRenderer->getShaderErrors();
+
+		if (!shaderErrors.empty()) {
+			ImGui::Begin("Shader errors");
+
+			for (const std::string &error : shaderErrors) {
+				ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", error.c_str());
+			}
+
 			ImGui::End();
 		}
 
 		ImGui::Render();
 
-		pRenderer->drawBegin();
+		if (cubeCount != sceneCubeCount) {
+			buildScene(pScene, &mesh, cubeCount, &root);
+			sceneCubeCount = cubeCount;
+		}
+
+		// moving the root dirties every cube below it
+		if (spin) {
+			angle += (float)deltaTime * 0.25f;
+			pScene->setLocalTransform(root, glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 0.0f, 1.0f)));
+		}
 
-		pRenderer->drawMesh(&mesh, glm::mat4(1.0f));
+		if (options.resizeStress) {
+			// the first frame has no delta yet
+			if (frame > 0) {
+				frameTimes.push_back(deltaTime * 1000.0);
+			}
+
+			elapsed += deltaTime;
+
+			if (std::fmod(elapsed, RESIZE_STRESS_DRAG_SECONDS + RESIZE_STRESS_REST_SECONDS) < RESIZE_STRESS_DRAG_SECONDS) {
+				float t = static_cast<float>(elapsed) * 4.0f;
+				uint32_t width = static_cast<uint32_t>(WIDTH * (0.75f + 0.25f * std::sin(t)));
+				uint32_t height = static_cast<uint32_t>(HEIGHT * (0.75f + 0.25f * std::cos(t)));
+
+				pRenderer->windowResize(width, height);
+				resizeCount++;
+			}
+		}
 
+		pRenderer->drawBegin();
+		pRenderer->drawScene(pScene);
 		pRenderer->drawEnd();
+
+		if (options.frameCount > 0 && ++frame == options.frameCount) {
+			quit = true;
+		}
 	}
 
 	pRenderer->waitIdle();
 
-	free(pCameraController);
-	free(pTime);
+	if (options.frameCount > 0) {
+		double seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+		printf("Rendered %u frames in %.2f s, %.3f ms per frame\n", frame, seconds, seconds * 1000.0 / frame);
+
+		AttachmentTraffic traffic = pRenderer->getAttachmentTraffic();
+		printf("Attachment traffic per frame: %u loads (%.2f MB), %u stores (%.2f MB)\n",
+				traffic.loads, traffic.loadBytes / (1024.0 * 1024.0), traffic.stores, traffic.storeBytes / (1024.0 * 1024.0));
+
+		if (pRenderer->hasDynamicResolution()) {
+			VkExtent2D renderExtent = pRenderer->getRenderExtent();
+			printf("Render scale: %.2f (%ux%u)\n", pRenderer->getRenderScale(), renderExtent.width, renderExtent.height);
+		}
+	}
+
+	if (options.resizeStress) {
+		printResizeStress(pRenderer, frameTimes, resizeCount);
+	}
+
+	if (!options.gpuProfilePath.empty()) {
+		pRenderer->getGpuProfiler()->exportCsv(options.gpuProfilePath);
+	}
+
+	if (CpuProfiler::isCapturing()) {
+		printf("CPU trace: the run ended before %u frames were captured\n", options.cpuTraceFrames);
+	}
+
+	delete pScene;
+
+	pRenderer->textureDestroy(&texture);
+	pRenderer->meshDestroy(&mesh);
+
+	delete pCameraController;
+	delete pTime;
 
 	return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[]) {
+	PROFILE_THREAD("Main");
+
 	bool useValidation = false;
+	bool cullBenchmark = false;
+	bool transformBenchmark = false;
+	bool usePipelineCache = true;
+	bool headless = false;
+	RenderPassConfig renderPassConfig = RENDER_PASS_CONFIG_TILE_OPTIMIZED;
+	bool dynamicResolution = false;
+	float frameBudget = 0.0f;
+	float renderScale = DYNAMIC_RESOLUTION_MAX_SCALE;
+	bool postProcessing = false;
+	bool asyncCompute = true;
+	RunOptions options;
+	BenchmarkOptions benchmarkOptions;
 
 	for (int i = 0; i < argc; i++) {
 		if (strcmp(argv[i], "--validation-layers") == 0) {
 			useValidation = true;
 		}
+
+		if (strcmp(argv[i], "--cull-benchmark") == 0) {
+			cullBenchmark = true;
+		}
+
+		if (strcmp(argv[i], "--transform-benchmark") == 0) {
+			transformBenchmark = true;
+		}
+
+		// only used by dev_shaders=1 builds, which compile shaders at startup
+		if (strcmp(argv[i], "--clear-shader-cache") == 0) {
+			printf("Removed %u shader cache entries\n", ShaderCache::clear());
+		}
+
+		// compare pipeline creation times against a cold start
+		if (strcmp(argv[i], "--no-pipeline-cache") == 0) {
+			usePipelineCache = false;
+		}
+
+		// no window, e.g. benchmarks and CI on lavapipe
+		if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		}
+
+		// stores every attachment, to compare attachment traffic and frame times
+		if (strcmp(argv[i], "--legacy-render-pass") == 0) {
+			renderPassConfig = RENDER_PASS_CONFIG_LEGACY;
+		}
+
+		// measures hitches while the size keeps changing, implies --headless
+		if (strcmp(argv[i], "--resize-stress") == 0) {
+			options.resizeStress = true;
+			headless = true;
+		}
+
+		// scales the render extent to keep the GPU time of a frame under the
+		// given milliseconds
+		if (strcmp(argv[i], "--dynamic-resolution") == 0 && i + 1 < argc) {
+			frameBudget = strtof(argv[++i], nullptr);
+			dynamicResolution = true;
+		}
+
+		// a fixed scale, e.g. to compare the upscale filters
+		if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+			renderScale = strtof(argv[++i], nullptr);
+			dynamicResolution = true;
+		}
+
+		// tonemaps, blooms and sharpens with compute passes
+		if (strcmp(argv[i], "--post-process") == 0) {
+			postProcessing = true;
+		}
+
+		// keeps the compute passes on the graphics queue, to compare
+		if (strcmp(argv[i], "--no-async-compute") == 0) {
+			asyncCompute = false;
+		}
+
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			options.frameCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+
+		// per pass GPU times of the last frames, written on exit
+		if (strcmp(argv[i], "--gpu-profile") == 0 && i + 1 < argc) {
+			options.gpuProfilePath = argv[++i];
+		}
+
+		// CPU zones of the first frames, needs a profiler=1 build
+		if (strcmp(argv[i], "--cpu-trace") == 0 && i + 1 < argc) {
+			options.cpuTracePath = argv[++i];
+		}
+
+		if (strcmp(argv[i], "--trace-frames") == 0 && i + 1 < argc) {
+			options.cpuTraceFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+
+		// renders the benchmark scenes and writes JSON results, implies
+		// --headless, --frames sets the measured frames
+		if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+			benchmarkOptions.path = argv[++i];
+			headless = true;
+		}
+
+		if (strcmp(argv[i], "--benchmark-scene") == 0 && i + 1 < argc) {
+			benchmarkOptions.sceneName = argv[++i];
+		}
+
+		if (strcmp(argv[i], "--warmup-frames") == 0 && i + 1 < argc) {
+			benchmarkOptions.warmupFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
 	}
 
-	// Wayland doesn't work, so force x11.
-	SDL_SetHint(SDL_HINT_VIDEODRIVER, "x11");
+	if (options.frameCount > 0) {
+		benchmarkOptions.measuredFrames = options.frameCount;
+	}
+
+#ifndef CPU_PROFILER
+	if (!options.cpuTracePath.empty()) {
+		printf("--cpu-trace needs a build with profiler=1, no trace is written\n");
+		options.cpuTracePath.clear();
+	}
+#endif
 
-	SDL_Init(SDL_INIT_VIDEO);
-	SDL_Window *pWindow = SDL_CreateWindow("3D Renderer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, SDL_WINDOW_RESIZABLE | SDL_WINDOW_VULKAN);
+	// a headless run always ends on its own
+	if (headless && options.frameCount == 0) {
+		options.frameCount = HEADLESS_FRAME_COUNT;
+	}
+
+	// CPU only, no window required
+	if (cullBenchmark) {
+		return Culling::benchmark(1000000) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
-	if (pWindow == nullptr) {
-		SDL_LogCritical(SDL_LOG_CATEGORY_VIDEO, "Failed to create window!\n");
-		return EXIT_FAILURE;
+	if (transformBenchmark) {
+		return ObjectTransforms::benchmark(1000000) ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	std::vector<const char *> extensions = getRequiredExtensions();
-	Renderer *pRenderer = new Renderer(extensions, useValidation);
+	SDL_Window *pWindow = nullptr;
+	// none without a display
+	std::vector<const char *> extensions;
 
-	VkSurfaceKHR surface;
-	SDL_bool result = SDL_Vulkan_CreateSurface(pWindow, pRenderer->getInstance(), &surface);
+	if (!headless) {
+		// Wayland doesn't work, so force x11.
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "x11");
 
-	if (result == SDL_FALSE) {
-		SDL_LogCritical(SDL_LOG_CATEGORY_VIDEO, "Failed to create surface!\n");
-		return EXIT_FAILURE;
+		SDL_Init(SDL_INIT_VIDEO);
+		pWindow = SDL_CreateWindow("3D Renderer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, SDL_WINDOW_RESIZABLE | SDL_WINDOW_VULKAN);
+
+		if (pWindow == nullptr) {
+			SDL_LogCritical(SDL_LOG_CATEGORY_VIDEO, "Failed to create window!\n");
+			return EXIT_FAILURE;
+		}
+
+		extensions = getRequiredExtensions();
 	}
 
-	int width, height;
-	SDL_Vulkan_GetDrawableSize(pWindow, &width, &height);
-	pRenderer->windowInit(surface, width, height);
+	Renderer *pRenderer = new Renderer(extensions, useValidation, usePipelineCache);
+
+	// shared by shader and pipeline creation and the scene updates
+	ThreadPool *pThreadPool = new ThreadPool();
+	pRenderer->setThreadPool(pThreadPool);
+	pRenderer->setRenderPassConfig(renderPassConfig);
+	pRenderer->setDynamicResolution(dynamicResolution);
+	pRenderer->setFrameBudget(frameBudget);
+	pRenderer->setRenderScale(renderScale);
+	pRenderer->setPostProcessing(postProcessing);
+	pRenderer->setAsyncCompute(asyncCompute);
+
+	bool initialized;
+
+	if (headless) {
+		initialized = pRenderer->headlessInit(WIDTH, HEIGHT);
+	} else {
+		VkSurfaceKHR surface;
+		SDL_bool result = SDL_Vulkan_CreateSurface(pWindow, pRenderer->getInstance(), &surface);
+
+		if (result == SDL_FALSE) {
+			SDL_LogCritical(SDL_LOG_CATEGORY_VIDEO, "Failed to create surface!\n");
+			return EXIT_FAILURE;
+		}
 
-	run(pWindow, pRenderer);
+		int width, height;
+		SDL_Vulkan_GetDrawableSize(pWindow, &width, &height);
+		initialized = pRenderer->windowInit(surface, width, height);
+	}
 
-	free(pRenderer);
+	int result = EXIT_SUCCESS;
+
+	if (!initialized) {
+		// the shader errors were printed
+		result = EXIT_FAILURE;
+	} else if (!benchmarkOptions.path.empty()) {
+		result = Benchmark::run(pRenderer, pThreadPool, benchmarkOptions) ? EXIT_SUCCESS : EXIT_FAILURE;
+	} else {
+		result = run(pWindow, pRenderer, pThreadPool, options);
+	}
+
+	// the destructor saves the pipeline cache
+	delete pRenderer;
+	delete pThreadPool;
+
+	if (pWindow != nullptr) {
+		SDL_DestroyWindow(pWindow);
+	}
 
-	SDL_DestroyWindow(pWindow);
 	SDL_Quit();
 
-	return EXIT_SUCCESS;
+	return result;
 }
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+
+#include "camera.h"
+#include "culling.h"
+
+void SphereBounds::resize(size_t count) {
+	centerX.resize(count);
+	centerY.resize(count);
+	centerZ.resize(count);
+	radius.resize(count);
+}
+
+void SphereBounds::set(size_t index, const glm::vec4 &localSphere, const glm::mat4 &transform) {
+	glm::vec4 center = transform * glm::vec4(glm::vec3(localSphere), 1.0f);
+
+	float scaleX = glm::length(glm::vec3(transform[0]));
+	float scaleY = glm::length(glm::vec3(transform[1]));
+	float scaleZ = glm::length(glm::vec3(transform[2]));
+
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	radius[index] = localSphere.w * std::max(scaleX, std::max(scaleY, scaleZ));
+}
+
+static void cullSpheresScalar(const Frustum &frustum, const SphereBounds &bounds, size_t begin, size_t end, uint8_t *pVisibility) {
+	for (size_t i = begin; i < end; i++) {
+		if (i % 8 == 0) {
+			pVisibility[i / 8] = 0;
+		}
+
+		bool visible = true;
+
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4 &plane = frustum.planes[p];
+			float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+
+			visible = visible && distance >= -bounds.radius[i];
+		}
+
+		pVisibility[i / 8] |= (uint8_t)visible << (i % 8);
+	}
+}
+
+#ifdef SIMD_KERNELS_X86
+
+__attribute__((target("sse2"))) static void cullSpheresSSE(const Frustum &frustum, const SphereBounds &bounds, uint8_t *pVisibility) {
+	size_t blockCount = bounds.size() / 8;
+
+	__m128 planes[6][4];
+	for (int p = 0; p < 6; p++) {
+		planes[p][0] = _mm_set1_ps(frustum.planes[p].x);
+		planes[p][1] = _mm_set1_ps(frustum.planes[p].y);
+		planes[p][2] = _mm_set1_ps(frustum.planes[p].z);
+		planes[p][3] = _mm_set1_ps(frustum.planes[p].w);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for (size_t block = 0; block < blockCount; block++) {
+		int mask = 0;
+
+		// two halves of four spheres make up one block of eight
+		for (int half = 0; half < 2; half++) {
+			size_t i = block * 8 + half * 4;
+
+			__m128 centerX = _mm_loadu_ps(&bounds.centerX[i]);
+			__m128 centerY = _mm_loadu_ps(&bounds.centerY[i]);
+			__m128 centerZ = _mm_loadu_ps(&bounds.centerZ[i]);
+			__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&bounds.radius[i]));
+
+			__m128 visible = _mm_cmpeq_ps(zero, zero);
+
+			for (int p = 0; p < 6; p++) {
+				__m128 distance = _mm_mul_ps(planes[p][0], centerX);
+				distance = _mm_add_ps(distance, _mm_mul_ps(planes[p][1], centerY));
+				distance = _mm_add_ps(distance, _mm_mul_ps(planes[p][2], centerZ));
+				distance = _mm_add_ps(distance, planes[p][3]);
+
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negRadius));
+			}
+
+			mask |= _mm_movemask_ps(visible) << (half * 4);
+		}
+
+		pVisibility[block] = (uint8_t)mask;
+	}
+
+	cullSpheresScalar(frustum, bounds, blockCount * 8, bounds.size(), pVisibility);
+}
+
+__attribute__((target("avx2"))) static void cullSpheresAVX2(const Frustum &frustum, const SphereBounds &bounds, uint8_t *pVisibility) {
+	size_t blockCount = bounds.size() / 8;
+
+	__m256 planes[6][4];
+	for (int p = 0; p < 6; p++) {
+		planes[p][0] = _mm256_set1_ps(frustum.planes[p].x);
+		planes[p][1] = _mm256_set1_ps(frustum.planes[p].y);
+		planes[p][2] = _mm256_set1_ps(frustum.planes[p].z);
+		planes[p][3] = _mm256_set1_ps(frustum.planes[p].w);
+	}
+
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (size_t block = 0; block < blockCount; block++) {
+		size_t i = block * 8;
+
+		__m256 centerX = _mm256_loadu_ps(&bounds.centerX[i]);
+		__m256 centerY = _mm256_loadu_ps(&bounds.centerY[i]);
+		__m256 centerZ = _mm256_loadu_ps(&bounds.centerZ[i]);
+		__m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&bounds.radius[i]));
+
+		__m256 visible = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+
+		for (int p = 0; p < 6; p++) {
+			__m256 distance = _mm256_mul_ps(planes[p][0], centerX);
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(planes[p][1], centerY));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(planes[p][2], centerZ));
+			distance = _mm256_add_ps(distance, planes[p][3]);
+
+			visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+		}
+
+		pVisibility[block] = (uint8_t)_mm256_movemask_ps(visible);
+	}
+
+	cullSpheresScalar(frustum, bounds, blockCount * 8, bounds.size(), pVisibility);
+}
+
+#endif // SIMD_KERNELS_X86
+
+AABB Culling::computeAABB(const std::vector<Vertex> &vertices) {
+	AABB aabb;
+	aabb.min = glm::vec3(std::numeric_limits<float>::max());
+	aabb.max = glm::vec3(std::numeric_limits<float>::lowest());
+
+	for (const Vertex &vertex : vertices) {
+		aabb.min = glm::min(aabb.min, vertex.pos);
+		aabb.max = glm::max(aabb.max, vertex.pos);
+	}
+
+	if (vertices.empty()) {
+		aabb.min = glm::vec3(0.0f);
+		aabb.max = glm::vec3(0.0f);
+	}
+
+	return aabb;
+}
+
+glm::vec4 Culling::computeBoundingSphere(const std::vector<Vertex> &vertices, const AABB &aabb) {
+	glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+	float radius = 0.0f;
+
+	for (const Vertex &vertex : vertices) {
+		radius = std::max(radius, glm::length(vertex.pos - center));
+	}
+
+	return glm::vec4(center, radius);
+}
+
+void Culling::cullSpheres(const Frustum &frustum, const SphereBounds &bounds, uint8_t *pVisibility, SimdKernel kernel) {
+	switch (kernel) {
+#ifdef SIMD_KERNELS_X86
+		case SIMD_KERNEL_SSE:
+			cullSpheresSSE(frustum, bounds, pVisibility);
+			break;
+		case SIMD_KERNEL_AVX2:
+			cullSpheresAVX2(frustum, bounds, pVisibility);
+			break;
+#endif
+		default:
+			cullSpheresScalar(frustum, bounds, 0, bounds.size(), pVisibility);
+			break;
+	}
+}
+
+void Culling::cullSpheres(const Frustum &frustum, const SphereBounds &bounds, uint8_t *pVisibility) {
+	static const SimdKernel bestKernel = SimdKernels::getBest(LAST_KERNEL);
+	cullSpheres(frustum, bounds, pVisibility, bestKernel);
+}
+
+bool Culling::benchmark(uint32_t sphereCount) {
+	const int iterations = 20;
+
+	Camera camera;
+	camera.transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 2.0f));
+
+	Frustum frustum = Frustum::fromMatrix(camera.getProjectionMatrix(16.0f / 9.0f) * camera.getViewMatrix());
+
+	// fixed seed, every run culls the same scene
+	std::mt19937 generator(1337);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> size(0.1f, 5.0f);
+
+	SphereBounds bounds;
+	bounds.resize(sphereCount);
+
+	for (uint32_t i = 0; i < sphereCount; i++) {
+		bounds.centerX[i] = position(generator);
+		bounds.centerY[i] = position(generator);
+		bounds.centerZ[i] = position(generator);
+		bounds.radius[i] = size(generator);
+	}
+
+	size_t byteCount = (sphereCount + 7) / 8;
+
+	std::vector<uint8_t> reference(byteCount);
+	cullSpheres(frustum, bounds, reference.data(), SIMD_KERNEL_SCALAR);
+
+	uint32_t visibleCount = 0;
+	for (uint32_t i = 0; i < sphereCount; i++) {
+		visibleCount += (reference[i / 8] >> (i % 8)) & 1;
+	}
+
+	printf("Culling %u spheres, %u visible, %d iterations\n", sphereCount, visibleCount, iterations);
+
+	std::vector<uint8_t> visibility(byteCount);
+
+	return SimdKernels::benchmark("sphere", sphereCount, iterations, LAST_KERNEL,
+			[&](SimdKernel kernel) {
+				cullSpheres(frustum, bounds, visibility.data(), kernel);
+			},
+			[&]() {
+				uint32_t mismatches = 0;
+				for (uint32_t i = 0; i < sphereCount; i++) {
+					mismatches += ((visibility[i / 8] ^ reference[i / 8]) >> (i % 8)) & 1;
+				}
+
+				// the next kernel starts from a cleared buffer too
+				std::fill(visibility.begin(), visibility.end(), 0);
+				return mismatches;
+			});
+}
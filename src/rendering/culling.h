@@ -0,0 +1,46 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frustum.h"
+#include "simd_kernels.h"
+#include "vertex.h"
+
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// World space bounding spheres as structure of arrays, culling kernels
+// load the same component of eight objects with a single instruction.
+struct SphereBounds {
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+
+	void resize(size_t count);
+	void set(size_t index, const glm::vec4 &localSphere, const glm::mat4 &transform);
+
+	size_t size() const { return radius.size(); }
+};
+
+class Culling {
+public:
+	static const SimdKernel LAST_KERNEL = SIMD_KERNEL_AVX2;
+
+	static AABB computeAABB(const std::vector<Vertex> &vertices);
+	static glm::vec4 computeBoundingSphere(const std::vector<Vertex> &vertices, const AABB &aabb);
+
+	// Writes one bit per sphere, eight spheres per byte. pVisibility must hold (size + 7) / 8 bytes.
+	static void cullSpheres(const Frustum &frustum, const SphereBounds &bounds, uint8_t *pVisibility, SimdKernel kernel);
+	static void cullSpheres(const Frustum &frustum, const SphereBounds &bounds, uint8_t *pVisibility);
+
+	// Times every supported kernel and checks it against the scalar reference.
+	static bool benchmark(uint32_t sphereCount);
+};
+
+#endif // !CULLING_H
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "descriptor_allocator.h"
+#include "vulkan_context.h"
+
+VkDescriptorPool DescriptorAllocator::_createPool(uint32_t setCount) {
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	poolSizes.reserve(_ratios.size());
+
+	for (const DescriptorPoolRatio &ratio : _ratios) {
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = ratio.type;
+		poolSize.descriptorCount = std::max(1u, static_cast<uint32_t>(std::ceil(ratio.ratio * setCount)));
+
+		poolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = _flags;
+	poolInfo.maxSets = setCount;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	VkDescriptorPool pool;
+	VK_CHECK(vkCreateDescriptorPool(_device, &poolInfo, nullptr, &pool), "Failed to create descriptor pool!");
+
+	return pool;
+}
+
+VkDescriptorPool DescriptorAllocator::_getPool() {
+	if (_readyPools.empty()) {
+		_readyPools.push_back(_createPool(_setsPerPool));
+
+		// fewer, larger pools once the first ones turned out too small
+		_setsPerPool = std::min(_setsPerPool * 2, DESCRIPTOR_POOL_MAX_SETS);
+	}
+
+	return _readyPools.back();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const void *pNext) {
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.pNext = pNext;
+	allocInfo.descriptorPool = _getPool();
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	VkResult result = vkAllocateDescriptorSets(_device, &allocInfo, &set);
+
+	// out of sets or descriptors, retry once with a new pool
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+		_fullPools.push_back(_readyPools.back());
+		_readyPools.pop_back();
+
+		allocInfo.descriptorPool = _getPool();
+		result = vkAllocateDescriptorSets(_device, &allocInfo, &set);
+	}
+
+	VK_CHECK(result, "Failed to allocate descriptor set!");
+	return set;
+}
+
+void DescriptorAllocator::reset() {
+	for (VkDescriptorPool pool : _readyPools) {
+		vkResetDescriptorPool(_device, pool, 0);
+	}
+
+	for (VkDescriptorPool pool : _fullPools) {
+		vkResetDescriptorPool(_device, pool, 0);
+		_readyPools.push_back(pool);
+	}
+
+	_fullPools.clear();
+}
+
+uint32_t DescriptorAllocator::getPoolCount() {
+	return static_cast<uint32_t>(_readyPools.size() + _fullPools.size());
+}
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device, uint32_t setsPerPool, const std::vector<DescriptorPoolRatio> &ratios, VkDescriptorPoolCreateFlags flags) {
+	_device = device;
+	_ratios = ratios;
+	_flags = flags;
+	_setsPerPool = std::min(setsPerPool, DESCRIPTOR_POOL_MAX_SETS);
+}
+
+DescriptorAllocator::~DescriptorAllocator() {
+	for (VkDescriptorPool pool : _readyPools) {
+		vkDestroyDescriptorPool(_device, pool, nullptr);
+	}
+
+	for (VkDescriptorPool pool : _fullPools) {
+		vkDestroyDescriptorPool(_device, pool, nullptr);
+	}
+}
+
+void DescriptorSetDesc::addBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	DescriptorWrite write;
+	write.binding = binding;
+	write.type = type;
+	write.buffer = buffer;
+	write.offset = offset;
+	write.range = range;
+
+	writes.push_back(write);
+}
+
+void DescriptorSetDesc::addImage(uint32_t binding, VkDescriptorType type, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout) {
+	DescriptorWrite write;
+	write.binding = binding;
+	write.type = type;
+	write.imageView = imageView;
+	write.sampler = sampler;
+	write.imageLayout = imageLayout;
+
+	writes.push_back(write);
+}
+
+VkDescriptorSet DescriptorCache::getSet(const DescriptorSetDesc &desc) {
+	auto it = _sets.find(desc);
+
+	if (it != _sets.end()) {
+		return it->second;
+	}
+
+	VkDescriptorSet set = _allocator.allocate(desc.layout);
+
+	uint32_t writeCount = static_cast<uint32_t>(desc.writes.size());
+
+	// sized up front, the writes point into them
+	std::vector<VkDescriptorBufferInfo> bufferInfos(writeCount);
+	std::vector<VkDescriptorImageInfo> imageInfos(writeCount);
+	std::vector<VkWriteDescriptorSet> descriptorWrites(writeCount);
+
+	for (uint32_t i = 0; i < writeCount; i++) {
+		const DescriptorWrite &write = desc.writes[i];
+
+		VkWriteDescriptorSet *pDescriptorWrite = &descriptorWrites[i];
+		pDescriptorWrite->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		pDescriptorWrite->dstSet = set;
+		pDescriptorWrite->dstBinding = write.binding;
+		pDescriptorWrite->dstArrayElement = 0;
+		pDescriptorWrite->descriptorType = static_cast<VkDescriptorType>(write.type);
+		pDescriptorWrite->descriptorCount = 1;
+
+		if (write.buffer != VK_NULL_HANDLE) {
+			bufferInfos[i].buffer = write.buffer;
+			bufferInfos[i].offset = write.offset;
+			bufferInfos[i].range = write.range;
+
+			pDescriptorWrite->pBufferInfo = &bufferInfos[i];
+		} else {
+			imageInfos[i].imageView = write.imageView;
+			imageInfos[i].sampler = write.sampler;
+			imageInfos[i].imageLayout = static_cast<VkImageLayout>(write.imageLayout);
+
+			pDescriptorWrite->pImageInfo = &imageInfos[i];
+		}
+	}
+
+	vkUpdateDescriptorSets(_device, writeCount, descriptorWrites.data(), 0, nullptr);
+
+	_sets.emplace(desc, set);
+	return set;
+}
+
+void DescriptorCache::reset() {
+	_sets.clear();
+	_allocator.reset();
+}
+
+uint32_t DescriptorCache::getSetCount() {
+	return static_cast<uint32_t>(_sets.size());
+}
+
+DescriptorCache::DescriptorCache(VkDevice device, uint32_t setsPerPool, const std::vector<DescriptorPoolRatio> &ratios) :
+		_allocator(device, setsPerPool, ratios) {
+	_device = device;
+}
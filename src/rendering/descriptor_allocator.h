@@ -0,0 +1,122 @@
+#ifndef DESCRIPTOR_ALLOCATOR_H
+#define DESCRIPTOR_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+// Upper bound for the sets of a single pool, pools double until they reach it.
+const uint32_t DESCRIPTOR_POOL_MAX_SETS = 4096;
+
+// Descriptors of a type reserved per set, e.g. 2 storage buffers for every set
+// a pool can hold.
+struct DescriptorPoolRatio {
+	VkDescriptorType type;
+	float ratio;
+};
+
+// Allocates descriptor sets from a list of pools. A full pool is set aside
+// and a larger one is created, so allocations don't fail when the sets in
+// use outgrow the initial guess. Sets aren't freed one by one, reset()
+// returns all of them at once.
+class DescriptorAllocator {
+private:
+	VkDevice _device;
+	std::vector<DescriptorPoolRatio> _ratios;
+	VkDescriptorPoolCreateFlags _flags;
+
+	// sets of the next pool that is created
+	uint32_t _setsPerPool;
+
+	std::vector<VkDescriptorPool> _fullPools;
+	// the last one is allocated from
+	std::vector<VkDescriptorPool> _readyPools;
+
+	VkDescriptorPool _createPool(uint32_t setCount);
+	VkDescriptorPool _getPool();
+
+public:
+	// pNext is chained to the allocate info, e.g. variable descriptor counts.
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void *pNext = nullptr);
+
+	// Frees every set, nothing may use them anymore. The pools are kept.
+	void reset();
+
+	uint32_t getPoolCount();
+
+	DescriptorAllocator(VkDevice device, uint32_t setsPerPool, const std::vector<DescriptorPoolRatio> &ratios, VkDescriptorPoolCreateFlags flags = 0);
+	~DescriptorAllocator();
+};
+
+// One descriptor of a set. Compared and hashed as raw bytes, so fields are
+// ordered to leave no padding and unused ones stay zero.
+struct DescriptorWrite {
+	uint32_t binding = 0;
+	uint32_t type = 0;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize range = 0;
+
+	VkImageView imageView = VK_NULL_HANDLE;
+	VkSampler sampler = VK_NULL_HANDLE;
+	uint32_t imageLayout = 0;
+	uint32_t padding = 0;
+};
+
+static_assert(std::has_unique_object_representations_v<DescriptorWrite>, "DescriptorWrite must not have padding");
+
+// The layout and contents of a descriptor set.
+struct DescriptorSetDesc {
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	std::vector<DescriptorWrite> writes;
+
+	void addBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	void addImage(uint32_t binding, VkDescriptorType type, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout);
+
+	bool operator==(const DescriptorSetDesc &other) const {
+		return layout == other.layout && writes.size() == other.writes.size() &&
+				memcmp(writes.data(), other.writes.data(), sizeof(DescriptorWrite) * writes.size()) == 0;
+	}
+
+	DescriptorSetDesc(VkDescriptorSetLayout setLayout) :
+			layout(setLayout) {}
+};
+
+namespace std {
+template <>
+struct hash<DescriptorSetDesc> {
+	size_t operator()(DescriptorSetDesc const &desc) const {
+		size_t hash = hashBytes(&desc.layout, sizeof(desc.layout));
+		return hashBytes(desc.writes.data(), sizeof(DescriptorWrite) * desc.writes.size(), hash);
+	}
+};
+} // namespace std
+
+// Descriptor sets by their contents, a set is written once and returned for
+// every identical description after that. Meant for transient sets, e.g. one
+// cache per frame in flight that is reset once the frame has finished, so no
+// cached set outlives the resources it points to.
+class DescriptorCache {
+private:
+	VkDevice _device;
+	DescriptorAllocator _allocator;
+
+	std::unordered_map<DescriptorSetDesc, VkDescriptorSet> _sets;
+
+public:
+	VkDescriptorSet getSet(const DescriptorSetDesc &desc);
+
+	// Frees all cached sets in bulk.
+	void reset();
+
+	uint32_t getSetCount();
+
+	DescriptorCache(VkDevice device, uint32_t setsPerPool, const std::vector<DescriptorPoolRatio> &ratios);
+};
+
+#endif // !DESCRIPTOR_ALLOCATOR_H
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cmath>
+
+#include "dynamic_resolution.h"
+
+static float snapScale(float scale) {
+	scale = std::round(scale / DYNAMIC_RESOLUTION_STEP) * DYNAMIC_RESOLUTION_STEP;
+	return std::clamp(scale, DYNAMIC_RESOLUTION_MIN_SCALE, DYNAMIC_RESOLUTION_MAX_SCALE);
+}
+
+void DynamicResolution::_setScale(float scale, uint32_t latency) {
+	if (scale != _scale) {
+		_scale = scale;
+		_staleFrames = latency;
+	}
+
+	_resetCounters();
+}
+
+void DynamicResolution::_resetCounters() {
+	_overFrames = 0;
+	_underFrames = 0;
+	_overMilliseconds = 0.0f;
+	_underMilliseconds = 0.0f;
+}
+
+float DynamicResolution::update(float gpuMilliseconds, uint32_t latency) {
+	// no timestamps, nothing to go by
+	if (_budget <= 0.0f || gpuMilliseconds <= 0.0f) {
+		return _scale;
+	}
+
+	if (_staleFrames > 0) {
+		_staleFrames--;
+		return _scale;
+	}
+
+	if (gpuMilliseconds > _budget) {
+		_underFrames = 0;
+		_underMilliseconds = 0.0f;
+
+		_overMilliseconds += gpuMilliseconds;
+
+		if (++_overFrames >= DYNAMIC_RESOLUTION_DECREASE_FRAMES) {
+			// GPU time follows the pixel count, the square of the scale, aim
+			// under the headroom so the next frames don't grow it right away
+			float average = _overMilliseconds / _overFrames;
+			float scale = _scale * std::sqrt(_budget * DYNAMIC_RESOLUTION_HEADROOM / average);
+
+			// at least a step down, counted in steps so rounding can't skip one
+			float steps = std::min(std::floor(scale / DYNAMIC_RESOLUTION_STEP), std::round(_scale / DYNAMIC_RESOLUTION_STEP) - 1.0f);
+
+			_setScale(snapScale(steps * DYNAMIC_RESOLUTION_STEP), latency);
+		}
+	} else if (gpuMilliseconds < _budget * DYNAMIC_RESOLUTION_HEADROOM) {
+		_overFrames = 0;
+		_overMilliseconds = 0.0f;
+
+		_underMilliseconds += gpuMilliseconds;
+
+		if (++_underFrames >= DYNAMIC_RESOLUTION_INCREASE_FRAMES) {
+			float average = _underMilliseconds / _underFrames;
+			float scale = snapScale(_scale + DYNAMIC_RESOLUTION_STEP);
+			float ratio = scale / _scale;
+
+			// a step up that would go over the budget would only come back down
+			if (average * ratio * ratio < _budget) {
+				_setScale(scale, latency);
+			} else {
+				_resetCounters();
+			}
+		}
+	} else {
+		// inside the band, hold
+		_resetCounters();
+	}
+
+	return _scale;
+}
+
+void DynamicResolution::setBudget(float milliseconds) {
+	_budget = std::max(milliseconds, 0.0f);
+	_staleFrames = 0;
+	_resetCounters();
+}
+
+void DynamicResolution::setScale(float scale) {
+	_scale = snapScale(scale);
+	_resetCounters();
+}
@@ -0,0 +1,53 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <cstdint>
+
+// Each side of the render extent is the scale times the swapchain's.
+const float DYNAMIC_RESOLUTION_MIN_SCALE = 0.5f;
+const float DYNAMIC_RESOLUTION_MAX_SCALE = 1.0f;
+// scales are multiples of it, smaller changes would only make the image swim
+const float DYNAMIC_RESOLUTION_STEP = 0.05f;
+
+// GPU time under this fraction of the budget lets the scale grow, between it
+// and the budget the scale holds.
+const float DYNAMIC_RESOLUTION_HEADROOM = 0.85f;
+
+// Consecutive frames over the budget before the scale drops, and under the
+// headroom before it grows. Dropping is quick, a missed frame shows.
+const uint32_t DYNAMIC_RESOLUTION_DECREASE_FRAMES = 3;
+const uint32_t DYNAMIC_RESOLUTION_INCREASE_FRAMES = 30;
+
+// Picks the render scale from the GPU time of finished frames, so the GPU
+// stays inside a frame time budget.
+class DynamicResolution {
+private:
+	// milliseconds, 0 keeps the scale fixed
+	float _budget = 0.0f;
+	float _scale = DYNAMIC_RESOLUTION_MAX_SCALE;
+
+	uint32_t _overFrames = 0;
+	uint32_t _underFrames = 0;
+	float _overMilliseconds = 0.0f;
+	float _underMilliseconds = 0.0f;
+
+	// frames recorded before the last change, they still show the old scale
+	uint32_t _staleFrames = 0;
+
+	void _setScale(float scale, uint32_t latency);
+	void _resetCounters();
+
+public:
+	// Takes the GPU time of a finished frame, latency is how many frames were
+	// recorded since then. Returns the scale of the next frame.
+	float update(float gpuMilliseconds, uint32_t latency);
+
+	void setBudget(float milliseconds);
+	float getBudget() { return _budget; }
+
+	// Used while there is no budget, snapped to a step.
+	void setScale(float scale);
+	float getScale() { return _scale; }
+};
+
+#endif // !DYNAMIC_RESOLUTION_H
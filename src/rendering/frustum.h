@@ -0,0 +1,35 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+struct Frustum {
+	// left, right, bottom, top, near, far; normals point inside
+	glm::vec4 planes[6];
+
+	static Frustum fromMatrix(const glm::mat4 &viewProj);
+};
+
+inline Frustum Frustum::fromMatrix(const glm::mat4 &viewProj) {
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	// -w <= z is conservative for both [-1, 1] and [0, 1] depth ranges
+	frustum.planes[4] = rows[3] + rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	for (int i = 0; i < 6; i++) {
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+	}
+
+	return frustum;
+}
+
+#endif // !FRUSTUM_H
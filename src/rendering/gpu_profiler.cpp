@@ -0,0 +1,238 @@
+#include <cstdio>
+#include <fstream>
+
+#include "gpu_profiler.h"
+
+GpuScopeHistory *GpuProfiler::_getHistory(const char *pName, uint32_t depth) {
+	for (GpuScopeHistory &history : _history) {
+		if (history.depth == depth && history.name == pName) {
+			return &history;
+		}
+	}
+
+	_history.emplace_back();
+	_history.back().name = pName;
+	_history.back().depth = depth;
+
+	return &_history.back();
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+	_currentFrame = currentFrame;
+	_depth = 0;
+	_frameScopes[currentFrame].clear();
+	_frameNumbers[currentFrame] = _begunFrames++;
+
+	if (_timestamps) {
+		vkCmdResetQueryPool(commandBuffer, _timestampPools[currentFrame], 0, GPU_PROFILER_MAX_SCOPES * 2);
+	}
+
+	// covers everything recorded until endFrame()
+	if (_statisticsPools[currentFrame] != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(commandBuffer, _statisticsPools[currentFrame], 0, 1);
+		vkCmdBeginQuery(commandBuffer, _statisticsPools[currentFrame], 0, 0);
+	}
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+	if (_statisticsPools[_currentFrame] != VK_NULL_HANDLE) {
+		vkCmdEndQuery(commandBuffer, _statisticsPools[_currentFrame], 0);
+		_statisticsRecorded[_currentFrame] = true;
+	}
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char *pName) {
+	std::vector<Scope> *pScopes = &_frameScopes[_currentFrame];
+
+	if (!_timestamps || pScopes->size() >= GPU_PROFILER_MAX_SCOPES) {
+		return UINT32_MAX;
+	}
+
+	uint32_t scope = static_cast<uint32_t>(pScopes->size());
+	pScopes->push_back({ pName, _depth++ });
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timestampPools[_currentFrame], scope * 2);
+
+	return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+	if (scope == UINT32_MAX) {
+		return;
+	}
+
+	_depth--;
+
+	// once everything before it has finished
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timestampPools[_currentFrame], scope * 2 + 1);
+}
+
+void GpuProfiler::collect(uint32_t frame) {
+	if (_statisticsRecorded[frame]) {
+		vkGetQueryPoolResults(_device, _statisticsPools[frame], 0, 1, sizeof(PipelineStatistics), &_pipelineStatistics, sizeof(PipelineStatistics), VK_QUERY_RESULT_64_BIT);
+		_statisticsRecorded[frame] = false;
+	}
+
+	std::vector<Scope> *pScopes = &_frameScopes[frame];
+
+	if (pScopes->empty()) {
+		return;
+	}
+
+	uint32_t queryCount = static_cast<uint32_t>(pScopes->size()) * 2;
+	uint64_t timestamps[GPU_PROFILER_MAX_SCOPES * 2];
+
+	// no wait flag, the frame has finished, VK_NOT_READY means it never ran
+	VkResult result = vkGetQueryPoolResults(_device, _timestampPools[frame], 0, queryCount, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+	if (result != VK_SUCCESS) {
+		pScopes->clear();
+		return;
+	}
+
+	uint32_t slot = _collectedFrames % GPU_PROFILER_HISTORY;
+	_historyFrameNumbers[slot] = _frameNumbers[frame];
+
+	// scopes missing from this frame show up as 0
+	for (GpuScopeHistory &history : _history) {
+		history.milliseconds[slot] = 0.0f;
+	}
+
+	for (uint32_t i = 0; i < pScopes->size(); i++) {
+		uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & _timestampMask;
+		double milliseconds = static_cast<double>(ticks) * _timestampPeriod / 1000000.0;
+
+		// the same name can be recorded several times, e.g. per pass
+		_getHistory((*pScopes)[i].pName, (*pScopes)[i].depth)->milliseconds[slot] += static_cast<float>(milliseconds);
+	}
+
+	_collectedFrames++;
+	pScopes->clear();
+}
+
+uint32_t GpuProfiler::getHistoryOffset() {
+	return _collectedFrames < GPU_PROFILER_HISTORY ? 0 : _collectedFrames % GPU_PROFILER_HISTORY;
+}
+
+uint32_t GpuProfiler::getHistoryCount() {
+	return _collectedFrames < GPU_PROFILER_HISTORY ? _collectedFrames : GPU_PROFILER_HISTORY;
+}
+
+float GpuProfiler::getFrameMilliseconds(uint32_t frame) {
+	float milliseconds = 0.0f;
+
+	for (const GpuScopeHistory &history : _history) {
+		if (history.depth == 0) {
+			milliseconds += history.milliseconds[frame % GPU_PROFILER_HISTORY];
+		}
+	}
+
+	return milliseconds;
+}
+
+bool GpuProfiler::getPipelineStatistics(PipelineStatistics *pStatistics) {
+	if (_statisticsPools[0] == VK_NULL_HANDLE) {
+		return false;
+	}
+
+	*pStatistics = _pipelineStatistics;
+	return true;
+}
+
+bool GpuProfiler::exportCsv(const std::string &path) {
+	std::ofstream file(path, std::ios::trunc);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	file << "frame";
+
+	for (const GpuScopeHistory &history : _history) {
+		file << "," << history.name;
+	}
+
+	file << "\n";
+
+	uint32_t count = getHistoryCount();
+	uint32_t offset = getHistoryOffset();
+
+	for (uint32_t i = 0; i < count; i++) {
+		file << _historyFrameNumbers[(offset + i) % GPU_PROFILER_HISTORY];
+
+		for (const GpuScopeHistory &history : _history) {
+			file << "," << history.milliseconds[(offset + i) % GPU_PROFILER_HISTORY];
+		}
+
+		file << "\n";
+	}
+
+	if (!file.good()) {
+		printf("Failed to write %s\n", path.c_str());
+		return false;
+	}
+
+	printf("GPU profile: wrote %u frames to %s\n", count, path.c_str());
+	return true;
+}
+
+GpuProfiler::GpuProfiler(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, bool pipelineStatistics) {
+	_device = device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+
+	_timestamps = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+	_timestampPeriod = properties.limits.timestampPeriod;
+	_timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+	if (!_timestamps) {
+		printf("GPU profiler: queue family %u doesn't support timestamps\n", queueFamily);
+	}
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		if (_timestamps) {
+			VkQueryPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			poolInfo.queryCount = GPU_PROFILER_MAX_SCOPES * 2;
+
+			VK_CHECK(vkCreateQueryPool(device, &poolInfo, nullptr, &_timestampPools[i]), "Failed to create query pool!");
+		}
+
+		if (pipelineStatistics) {
+			VkQueryPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			poolInfo.queryCount = 1;
+			// must match the fields of PipelineStatistics
+			poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+					VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+					VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+					VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+					VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+			VK_CHECK(vkCreateQueryPool(device, &poolInfo, nullptr, &_statisticsPools[i]), "Failed to create query pool!");
+		}
+	}
+}
+
+GpuProfiler::~GpuProfiler() {
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		if (_timestampPools[i] != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(_device, _timestampPools[i], nullptr);
+		}
+
+		if (_statisticsPools[i] != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(_device, _statisticsPools[i], nullptr);
+		}
+	}
+}
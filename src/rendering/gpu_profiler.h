@@ -0,0 +1,137 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vulkan_context.h"
+
+// Timestamp scopes one frame can record, two queries each.
+const uint32_t GPU_PROFILER_MAX_SCOPES = 32;
+
+// Frames kept for the rolling graph and the CSV export.
+const uint32_t GPU_PROFILER_HISTORY = 240;
+
+// Counted over a whole frame, in the order Vulkan writes them.
+struct PipelineStatistics {
+	uint64_t inputVertices;
+	uint64_t vertexInvocations;
+	uint64_t clippingPrimitives;
+	uint64_t fragmentInvocations;
+	uint64_t computeInvocations;
+};
+
+// GPU time of a scope over the last frames, a ring buffer that starts at
+// GpuProfiler::getHistoryOffset(). Frames the scope wasn't recorded in are 0.
+struct GpuScopeHistory {
+	std::string name;
+	// nesting level, 0 for scopes that aren't inside another one
+	uint32_t depth = 0;
+	float milliseconds[GPU_PROFILER_HISTORY] = {};
+};
+
+// Measures GPU time with timestamp queries. Each frame in flight records
+// into a query pool of its own, which is read back once the frame has
+// finished, so reading never waits for the GPU.
+class GpuProfiler {
+private:
+	struct Scope {
+		const char *pName;
+		uint32_t depth;
+	};
+
+	VkDevice _device;
+
+	// false when the queue can't write timestamps, scopes are ignored then
+	bool _timestamps = false;
+	// nanoseconds per tick
+	double _timestampPeriod = 0.0;
+	uint64_t _timestampMask = 0;
+
+	VkQueryPool _timestampPools[MAX_FRAMES_IN_FLIGHT] = {};
+	// null without pipelineStatisticsQuery
+	VkQueryPool _statisticsPools[MAX_FRAMES_IN_FLIGHT] = {};
+
+	// what each frame slot recorded, until it is collected
+	std::vector<Scope> _frameScopes[MAX_FRAMES_IN_FLIGHT];
+	bool _statisticsRecorded[MAX_FRAMES_IN_FLIGHT] = {};
+	uint32_t _frameNumbers[MAX_FRAMES_IN_FLIGHT] = {};
+
+	// the frame being recorded
+	uint32_t _currentFrame = 0;
+	uint32_t _depth = 0;
+
+	PipelineStatistics _pipelineStatistics{};
+
+	std::vector<GpuScopeHistory> _history;
+	// frame number of each history slot
+	uint32_t _historyFrameNumbers[GPU_PROFILER_HISTORY] = {};
+	// frames begun so far
+	uint32_t _begunFrames = 0;
+	// frames collected so far, frames that didn't run or recorded nothing are
+	// skipped
+	uint32_t _collectedFrames = 0;
+
+	GpuScopeHistory *_getHistory(const char *pName, uint32_t depth);
+
+public:
+	// Resets the frame slot's queries, call before anything else is recorded.
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+	void endFrame(VkCommandBuffer commandBuffer);
+
+	// pName must outlive the frame, e.g. a string literal. Returns the index
+	// endScope() takes, scopes past GPU_PROFILER_MAX_SCOPES aren't recorded.
+	uint32_t beginScope(VkCommandBuffer commandBuffer, const char *pName);
+	void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	// Reads back what the frame slot recorded, call once the frame that last
+	// used it has finished.
+	void collect(uint32_t frame);
+
+	bool hasTimestamps() { return _timestamps; }
+
+	// Scopes in the order they were first seen.
+	const std::vector<GpuScopeHistory> &getHistory() { return _history; }
+	// index of the oldest frame in the ring buffers
+	uint32_t getHistoryOffset();
+	// frames in the ring buffers, up to GPU_PROFILER_HISTORY
+	uint32_t getHistoryCount();
+	// frames collected so far, frame i is at i % GPU_PROFILER_HISTORY
+	uint32_t getCollectedFrameCount() { return _collectedFrames; }
+	// Frames are numbered by beginFrame(), from 0. This is the number the next
+	// one gets.
+	uint32_t getFrameNumber() { return _begunFrames; }
+	// number of a collected frame, which can be higher than its index
+	uint32_t getCollectedFrameNumber(uint32_t frame) { return _historyFrameNumbers[frame % GPU_PROFILER_HISTORY]; }
+	// GPU time of a collected frame, the sum of its top level scopes
+	float getFrameMilliseconds(uint32_t frame);
+
+	// Statistics of the last collected frame, false when the device can't
+	// count them.
+	bool getPipelineStatistics(PipelineStatistics *pStatistics);
+
+	// A row per frame of the history, oldest first, a column per scope.
+	bool exportCsv(const std::string &path);
+
+	GpuProfiler(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, bool pipelineStatistics);
+	~GpuProfiler();
+};
+
+// Times the commands recorded during its lifetime.
+class GpuProfileScope {
+private:
+	GpuProfiler *_pProfiler;
+	VkCommandBuffer _commandBuffer;
+	uint32_t _scope;
+
+public:
+	GpuProfileScope(GpuProfiler *pProfiler, VkCommandBuffer commandBuffer, const char *pName) :
+			_pProfiler(pProfiler), _commandBuffer(commandBuffer), _scope(pProfiler->beginScope(commandBuffer, pName)) {}
+
+	~GpuProfileScope() { _pProfiler->endScope(_commandBuffer, _scope); }
+};
+
+#endif // !GPU_PROFILER_H
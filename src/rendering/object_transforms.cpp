@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "object_transforms.h"
+
+static void computeScalar(const glm::mat4 &view, const glm::mat4 *pModels, const uint32_t *pIndices, ObjectData *pObjects, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		const glm::mat4 &model = pModels[pIndices[i]];
+		glm::mat4 modelView = view * model;
+		glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(modelView)));
+
+		ObjectData *pObject = &pObjects[i];
+		pObject->model = model;
+		pObject->modelView = modelView;
+
+		for (int column = 0; column < 3; column++) {
+			pObject->normal[column] = glm::vec4(normal[column], 0.0f);
+		}
+	}
+}
+
+#ifdef SIMD_KERNELS_X86
+
+#define SHUFFLE_YZX _MM_SHUFFLE(3, 0, 2, 1)
+#define SHUFFLE_ZXY _MM_SHUFFLE(3, 1, 0, 2)
+
+// w is zero for the columns of an affine matrix, and stays zero
+__attribute__((target("sse2"))) static inline __m128 cross(__m128 a, __m128 b) {
+	__m128 left = _mm_mul_ps(_mm_shuffle_ps(a, a, SHUFFLE_YZX), _mm_shuffle_ps(b, b, SHUFFLE_ZXY));
+	__m128 right = _mm_mul_ps(_mm_shuffle_ps(a, a, SHUFFLE_ZXY), _mm_shuffle_ps(b, b, SHUFFLE_YZX));
+
+	return _mm_sub_ps(left, right);
+}
+
+// sum of all lanes in every lane
+__attribute__((target("sse2"))) static inline __m128 horizontalSum(__m128 value) {
+	value = _mm_add_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+__attribute__((target("sse2"))) static void computeSSE(const glm::mat4 &view, const glm::mat4 *pModels, const uint32_t *pIndices, ObjectData *pObjects, uint32_t count) {
+	__m128 viewColumns[4];
+	for (int column = 0; column < 4; column++) {
+		viewColumns[column] = _mm_loadu_ps(&view[column][0]);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		const float *pModel = &pModels[pIndices[i]][0][0];
+		float *pObject = &pObjects[i].model[0][0];
+
+		__m128 modelView[4];
+
+		for (int column = 0; column < 4; column++) {
+			__m128 model = _mm_loadu_ps(pModel + column * 4);
+			_mm_storeu_ps(pObject + column * 4, model);
+
+			__m128 result = _mm_mul_ps(viewColumns[0], _mm_shuffle_ps(model, model, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm_add_ps(result, _mm_mul_ps(viewColumns[1], _mm_shuffle_ps(model, model, _MM_SHUFFLE(1, 1, 1, 1))));
+			result = _mm_add_ps(result, _mm_mul_ps(viewColumns[2], _mm_shuffle_ps(model, model, _MM_SHUFFLE(2, 2, 2, 2))));
+			result = _mm_add_ps(result, _mm_mul_ps(viewColumns[3], _mm_shuffle_ps(model, model, _MM_SHUFFLE(3, 3, 3, 3))));
+
+			modelView[column] = result;
+			_mm_storeu_ps(pObject + 16 + column * 4, result);
+		}
+
+		// the inverse transpose of a 3x3 matrix is its cofactor matrix over the determinant
+		__m128 bc = cross(modelView[1], modelView[2]);
+		__m128 ca = cross(modelView[2], modelView[0]);
+		__m128 ab = cross(modelView[0], modelView[1]);
+
+		// w of modelView[3] doesn't matter, bc.w is zero
+		__m128 determinant = horizontalSum(_mm_mul_ps(modelView[0], bc));
+		__m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+		_mm_storeu_ps(pObject + 32, _mm_mul_ps(bc, inverseDeterminant));
+		_mm_storeu_ps(pObject + 36, _mm_mul_ps(ca, inverseDeterminant));
+		_mm_storeu_ps(pObject + 40, _mm_mul_ps(ab, inverseDeterminant));
+	}
+}
+
+#endif // SIMD_KERNELS_X86
+
+void ObjectTransforms::compute(const glm::mat4 &view, const glm::mat4 *pModels, const uint32_t *pIndices, ObjectData *pObjects, uint32_t count, SimdKernel kernel) {
+	switch (kernel) {
+#ifdef SIMD_KERNELS_X86
+		case SIMD_KERNEL_SSE:
+			computeSSE(view, pModels, pIndices, pObjects, count);
+			break;
+#endif
+		default:
+			computeScalar(view, pModels, pIndices, pObjects, count);
+			break;
+	}
+}
+
+void ObjectTransforms::compute(const glm::mat4 &view, const glm::mat4 *pModels, const uint32_t *pIndices, ObjectData *pObjects, uint32_t count) {
+	static const SimdKernel bestKernel = SimdKernels::getBest(LAST_KERNEL);
+	compute(view, pModels, pIndices, pObjects, count, bestKernel);
+}
+
+bool ObjectTransforms::benchmark(uint32_t objectCount) {
+	const int iterations = 20;
+	const float tolerance = 1e-4f;
+
+	glm::mat4 view = glm::lookAt(glm::vec3(3.0f, 2.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+	// fixed seed, every run transforms the same objects
+	std::mt19937 generator(1337);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	std::uniform_real_distribution<float> scale(0.1f, 5.0f);
+
+	std::vector<glm::mat4> models(objectCount);
+	std::vector<uint32_t> indices(objectCount);
+
+	for (uint32_t i = 0; i < objectCount; i++) {
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(position(generator), position(generator), position(generator)));
+		model = glm::rotate(model, angle(generator), glm::normalize(glm::vec3(scale(generator), scale(generator), scale(generator))));
+		models[i] = glm::scale(model, glm::vec3(scale(generator), scale(generator), scale(generator)));
+
+		// reversed, like draws sorted away from scene order
+		indices[i] = objectCount - 1 - i;
+	}
+
+	std::vector<ObjectData> reference(objectCount);
+	compute(view, models.data(), indices.data(), reference.data(), objectCount, SIMD_KERNEL_SCALAR);
+
+	printf("Transforming %u objects, %d iterations\n", objectCount, iterations);
+
+	std::vector<ObjectData> objects(objectCount);
+
+	return SimdKernels::benchmark("object", objectCount, iterations, LAST_KERNEL,
+			[&](SimdKernel kernel) {
+				compute(view, models.data(), indices.data(), objects.data(), objectCount, kernel);
+			},
+			[&]() {
+				uint32_t mismatches = 0;
+				for (uint32_t i = 0; i < objectCount; i++) {
+					const float *pValues = &objects[i].model[0][0];
+					const float *pReference = &reference[i].model[0][0];
+
+					for (size_t j = 0; j < sizeof(ObjectData) / sizeof(float); j++) {
+						float difference = std::abs(pValues[j] - pReference[j]);
+
+						if (difference > tolerance * std::max(1.0f, std::abs(pReference[j]))) {
+							mismatches++;
+							break;
+						}
+					}
+				}
+
+				// the next kernel starts from a cleared buffer too
+				std::fill(objects.begin(), objects.end(), ObjectData{});
+				return mismatches;
+			});
+}
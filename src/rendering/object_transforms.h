@@ -0,0 +1,32 @@
+#ifndef OBJECT_TRANSFORMS_H
+#define OBJECT_TRANSFORMS_H
+
+#include <cstdint>
+
+#include "simd_kernels.h"
+#include "vertex.h"
+
+// Per object data read by the vertex stage, matches ObjectData in the
+// shaders. std430 stores mat3 columns with a vec4 stride.
+struct ObjectData {
+	glm::mat4 model;
+	glm::mat4 modelView;
+	// inverse transpose of the upper 3x3 of modelView, w is unused
+	glm::vec4 normal[3];
+};
+
+// Computes the object data of a frame once per object, so the vertex stage
+// doesn't invert a matrix per vertex.
+class ObjectTransforms {
+public:
+	static const SimdKernel LAST_KERNEL = SIMD_KERNEL_SSE;
+
+	// pObjects[i] is computed from pModels[pIndices[i]].
+	static void compute(const glm::mat4 &view, const glm::mat4 *pModels, const uint32_t *pIndices, ObjectData *pObjects, uint32_t count, SimdKernel kernel);
+	static void compute(const glm::mat4 &view, const glm::mat4 *pModels, const uint32_t *pIndices, ObjectData *pObjects, uint32_t count);
+
+	// Times every supported kernel and checks it against the scalar reference.
+	static bool benchmark(uint32_t objectCount);
+};
+
+#endif // !OBJECT_TRANSFORMS_H
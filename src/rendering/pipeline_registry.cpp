@@ -0,0 +1,550 @@
+#include "pipeline_registry.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <exception>
+
+#include "../thread_pool.h"
+#include "shaders/shader_rd.h"
+#include "shaders/spirv_reflection.h"
+#include "vertex.h"
+
+static VkShaderModule createShaderModule(VkDevice device, const std::vector<uint32_t> &spirv) {
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = spirv.size() * sizeof(uint32_t);
+	createInfo.pCode = spirv.data();
+
+	VkShaderModule shaderModule;
+	VK_CHECK(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule), "Failed to create shader module!");
+
+	return shaderModule;
+}
+
+ShaderLayoutDesc::ShaderLayoutDesc(const ShaderReflection &reflection) {
+	for (const ReflectedBinding &binding : reflection.bindings) {
+		if (binding.set >= PIPELINE_LAYOUT_MAX_SETS || sets[binding.set].bindingCount >= DESCRIPTOR_SET_MAX_BINDINGS) {
+			printf("Descriptor set %u binding %u exceeds the layout limits!\n", binding.set, binding.binding);
+			continue;
+		}
+
+		DescriptorSetLayoutDesc *pSet = &sets[binding.set];
+		DescriptorBindingDesc *pBinding = &pSet->bindings[pSet->bindingCount++];
+		pBinding->binding = binding.binding;
+		pBinding->type = binding.type;
+		pBinding->count = binding.count;
+		pBinding->stages = binding.stages;
+
+		setCount = std::max(setCount, binding.set + 1);
+	}
+
+	pushConstantSize = reflection.pushConstantSize;
+	pushConstantStages = reflection.pushConstantStages;
+}
+
+void PipelineRegistry::_waitForTasks() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_tasksDone.wait(lock, [this] { return _pendingTasks == 0; });
+}
+
+VkPipeline PipelineRegistry::_createPipeline(const PipelineStateDesc &desc) {
+	VkDevice device = _context->getDevice();
+
+	VkSpecializationMapEntry mapEntries[PIPELINE_SPECIALIZATION_CONSTANTS]{};
+	for (uint32_t i = 0; i < PIPELINE_SPECIALIZATION_CONSTANTS; i++) {
+		mapEntries[i].constantID = i;
+		mapEntries[i].offset = sizeof(uint32_t) * i;
+		mapEntries[i].size = sizeof(uint32_t);
+	}
+
+	// shaders without a constant ignore it
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = PIPELINE_SPECIALIZATION_CONSTANTS;
+	specializationInfo.pMapEntries = mapEntries;
+	specializationInfo.dataSize = sizeof(desc.specialization);
+	specializationInfo.pData = desc.specialization;
+
+	VkPipeline pipeline;
+
+	if (desc.pShader->isCompute()) {
+		VkShaderModule computeModule = createShaderModule(device, desc.pShader->getComputeCode(desc.variant));
+		pipeline = _createComputePipeline(desc, computeModule, &specializationInfo);
+
+		vkDestroyShaderModule(device, computeModule, nullptr);
+	} else {
+		std::vector<uint32_t> vertexCode = desc.pShader->getVertexCode(desc.variant);
+
+		ShaderReflection vertexReflection;
+		SpirvReflection::reflect(vertexCode, desc.specialization, PIPELINE_SPECIALIZATION_CONSTANTS, &vertexReflection);
+
+		VkShaderModule vertexModule = createShaderModule(device, vertexCode);
+		VkShaderModule fragmentModule = createShaderModule(device, desc.pShader->getFragmentCode(desc.variant));
+		pipeline = _createGraphicsPipeline(desc, vertexModule, fragmentModule, vertexReflection, &specializationInfo);
+
+		vkDestroyShaderModule(device, fragmentModule, nullptr);
+		vkDestroyShaderModule(device, vertexModule, nullptr);
+	}
+
+	return pipeline;
+}
+
+VkPipeline PipelineRegistry::_createGraphicsPipeline(const PipelineStateDesc &desc, VkShaderModule vertex, VkShaderModule fragment, const ShaderReflection &vertexReflection, const VkSpecializationInfo *pSpecialization) {
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertShaderStageInfo.module = vertex;
+	vertShaderStageInfo.pName = "main";
+	vertShaderStageInfo.pSpecializationInfo = pSpecialization;
+
+	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragShaderStageInfo.module = fragment;
+	fragShaderStageInfo.pName = "main";
+	fragShaderStageInfo.pSpecializationInfo = pSpecialization;
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+	auto bindingDescription = Vertex::getBindingDescription();
+
+	// only the attributes the vertex shader reads
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+	uint32_t providedLocations = 0;
+
+	if (desc.vertexLayout == VERTEX_LAYOUT_MESH) {
+		for (const VkVertexInputAttributeDescription &attribute : Vertex::getAttributeDescriptions()) {
+			if ((vertexReflection.inputLocations & (1u << attribute.location)) == 0) {
+				continue;
+			}
+
+			if (vertexReflection.inputFormats[attribute.location] != attribute.format) {
+				printf("%s reads vertex input %u with a different format!\n", desc.pShader->getName(), attribute.location);
+			}
+
+			attributeDescriptions.push_back(attribute);
+			providedLocations |= 1u << attribute.location;
+		}
+	}
+
+	if ((vertexReflection.inputLocations & ~providedLocations) != 0) {
+		printf("%s reads vertex inputs the vertex layout doesn't provide!\n", desc.pShader->getName());
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	if (desc.vertexLayout == VERTEX_LAYOUT_MESH) {
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+	}
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTest;
+	depthStencil.depthWriteEnable = desc.depthWrite;
+	depthStencil.depthCompareOp = static_cast<VkCompareOp>(desc.depthCompareOp);
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	if (desc.blendMode == BLEND_MODE_ALPHA) {
+		colorBlendAttachment.blendEnable = VK_TRUE;
+		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	}
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+	colorBlending.blendConstants[0] = 0.0f;
+	colorBlending.blendConstants[1] = 0.0f;
+	colorBlending.blendConstants[2] = 0.0f;
+	colorBlending.blendConstants[3] = 0.0f;
+
+	std::vector<VkDynamicState> dynamicStates = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = _context->getRenderPass(static_cast<RenderPassType>(desc.renderPass));
+	pipelineInfo.subpass = desc.subpass;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+	VkPipeline pipeline;
+	VK_CHECK(vkCreateGraphicsPipelines(_context->getDevice(), _context->getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline), "Failed to create graphics pipeline!");
+
+	return pipeline;
+}
+
+VkPipeline PipelineRegistry::_createComputePipeline(const PipelineStateDesc &desc, VkShaderModule compute, const VkSpecializationInfo *pSpecialization) {
+	VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
+	computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computeShaderStageInfo.module = compute;
+	computeShaderStageInfo.pName = "main";
+	computeShaderStageInfo.pSpecializationInfo = pSpecialization;
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = computeShaderStageInfo;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+	VkPipeline pipeline;
+	VK_CHECK(vkCreateComputePipelines(_context->getDevice(), _context->getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline), "Failed to create compute pipeline!");
+
+	return pipeline;
+}
+
+VkDescriptorSetLayout PipelineRegistry::getSetLayout(const DescriptorSetLayoutDesc &desc) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _setLayouts.find(desc);
+
+	if (it != _setLayouts.end()) {
+		return it->second;
+	}
+
+	VkDescriptorSetLayoutBinding bindings[DESCRIPTOR_SET_MAX_BINDINGS]{};
+	VkDescriptorBindingFlagsEXT bindingFlags[DESCRIPTOR_SET_MAX_BINDINGS]{};
+	bool hasBindingFlags = false;
+
+	for (uint32_t i = 0; i < desc.bindingCount; i++) {
+		bindings[i].binding = desc.bindings[i].binding;
+		bindings[i].descriptorType = static_cast<VkDescriptorType>(desc.bindings[i].type);
+		bindings[i].descriptorCount = desc.bindings[i].count;
+		bindings[i].stageFlags = desc.bindings[i].stages;
+		bindings[i].pImmutableSamplers = nullptr;
+
+		bindingFlags[i] = desc.bindings[i].flags;
+		hasBindingFlags |= desc.bindings[i].flags != 0;
+	}
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsInfo.bindingCount = desc.bindingCount;
+	bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	// only chained when used, the extension may be missing otherwise
+	layoutInfo.pNext = hasBindingFlags ? &bindingFlagsInfo : nullptr;
+	layoutInfo.flags = desc.flags;
+	layoutInfo.bindingCount = desc.bindingCount;
+	layoutInfo.pBindings = bindings;
+
+	VkDescriptorSetLayout setLayout;
+	VK_CHECK(vkCreateDescriptorSetLayout(_context->getDevice(), &layoutInfo, nullptr, &setLayout), "Failed to create descriptor set layout!");
+
+	_setLayouts[desc] = setLayout;
+
+	return setLayout;
+}
+
+VkPipelineLayout PipelineRegistry::getLayout(const ShaderLayoutDesc &desc, VkDescriptorSetLayout *pSetLayouts) {
+	PipelineLayoutDesc layout;
+	layout.setLayoutCount = desc.setCount;
+	layout.pushConstantSize = desc.pushConstantSize;
+	layout.pushConstantStages = desc.pushConstantStages;
+
+	// sets the shader skips still need a layout, an empty one
+	for (uint32_t i = 0; i < desc.setCount; i++) {
+		layout.setLayouts[i] = getSetLayout(desc.sets[i]);
+
+		if (pSetLayouts != nullptr) {
+			pSetLayouts[i] = layout.setLayouts[i];
+		}
+	}
+
+	return getLayout(layout);
+}
+
+VkPipelineLayout PipelineRegistry::getLayout(const PipelineLayoutDesc &desc) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _layouts.find(desc);
+
+	if (it != _layouts.end()) {
+		return it->second;
+	}
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = desc.pushConstantSize;
+	pushConstant.stageFlags = desc.pushConstantStages;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = desc.setLayoutCount;
+	pipelineLayoutInfo.pSetLayouts = desc.setLayouts;
+	pipelineLayoutInfo.pushConstantRangeCount = desc.pushConstantSize > 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+
+	VkPipelineLayout pipelineLayout;
+	VK_CHECK(vkCreatePipelineLayout(_context->getDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout), "Failed to create pipeline layout!");
+
+	_layouts[desc] = pipelineLayout;
+
+	return pipelineLayout;
+}
+
+VkPipeline PipelineRegistry::getPipeline(const PipelineStateDesc &desc) {
+	std::promise<VkPipeline> promise;
+	std::shared_future<VkPipeline> future;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		auto it = _pipelines.find(desc);
+
+		if (it != _pipelines.end()) {
+			future = it->second;
+		} else {
+			_pipelines[desc] = promise.get_future().share();
+		}
+	}
+
+	// may still be created by another thread
+	if (future.valid()) {
+		return future.get();
+	}
+
+	// created outside the lock, drivers compile here
+	VkPipeline pipeline;
+
+	try {
+		pipeline = _createPipeline(desc);
+	} catch (...) {
+		// shader compile errors in dev_shaders builds, a later call retries
+		promise.set_exception(std::current_exception());
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pipelines.erase(desc);
+
+		throw;
+	}
+
+	promise.set_value(pipeline);
+
+	return pipeline;
+}
+
+void PipelineRegistry::_prewarmPipeline(const PipelineStateDesc &desc) {
+	// runs on pool tasks, which an exception must not leave
+	try {
+		getPipeline(desc);
+	} catch (const std::exception &error) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_prewarmErrors.push_back(error.what());
+	}
+}
+
+void PipelineRegistry::prewarm(const PipelineStateDesc *pDescs, uint32_t count, bool background) {
+	if (!background || _threadPool == nullptr) {
+		auto createRange = [this, pDescs](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				_prewarmPipeline(pDescs[i]);
+			}
+		};
+
+		if (_threadPool == nullptr) {
+			createRange(0, count);
+		} else {
+			_threadPool->parallelFor(count, 1, createRange);
+		}
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pendingTasks += count;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		PipelineStateDesc desc = pDescs[i];
+
+		_threadPool->submit([this, desc] {
+			_prewarmPipeline(desc);
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (--_pendingTasks == 0) {
+				_tasksDone.notify_all();
+			}
+		});
+	}
+}
+
+std::vector<std::string> PipelineRegistry::takePrewarmErrors() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	std::vector<std::string> errors;
+	errors.swap(_prewarmErrors);
+
+	return errors;
+}
+
+std::vector<PipelineStateDesc> PipelineRegistry::getStates(ShaderRD *pShader) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	std::vector<PipelineStateDesc> states;
+
+	for (auto &entry : _pipelines) {
+		if (entry.first.pShader == pShader) {
+			states.push_back(entry.first);
+		}
+	}
+
+	return states;
+}
+
+std::vector<VkPipeline> PipelineRegistry::removeShader(ShaderRD *pShader) {
+	// a prewarm task could still add a pipeline of the shader
+	_waitForTasks();
+
+	std::vector<std::shared_future<VkPipeline>> futures;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		for (auto it = _pipelines.begin(); it != _pipelines.end();) {
+			if (it->first.pShader == pShader) {
+				futures.push_back(it->second);
+				it = _pipelines.erase(it);
+			} else {
+				it++;
+			}
+		}
+	}
+
+	std::vector<VkPipeline> pipelines;
+
+	for (std::shared_future<VkPipeline> &future : futures) {
+		pipelines.push_back(future.get());
+	}
+
+	return pipelines;
+}
+
+std::vector<VkPipeline> PipelineRegistry::removeGraphicsPipelines(std::vector<PipelineStateDesc> *pStates) {
+	// a prewarm task could still add one for the old render pass
+	_waitForTasks();
+
+	std::vector<std::shared_future<VkPipeline>> futures;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		for (auto it = _pipelines.begin(); it != _pipelines.end();) {
+			if (!it->first.pShader->isCompute()) {
+				pStates->push_back(it->first);
+				futures.push_back(it->second);
+				it = _pipelines.erase(it);
+			} else {
+				it++;
+			}
+		}
+	}
+
+	std::vector<VkPipeline> pipelines;
+
+	for (std::shared_future<VkPipeline> &future : futures) {
+		pipelines.push_back(future.get());
+	}
+
+	return pipelines;
+}
+
+uint32_t PipelineRegistry::getPipelineCount() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return static_cast<uint32_t>(_pipelines.size());
+}
+
+uint32_t PipelineRegistry::getLayoutCount() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return static_cast<uint32_t>(_layouts.size());
+}
+
+uint32_t PipelineRegistry::getSetLayoutCount() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return static_cast<uint32_t>(_setLayouts.size());
+}
+
+PipelineRegistry::PipelineRegistry(VulkanContext *pContext, ThreadPool *pThreadPool) {
+	_context = pContext;
+	_threadPool = pThreadPool;
+}
+
+PipelineRegistry::~PipelineRegistry() {
+	_waitForTasks();
+
+	VkDevice device = _context->getDevice();
+
+	for (auto &entry : _pipelines) {
+		vkDestroyPipeline(device, entry.second.get(), nullptr);
+	}
+
+	for (auto &entry : _layouts) {
+		vkDestroyPipelineLayout(device, entry.second, nullptr);
+	}
+
+	for (auto &entry : _setLayouts) {
+		vkDestroyDescriptorSetLayout(device, entry.second, nullptr);
+	}
+}
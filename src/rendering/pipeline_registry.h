@@ -0,0 +1,207 @@
+#ifndef PIPELINE_REGISTRY_H
+#define PIPELINE_REGISTRY_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+#include "vulkan_context.h"
+
+class ShaderRD;
+class ThreadPool;
+struct ShaderReflection;
+
+enum VertexLayout {
+	// no vertex buffer, e.g. a fullscreen triangle
+	VERTEX_LAYOUT_NONE,
+	VERTEX_LAYOUT_MESH,
+};
+
+enum BlendMode {
+	BLEND_MODE_NONE,
+	BLEND_MODE_ALPHA,
+};
+
+const uint32_t PIPELINE_SPECIALIZATION_CONSTANTS = 2;
+
+// Everything a pipeline is created from. Compared and hashed as raw bytes,
+// so fields are ordered to leave no padding. Compute shaders only use the
+// shader, variant, specialization and layout.
+struct PipelineStateDesc {
+	ShaderRD *pShader = nullptr;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	uint32_t variant = 0;
+	// values of specialization constants 0 and 1
+	uint32_t specialization[PIPELINE_SPECIALIZATION_CONSTANTS] = {};
+	uint32_t padding = 0;
+
+	uint8_t vertexLayout = VERTEX_LAYOUT_MESH;
+	uint8_t cullMode = VK_CULL_MODE_BACK_BIT;
+	uint8_t depthTest = VK_TRUE;
+	uint8_t depthWrite = VK_TRUE;
+	uint8_t depthCompareOp = VK_COMPARE_OP_LESS;
+	uint8_t blendMode = BLEND_MODE_NONE;
+	// all render pass types are compatible, the handle changes with the swapchain
+	uint8_t renderPass = RENDER_PASS_TYPE_MAIN;
+	uint8_t subpass = 0;
+
+	bool operator==(const PipelineStateDesc &other) const {
+		return memcmp(this, &other, sizeof(PipelineStateDesc)) == 0;
+	}
+};
+
+const uint32_t PIPELINE_LAYOUT_MAX_SETS = 4;
+
+struct PipelineLayoutDesc {
+	VkDescriptorSetLayout setLayouts[PIPELINE_LAYOUT_MAX_SETS] = {};
+	uint32_t setLayoutCount = 0;
+
+	// a single range starting at offset 0, size 0 for none
+	uint32_t pushConstantSize = 0;
+	VkShaderStageFlags pushConstantStages = 0;
+	uint32_t padding = 0;
+
+	bool operator==(const PipelineLayoutDesc &other) const {
+		return memcmp(this, &other, sizeof(PipelineLayoutDesc)) == 0;
+	}
+};
+
+const uint32_t DESCRIPTOR_SET_MAX_BINDINGS = 8;
+
+struct DescriptorBindingDesc {
+	uint32_t binding = 0;
+	uint32_t type = 0;
+	uint32_t count = 0;
+	VkShaderStageFlags stages = 0;
+	// VkDescriptorBindingFlagsEXT, needs descriptor indexing
+	uint32_t flags = 0;
+};
+
+struct DescriptorSetLayoutDesc {
+	DescriptorBindingDesc bindings[DESCRIPTOR_SET_MAX_BINDINGS] = {};
+	uint32_t bindingCount = 0;
+	VkDescriptorSetLayoutCreateFlags flags = 0;
+
+	bool operator==(const DescriptorSetLayoutDesc &other) const {
+		return memcmp(this, &other, sizeof(DescriptorSetLayoutDesc)) == 0;
+	}
+};
+
+// Set layouts and push constants a shader declares, built from its SPIR-V.
+// Bindings can be adjusted before the layout is created, e.g. flags the
+// SPIR-V knows nothing about or the size of a runtime sized array, which
+// reflects as a count of 0.
+struct ShaderLayoutDesc {
+	DescriptorSetLayoutDesc sets[PIPELINE_LAYOUT_MAX_SETS];
+	uint32_t setCount = 0;
+
+	uint32_t pushConstantSize = 0;
+	VkShaderStageFlags pushConstantStages = 0;
+
+	bool operator==(const ShaderLayoutDesc &other) const {
+		return memcmp(this, &other, sizeof(ShaderLayoutDesc)) == 0;
+	}
+
+	ShaderLayoutDesc(const ShaderReflection &reflection);
+};
+
+static_assert(std::has_unique_object_representations_v<PipelineStateDesc>, "PipelineStateDesc must not have padding");
+static_assert(std::has_unique_object_representations_v<PipelineLayoutDesc>, "PipelineLayoutDesc must not have padding");
+static_assert(std::has_unique_object_representations_v<DescriptorSetLayoutDesc>, "DescriptorSetLayoutDesc must not have padding");
+static_assert(std::has_unique_object_representations_v<ShaderLayoutDesc>, "ShaderLayoutDesc must not have padding");
+
+namespace std {
+template <>
+struct hash<PipelineStateDesc> {
+	size_t operator()(PipelineStateDesc const &desc) const {
+		return hashBytes(&desc, sizeof(desc));
+	}
+};
+
+template <>
+struct hash<PipelineLayoutDesc> {
+	size_t operator()(PipelineLayoutDesc const &desc) const {
+		return hashBytes(&desc, sizeof(desc));
+	}
+};
+
+template <>
+struct hash<DescriptorSetLayoutDesc> {
+	size_t operator()(DescriptorSetLayoutDesc const &desc) const {
+		return hashBytes(&desc, sizeof(desc));
+	}
+};
+} // namespace std
+
+// Creates pipelines, pipeline layouts and descriptor set layouts on first use
+// and shares them between identical descriptions. Thread safe, a pipeline that is being
+// created on another thread is waited for instead of created twice.
+class PipelineRegistry {
+private:
+	VulkanContext *_context;
+	ThreadPool *_threadPool;
+
+	std::mutex _mutex;
+	std::unordered_map<PipelineStateDesc, std::shared_future<VkPipeline>> _pipelines;
+	std::unordered_map<PipelineLayoutDesc, VkPipelineLayout> _layouts;
+	std::unordered_map<DescriptorSetLayoutDesc, VkDescriptorSetLayout> _setLayouts;
+
+	// background prewarm tasks still running
+	uint32_t _pendingTasks = 0;
+	std::condition_variable _tasksDone;
+	// of prewarmed pipelines that failed, until taken
+	std::vector<std::string> _prewarmErrors;
+
+	void _prewarmPipeline(const PipelineStateDesc &desc);
+
+	void _waitForTasks();
+
+	VkPipeline _createPipeline(const PipelineStateDesc &desc);
+	VkPipeline _createGraphicsPipeline(const PipelineStateDesc &desc, VkShaderModule vertex, VkShaderModule fragment, const ShaderReflection &vertexReflection, const VkSpecializationInfo *pSpecialization);
+	VkPipeline _createComputePipeline(const PipelineStateDesc &desc, VkShaderModule compute, const VkSpecializationInfo *pSpecialization);
+
+public:
+	VkDescriptorSetLayout getSetLayout(const DescriptorSetLayoutDesc &desc);
+	VkPipelineLayout getLayout(const PipelineLayoutDesc &desc);
+
+	// Creates the set layouts of a reflected shader too, they are returned in
+	// pSetLayouts to allocate sets with.
+	VkPipelineLayout getLayout(const ShaderLayoutDesc &desc, VkDescriptorSetLayout *pSetLayouts = nullptr);
+	VkPipeline getPipeline(const PipelineStateDesc &desc);
+
+	// Creates the pipelines on the thread pool. Returns right away when
+	// background is set, getPipeline() then waits for the ones in flight.
+	void prewarm(const PipelineStateDesc *pDescs, uint32_t count, bool background);
+
+	// Errors of the pipelines prewarm() failed to create since the last call,
+	// a later getPipeline() tries them again.
+	std::vector<std::string> takePrewarmErrors();
+
+	// States created with a shader, used to rebuild them after a reload.
+	std::vector<PipelineStateDesc> getStates(ShaderRD *pShader);
+
+	// Forgets the pipelines of a shader and returns them, the caller destroys
+	// them once no frame in flight uses them.
+	std::vector<VkPipeline> removeShader(ShaderRD *pShader);
+
+	// Forgets every graphics pipeline after the render passes were recreated,
+	// their states are returned in pStates to build them again.
+	std::vector<VkPipeline> removeGraphicsPipelines(std::vector<PipelineStateDesc> *pStates);
+
+	uint32_t getPipelineCount();
+	uint32_t getLayoutCount();
+	uint32_t getSetLayoutCount();
+
+	PipelineRegistry(VulkanContext *pContext, ThreadPool *pThreadPool);
+	~PipelineRegistry();
+};
+
+#endif // !PIPELINE_REGISTRY_H
@@ -0,0 +1,107 @@
+#include <cstdio>
+
+#include "queue_timeline.h"
+#include "vulkan_context.h"
+
+uint64_t QueueTimeline::submit(const VkCommandBuffer *pCommandBuffers, uint32_t commandBufferCount, const std::vector<SemaphoreWait> &waits, VkSemaphore binarySignal) {
+	uint32_t waitCount = static_cast<uint32_t>(waits.size());
+
+	std::vector<VkSemaphore> waitSemaphores(waitCount);
+	std::vector<uint64_t> waitValues(waitCount);
+	std::vector<VkPipelineStageFlags> waitStages(waitCount);
+
+	for (uint32_t i = 0; i < waitCount; i++) {
+		waitSemaphores[i] = waits[i].semaphore;
+		waitValues[i] = waits[i].value;
+		waitStages[i] = waits[i].stage;
+	}
+
+	std::lock_guard<std::mutex> lock(_submitMutex);
+
+	uint64_t value = _submittedValue + 1;
+
+	// the value of a binary semaphore is ignored
+	VkSemaphore signalSemaphores[] = { _semaphore, binarySignal };
+	uint64_t signalValues[] = { value, 0 };
+	uint32_t signalCount = binarySignal != VK_NULL_HANDLE ? 2 : 1;
+
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timelineInfo.waitSemaphoreValueCount = waitCount;
+	timelineInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineInfo.signalSemaphoreValueCount = signalCount;
+	timelineInfo.pSignalSemaphoreValues = signalValues;
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = waitCount;
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
+	submitInfo.commandBufferCount = commandBufferCount;
+	submitInfo.pCommandBuffers = pCommandBuffers;
+	submitInfo.signalSemaphoreCount = signalCount;
+	submitInfo.pSignalSemaphores = signalSemaphores;
+
+	VK_CHECK(vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE), "Failed to submit to queue!");
+
+	_submittedValue = value;
+	return value;
+}
+
+VkResult QueueTimeline::present(const VkPresentInfoKHR *pPresentInfo) {
+	std::lock_guard<std::mutex> lock(_submitMutex);
+	return vkQueuePresentKHR(_queue, pPresentInfo);
+}
+
+bool QueueTimeline::wait(uint64_t value, uint64_t timeout) {
+	VkSemaphoreWaitInfoKHR waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &_semaphore;
+	waitInfo.pValues = &value;
+
+	VkResult result = _waitSemaphores(_device, &waitInfo, timeout);
+
+	if (result != VK_SUCCESS && result != VK_TIMEOUT) {
+		printf("Failed to wait for timeline value %llu!\n", (unsigned long long)value);
+	}
+
+	return result == VK_SUCCESS;
+}
+
+uint64_t QueueTimeline::getCompletedValue() {
+	uint64_t value = 0;
+	VK_CHECK(_getSemaphoreCounterValue(_device, _semaphore, &value), "Failed to get timeline value!");
+
+	return value;
+}
+
+uint64_t QueueTimeline::getSubmittedValue() {
+	std::lock_guard<std::mutex> lock(_submitMutex);
+	return _submittedValue;
+}
+
+QueueTimeline::QueueTimeline(VkDevice device, VkQueue queue) {
+	_device = device;
+	_queue = queue;
+
+	// not exported by the loader without Vulkan 1.2
+	_waitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+	_getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+
+	VkSemaphoreTypeCreateInfoKHR typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &_semaphore), "Failed to create timeline semaphore!");
+}
+
+QueueTimeline::~QueueTimeline() {
+	vkDestroySemaphore(_device, _semaphore, nullptr);
+}
@@ -0,0 +1,61 @@
+#ifndef QUEUE_TIMELINE_H
+#define QUEUE_TIMELINE_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// A semaphore a submission waits on, the value is ignored for binary ones.
+struct SemaphoreWait {
+	VkSemaphore semaphore;
+	uint64_t value;
+	VkPipelineStageFlags stage;
+};
+
+// Counts the submissions of one queue with a timeline semaphore
+// (VK_KHR_timeline_semaphore). Every submit signals the next value, work and
+// the resources it uses are retired once the counter has reached the value
+// its submit returned.
+class QueueTimeline {
+private:
+	VkDevice _device;
+	VkQueue _queue;
+	VkSemaphore _semaphore;
+
+	// the queue needs external synchronization, submits may come from any thread
+	std::mutex _submitMutex;
+	// last value handed out by submit()
+	uint64_t _submittedValue = 0;
+
+	PFN_vkWaitSemaphoresKHR _waitSemaphores;
+	PFN_vkGetSemaphoreCounterValueKHR _getSemaphoreCounterValue;
+
+public:
+	// Returns the value signaled once the command buffers have finished.
+	// Binary semaphores, e.g. of the swapchain, can be waited on and
+	// signaled alongside, as can other queues' timelines.
+	uint64_t submit(const VkCommandBuffer *pCommandBuffers, uint32_t commandBufferCount, const std::vector<SemaphoreWait> &waits = {}, VkSemaphore binarySignal = VK_NULL_HANDLE);
+
+	// Presents on the timeline's queue under the submit lock, for when the
+	// present queue is the same VkQueue.
+	VkResult present(const VkPresentInfoKHR *pPresentInfo);
+
+	// Blocks until the counter reaches value, false on timeout. Value 0 is
+	// always reached.
+	bool wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+	uint64_t getCompletedValue();
+	bool isComplete(uint64_t value) { return getCompletedValue() >= value; }
+
+	uint64_t getSubmittedValue();
+
+	// for other queues to wait on
+	VkSemaphore getSemaphore() { return _semaphore; }
+
+	QueueTimeline(VkDevice device, VkQueue queue);
+	~QueueTimeline();
+};
+
+#endif // !QUEUE_TIMELINE_H
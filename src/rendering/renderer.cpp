@@ -1,26 +1,46 @@
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <utility>
 
 #include <imgui.h>
 #include <imgui_impl_vulkan.h>
 
+#include "../cpu_profiler.h"
+#include "../thread_pool.h"
+#include "descriptor_allocator.h"
+#include "object_transforms.h"
 #include "renderer.h"
+#include "scene.h"
 
+#include "shaders/bloom.glsl.gen.h"
+#include "shaders/cull.glsl.gen.h"
+#include "shaders/depth_pyramid.glsl.gen.h"
 #include "shaders/material.glsl.gen.h"
+#include "shaders/occlusion_cull.glsl.gen.h"
+#include "shaders/post_tonemap.glsl.gen.h"
+#include "shaders/shader_cache.h"
+#include "shaders/shader_reloader.h"
+#include "shaders/sharpen.glsl.gen.h"
+#include "shaders/spirv_reflection.h"
 #include "shaders/tonemapping.glsl.gen.h"
+#include "shaders/upscale.glsl.gen.h"
 
-VkShaderModule createShaderModule(VkDevice device, const std::vector<uint32_t> &spirv) {
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = spirv.size() * sizeof(uint32_t);
-	createInfo.pCode = spirv.data();
+// objects per task when the object data is computed in parallel
+const uint32_t OBJECT_TRANSFORM_BATCH_SIZE = 4096;
 
-	VkShaderModule shaderModule;
-	VK_CHECK(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule), "Failed to create shader module!");
+static uint32_t previousPowerOfTwo(uint32_t value) {
+	uint32_t result = 1;
 
-	return shaderModule;
+	while (result * 2 <= value) {
+		result *= 2;
+	}
+
+	return result;
 }
 
 void Renderer::_initAllocator() {
@@ -40,131 +60,136 @@ void Renderer::_initCommands() {
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 	allocInfo.commandBufferCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		VK_CHECK(vkAllocateCommandBuffers(_context->getDevice(), &allocInfo, &_commandBuffers[i]), "Failed to allocate command buffers!");
-	}
-}
-
-void Renderer::_initDescriptors() {
-	std::array<VkDescriptorPoolSize, 4> poolSizes{};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	// all of them in one call, the array is filled
+	VK_CHECK(vkAllocateCommandBuffers(_context->getDevice(), &allocInfo, _commandBuffers), "Failed to allocate command buffers!");
 
-	// subpass
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-	poolSizes[1].descriptorCount = 1;
+	if (!_context->hasPostProcessing()) {
+		return;
+	}
 
-	// texture
-	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[2].descriptorCount = 1;
+	VK_CHECK(vkAllocateCommandBuffers(_context->getDevice(), &allocInfo, _compositeCommandBuffers), "Failed to allocate command buffers!");
 
-	// ImGui
-	poolSizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[3].descriptorCount = 1;
+	// recorded for the compute queue, one per frame struct
+	allocInfo.commandPool = _context->getComputeCommandPool();
+	allocInfo.commandBufferCount = 1;
 
-	VkDescriptorPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) + 3;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VK_CHECK(vkAllocateCommandBuffers(_context->getDevice(), &allocInfo, &_postProcess.frames[i].commandBuffer), "Failed to allocate command buffers!");
+	}
+}
 
-	VK_CHECK(vkCreateDescriptorPool(_context->getDevice(), &poolInfo, nullptr, &_descriptorPool), "Failed to create descriptor pool!");
+void Renderer::_initQueries() {
+	_gpuProfiler = new GpuProfiler(_context->getDevice(), _context->getPhysicalDevice(), _context->getGraphicsQueueFamily(), _context->getEnabledFeatures().pipelineStatisticsQuery);
 
-	// uniform set layout
+	if (_context->hasPostProcessing()) {
+		_postProfiler = new GpuProfiler(_context->getDevice(), _context->getPhysicalDevice(), _context->getComputeQueueFamily(), false);
+	}
+}
 
-	VkDescriptorSetLayoutBinding uboBinding{};
-	uboBinding.binding = 0;
-	uboBinding.descriptorCount = 1;
-	uboBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uboBinding.pImmutableSamplers = nullptr;
-	uboBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+void Renderer::_initDescriptors() {
+	VkDevice device = _context->getDevice();
 
-	VkDescriptorSetLayoutCreateInfo uboLayoutInfo{};
-	uboLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	uboLayoutInfo.bindingCount = 1;
-	uboLayoutInfo.pBindings = &uboBinding;
+	// descriptors per set, roughly what the sets below use, pools grow past it
+	_descriptorAllocator = new DescriptorAllocator(device, 32, {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0.5f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+	});
 
-	VK_CHECK(vkCreateDescriptorSetLayout(_context->getDevice(), &uboLayoutInfo, nullptr, &_uniformSetLayout), "Failed to create uniform buffer object set layout!");
+	// sets written every frame, freed in bulk once the frame has finished
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		_frameDescriptors[i] = new DescriptorCache(device, 8, {
+				{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1.0f },
+				{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },
+				{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+				{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+		});
+	}
 
-	{
-		std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, _uniformSetLayout);
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = _descriptorPool;
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-		allocInfo.pSetLayouts = layouts.data();
+	// set layouts come from the shaders, see _initShaders()
 
-		std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> uniformSets{};
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+
+		_uniformBuffers[i] = _createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, _uniformAllocInfos[i]);
+		_uniformSets[i] = _descriptorAllocator->allocate(_uniformSetLayout);
+
+		VkDescriptorBufferInfo uniformBufferInfo{};
+		uniformBufferInfo.buffer = _uniformBuffers[i].buffer;
+		uniformBufferInfo.offset = 0;
+		uniformBufferInfo.range = sizeof(UniformBufferObject);
+
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = _uniformSets[i];
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pBufferInfo = &uniformBufferInfo;
+
+		vkUpdateDescriptorSets(_context->getDevice(), 1, &descriptorWrite, 0, nullptr);
+	}
 
-		VK_CHECK(vkAllocateDescriptorSets(_context->getDevice(), &allocInfo, uniformSets.data()), "Failed to allocate uniform set!");
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		_cullSets[i] = _descriptorAllocator->allocate(_cullSetLayout);
+		_reserveDrawBuffers(i, INSTANCE_BUFFER_CAPACITY, INSTANCE_BUFFER_CAPACITY);
+	}
 
+	{
 		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-			VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+			for (uint32_t j = 0; j < DEPTH_PYRAMID_MAX_LEVELS; j++) {
+				_depthPyramid.levelSets[i][j] = _descriptorAllocator->allocate(_depthPyramidSetLayout);
+			}
+		}
 
-			_uniformBuffers[i] = _createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, _uniformAllocInfos[i]);
-			_uniformSets[i] = uniformSets[i];
+		// texel fetches only, no filtering
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		VK_CHECK(vkCreateSampler(_context->getDevice(), &samplerInfo, nullptr, &_depthPyramid.sampler), "Failed to create depth pyramid sampler!");
+	}
 
-			VkDescriptorBufferInfo uniformBufferInfo{};
-			uniformBufferInfo.buffer = _uniformBuffers[i].buffer;
-			uniformBufferInfo.offset = 0;
-			uniformBufferInfo.range = sizeof(UniformBufferObject);
+	if (_context->hasPostProcessing()) {
+		// written by _createPostProcess()
+		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			PostProcessFrame *pFrame = &_postProcess.frames[i];
 
-			VkWriteDescriptorSet descriptorWrite{};
-			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrite.dstSet = _uniformSets[i];
-			descriptorWrite.dstBinding = 0;
-			descriptorWrite.dstArrayElement = 0;
-			descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrite.descriptorCount = 1;
-			descriptorWrite.pBufferInfo = &uniformBufferInfo;
+			for (uint32_t j = 0; j < BLOOM_MAX_LEVELS; j++) {
+				pFrame->downsampleSets[j] = _descriptorAllocator->allocate(_bloomSetLayout);
+				pFrame->upsampleSets[j] = _descriptorAllocator->allocate(_bloomSetLayout);
+			}
 
-			vkUpdateDescriptorSets(_context->getDevice(), 1, &descriptorWrite, 0, nullptr);
+			pFrame->tonemapSet = _descriptorAllocator->allocate(_postTonemapSetLayout);
+			pFrame->tonemapOutputSet = _descriptorAllocator->allocate(_postTonemapSetLayout);
+			pFrame->sharpenSet = _descriptorAllocator->allocate(_sharpenSetLayout);
 		}
 	}
 
-	// subpass set layout
-
-	VkDescriptorSetLayoutBinding subpassBinding{};
-	subpassBinding.binding = 0;
-	subpassBinding.descriptorCount = 1;
-	subpassBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-	subpassBinding.pImmutableSamplers = nullptr;
-	subpassBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-	VkDescriptorSetLayoutCreateInfo subpassLayoutInfo{};
-	subpassLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	subpassLayoutInfo.bindingCount = 1;
-	subpassLayoutInfo.pBindings = &subpassBinding;
-
-	VK_CHECK(vkCreateDescriptorSetLayout(_context->getDevice(), &subpassLayoutInfo, nullptr, &_subpassSetLayout), "Failed to create subpass set layout!");
-
 	{
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = _descriptorPool;
-		allocInfo.descriptorSetCount = 1;
-		allocInfo.pSetLayouts = &_subpassSetLayout;
-
-		VK_CHECK(vkAllocateDescriptorSets(_context->getDevice(), &allocInfo, &_subpassSet), "Failed to allocate subpass set!");
-
-		_writeImageSet(_subpassSet, _context->getColorImageView(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+		// the upscale and post-processing shaders clamp to the rendered part themselves
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = 0.0f;
+
+		VK_CHECK(vkCreateSampler(_context->getDevice(), &samplerInfo, nullptr, &_upscaleSampler), "Failed to create upscale sampler!");
 	}
-
-	// texture set layout
-
-	VkDescriptorSetLayoutBinding textureBinding{};
-	textureBinding.binding = 0;
-	textureBinding.descriptorCount = 1;
-	textureBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	textureBinding.pImmutableSamplers = nullptr;
-	textureBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-	VkDescriptorSetLayoutCreateInfo textureLayoutInfo{};
-	textureLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	textureLayoutInfo.bindingCount = 1;
-	textureLayoutInfo.pBindings = &textureBinding;
-
-	VK_CHECK(vkCreateDescriptorSetLayout(_context->getDevice(), &textureLayoutInfo, nullptr, &_textureSetLayout), "Failed to create texture set layout!");
 }
 
 // ImGui error check
@@ -179,6 +204,19 @@ static void vkCheckResult(VkResult err) {
 }
 
 void Renderer::initImGui() {
+	// the font texture set, ImGui wants a pool it can allocate from itself
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = 1;
+
+	VK_CHECK(vkCreateDescriptorPool(_context->getDevice(), &poolInfo, nullptr, &_imguiPool), "Failed to create ImGui descriptor pool!");
+
 	// Setup Platform/Renderer backends
 	ImGui_ImplVulkan_InitInfo init_info = {};
 	init_info.Instance = _context->getInstance();
@@ -186,8 +224,8 @@ void Renderer::initImGui() {
 	init_info.Device = _context->getDevice();
 	init_info.QueueFamily = _context->getGraphicsQueueFamily();
 	init_info.Queue = _context->getGraphicsQueue();
-	init_info.PipelineCache = nullptr;
-	init_info.DescriptorPool = _descriptorPool;
+	init_info.PipelineCache = _context->getPipelineCache();
+	init_info.DescriptorPool = _imguiPool;
 	init_info.Subpass = 0;
 	init_info.MinImageCount = MAX_FRAMES_IN_FLIGHT;
 	init_info.ImageCount = MAX_FRAMES_IN_FLIGHT;
@@ -203,52 +241,384 @@ void Renderer::initImGui() {
 	ImGui_ImplVulkan_DestroyFontUploadObjects();
 }
 
-void Renderer::_initPipelines() {
+void Renderer::_initTextureTable() {
+	bool bindless = _context->hasDescriptorIndexing();
+
+	// a single set, update after bind sets need pools of their own
+	VkDescriptorPoolCreateFlags poolFlags = bindless ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT : 0;
+	_textureAllocator = new DescriptorAllocator(_context->getDevice(), 1, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<float>(_textureTableSize) } }, poolFlags);
+
+	_material.textureSet = _textureAllocator->allocate(_textureSetLayout);
+
+	// slot 0, what meshes without a texture of their own sample
+	std::vector<uint8_t> white = { 255, 255, 255, 255 };
+	_defaultTexture = _createTexture(1, 1, VK_FORMAT_R8G8B8A8_SRGB, white);
+	_defaultTexture.index = 0;
+	_textureCount = 1;
+
+	// without partially bound descriptors every slot must be valid
+	uint32_t writeCount = bindless ? 1 : _textureTableSize;
+
+	for (uint32_t i = 0; i < writeCount; i++) {
+		_writeImageSet(_material.textureSet, 0, _defaultTexture.view, _defaultTexture.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, i);
+	}
+
+	printf("Texture table with %u slots (%s)\n", _textureTableSize, bindless ? "descriptor indexing" : "fixed size");
+}
+
+static_assert(MATERIAL_FEATURE_TEXTURE == MaterialShaderRD::FEATURE_TEXTURE, "material.glsl features changed");
+static_assert(MATERIAL_FEATURE_VERTEX_COLOR == MaterialShaderRD::FEATURE_VERTEX_COLOR, "material.glsl features changed");
+
+// The C++ side of a push constant block must fit the range of the layout.
+static void checkPushConstants(const char *name, const ShaderReflection &reflection, size_t size) {
+	if (size > reflection.pushConstantSize) {
+		printf("%s push constants are %zu bytes, the shader declares %u!\n", name, size, reflection.pushConstantSize);
+	}
+}
+
+bool Renderer::_initShaders() {
+	_pipelineRegistry = new PipelineRegistry(_context, _threadPool);
+
+	// owned by their pipeline states, hot reloading replaces them
+	ShaderRD *shaders[] = {
+		new MaterialShaderRD(),
+		new TonemappingShaderRD(),
+		new CullShaderRD(),
+		new OcclusionCullShaderRD(),
+		new DepthPyramidShaderRD(),
+		new UpscaleShaderRD(),
+		new BloomShaderRD(),
+		new PostTonemapShaderRD(),
+		new SharpenShaderRD(),
+	};
+
+	uint32_t shaderCount = sizeof(shaders) / sizeof(shaders[0]);
+	std::vector<std::string> errors;
+
+	// only dev_shaders builds compile anything here
+	if (!ShaderRD::compileAll(shaders, shaderCount, _threadPool, &errors)) {
+		// the logs were printed as the stages failed
+		printf("Failed to compile %zu shader stages!\n", errors.size());
+
+		for (uint32_t i = 0; i < shaderCount; i++) {
+			delete shaders[i];
+		}
+
+		return false;
+	}
+
+	// Pipeline layouts are reflected from the base variants, which declare the
+	// resources of every variant. Identical set layouts are shared.
+
+	bool bindless = _context->hasDescriptorIndexing();
+	_textureTableSize = bindless ? std::min(BINDLESS_TEXTURE_CAPACITY, _context->getMaxBindlessTextures()) : FALLBACK_TEXTURE_CAPACITY;
+
+	{
+		_material.state.pShader = shaders[0];
+		// size of the texture table, depends on the device
+		_material.state.specialization[1] = _textureTableSize;
+
+		ShaderReflection reflection;
+		SpirvReflection::reflectShader(shaders[0], 0, _material.state.specialization, PIPELINE_SPECIALIZATION_CONSTANTS, &reflection);
+		checkPushConstants("Material", reflection, sizeof(MaterialPushConstants));
+
+		ShaderLayoutDesc layout(reflection);
+
+		// slots are filled as textures are created, while frames using the table are in flight
+		if (bindless) {
+			layout.sets[1].bindings[0].flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+			layout.sets[1].flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+		}
+
+		VkDescriptorSetLayout setLayouts[PIPELINE_LAYOUT_MAX_SETS];
+		_material.state.layout = _pipelineRegistry->getLayout(layout, setLayouts);
+
+		_uniformSetLayout = setLayouts[0];
+		_textureSetLayout = setLayouts[1];
+	}
+
 	{
-		MaterialShaderRD shader;
+		ShaderReflection reflection;
+		SpirvReflection::reflectShader(shaders[1], 0, nullptr, 0, &reflection);
+
+		// fullscreen triangle in the tonemapping subpass, which has no depth
+		_tonemapping.textureSet = VK_NULL_HANDLE;
+		_tonemapping.state.pShader = shaders[1];
+		_tonemapping.state.layout = _pipelineRegistry->getLayout(ShaderLayoutDesc(reflection), &_subpassSetLayout);
+		_tonemapping.state.vertexLayout = VERTEX_LAYOUT_NONE;
+		_tonemapping.state.cullMode = VK_CULL_MODE_NONE;
+		_tonemapping.state.depthTest = VK_FALSE;
+		_tonemapping.state.depthWrite = VK_FALSE;
+		_tonemapping.state.subpass = 1;
+	}
 
-		VkShaderModule vertexModule = createShaderModule(_context->getDevice(), shader.getVertexCode());
-		VkShaderModule fragmentModule = createShaderModule(_context->getDevice(), shader.getFragmentCode());
+	{
+		// both cull shaders share a set, reflected together the layout has
+		// the bindings of both and a range that covers the larger block
+		ShaderReflection reflection;
+		SpirvReflection::reflectShader(shaders[2], 0, nullptr, 0, &reflection);
+		SpirvReflection::reflectShader(shaders[3], 0, nullptr, 0, &reflection);
+		checkPushConstants("Cull", reflection, sizeof(CullPushConstants));
+		checkPushConstants("Occlusion cull", reflection, sizeof(OcclusionCullPushConstants));
+
+		_cullState.pShader = shaders[2];
+		_cullState.layout = _pipelineRegistry->getLayout(ShaderLayoutDesc(reflection), &_cullSetLayout);
+
+		_occlusionCullState.pShader = shaders[3];
+		_occlusionCullState.layout = _cullState.layout;
+	}
 
-		VkDescriptorSetLayout setLayouts[] = { _uniformSetLayout, _textureSetLayout };
+	{
+		ShaderReflection reflection;
+		SpirvReflection::reflectShader(shaders[4], 0, nullptr, 0, &reflection);
+		checkPushConstants("Depth pyramid", reflection, sizeof(DepthPyramidPushConstants));
 
-		VkPushConstantRange pushConstant{};
-		pushConstant.offset = 0;
-		pushConstant.size = sizeof(MeshPushConstants);
-		pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		_depthPyramidState.pShader = shaders[4];
+		_depthPyramidState.layout = _pipelineRegistry->getLayout(ShaderLayoutDesc(reflection), &_depthPyramidSetLayout);
+	}
 
-		VkPipelineLayout pipelineLayout = _createPipelineLayout(setLayouts, 2, &pushConstant, 1);
-		VkPipeline pipeline = _createPipeline(pipelineLayout, vertexModule, fragmentModule, 0);
+	{
+		ShaderReflection reflection;
+		SpirvReflection::reflectShader(shaders[5], 0, nullptr, 0, &reflection);
+		checkPushConstants("Upscale", reflection, sizeof(UpscalePushConstants));
+
+		// fullscreen triangle in the draw subpass of the upscale pass, the
+		// filter is filled in per frame
+		_upscaleState.pShader = shaders[5];
+		_upscaleState.layout = _pipelineRegistry->getLayout(ShaderLayoutDesc(reflection), &_upscaleSetLayout);
+		_upscaleState.vertexLayout = VERTEX_LAYOUT_NONE;
+		_upscaleState.cullMode = VK_CULL_MODE_NONE;
+		_upscaleState.depthTest = VK_FALSE;
+		_upscaleState.depthWrite = VK_FALSE;
+	}
 
-		vkDestroyShaderModule(_context->getDevice(), fragmentModule, nullptr);
-		vkDestroyShaderModule(_context->getDevice(), vertexModule, nullptr);
+	{
+		// the post-processing chain, the bloom mode is filled in per pass
+		ShaderReflection reflection;
+		SpirvReflection::reflectShader(shaders[6], 0, nullptr, 0, &reflection);
+		checkPushConstants("Bloom", reflection, sizeof(BloomPushConstants));
 
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = _descriptorPool;
-		allocInfo.descriptorSetCount = 1;
-		allocInfo.pSetLayouts = &_textureSetLayout;
+		_bloomState.pShader = shaders[6];
+		_bloomState.layout = _pipelineRegistry->getLayout(ShaderLayoutDesc(reflection), &_bloomSetLayout);
+	}
 
-		VkDescriptorSet textureSet;
-		VK_CHECK(vkAllocateDescriptorSets(_context->getDevice(), &allocInfo, &textureSet), "Failed to allocate texture set!");
+	{
+		ShaderReflection reflection;
+		SpirvReflection::reflectShader(shaders[7], 0, nullptr, 0, &reflection);
+		checkPushConstants("Post tonemap", reflection, sizeof(PostTonemapPushConstants));
 
-		_material = { textureSet, pipelineLayout, pipeline };
+		_postTonemapState.pShader = shaders[7];
+		_postTonemapState.layout = _pipelineRegistry->getLayout(ShaderLayoutDesc(reflection), &_postTonemapSetLayout);
 	}
 
 	{
-		TonemappingShaderRD shader;
+		ShaderReflection reflection;
+		SpirvReflection::reflectShader(shaders[8], 0, nullptr, 0, &reflection);
+		checkPushConstants("Sharpen", reflection, sizeof(SharpenPushConstants));
+
+		_sharpenState.pShader = shaders[8];
+		_sharpenState.layout = _pipelineRegistry->getLayout(ShaderLayoutDesc(reflection), &_sharpenSetLayout);
+	}
+
+	printf("Reflected %u pipeline layouts with %u set layouts\n", _pipelineRegistry->getLayoutCount(), _pipelineRegistry->getSetLayoutCount());
+
+	return true;
+}
+
+void Renderer::_initPipelines() {
+	// what the first frame needs, created in parallel before it starts
+	PipelineStateDesc material = _material.state;
+	material.variant = MATERIAL_FEATURE_TEXTURE;
+
+	std::vector<PipelineStateDesc> startupStates = { material, _tonemapping.state, _cullState, _occlusionCullState, _depthPyramidState };
+
+	// either filter can be picked in the overlay
+	if (_context->hasDynamicResolution() || _context->hasPostProcessing()) {
+		for (uint32_t filter : { UPSCALE_FILTER_BILINEAR, UPSCALE_FILTER_EDGE_AWARE }) {
+			startupStates.push_back(_upscaleState);
+			startupStates.back().specialization[0] = filter;
+		}
+	}
+
+	if (_context->hasPostProcessing()) {
+		for (uint32_t mode : { BLOOM_MODE_PREFILTER, BLOOM_MODE_DOWNSAMPLE, BLOOM_MODE_UPSAMPLE }) {
+			startupStates.push_back(_bloomState);
+			startupStates.back().specialization[0] = mode;
+		}
+
+		startupStates.push_back(_postTonemapState);
+		startupStates.push_back(_sharpenState);
+
+		startupStates.push_back(_tonemapping.state);
+		startupStates.back().specialization[0] = TONEMAP_OPERATOR_NONE;
+	}
+
+	uint32_t startupCount = static_cast<uint32_t>(startupStates.size());
+
+	auto start = std::chrono::steady_clock::now();
+
+	_pipelineRegistry->prewarm(startupStates.data(), startupCount, false);
+	_reportPrewarmErrors();
+
+	_pipelineCreationTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	_pipelineCount = startupCount;
+
+	// the other material variants are created in the background, a draw that
+	// needs one first waits for it
+	std::vector<PipelineStateDesc> variantStates;
+
+	for (uint32_t variant = 0; variant < _material.state.pShader->getVariantCount(); variant++) {
+		if (variant != material.variant) {
+			variantStates.push_back(_material.state);
+			variantStates.back().variant = variant;
+		}
+	}
+
+	_pipelineRegistry->prewarm(variantStates.data(), static_cast<uint32_t>(variantStates.size()), true);
+
+#ifdef SHADER_RUNTIME_COMPILE
+	PipelineStateDesc *states[] = { &_material.state, &_tonemapping.state, &_cullState, &_occlusionCullState, &_depthPyramidState, &_upscaleState, &_bloomState, &_postTonemapState, &_sharpenState };
+	_watchShaders(states, sizeof(states) / sizeof(states[0]));
+#endif
+}
+
+#ifdef SHADER_RUNTIME_COMPILE
+// Layouts are reflected once at startup, a reload must keep the interface.
+static bool hasSameLayout(ShaderRD *pOld, ShaderRD *pNew, const uint32_t *pSpecialization) {
+	ShaderReflection oldReflection;
+	ShaderReflection newReflection;
+
+	SpirvReflection::reflectShader(pOld, 0, pSpecialization, PIPELINE_SPECIALIZATION_CONSTANTS, &oldReflection);
+	SpirvReflection::reflectShader(pNew, 0, pSpecialization, PIPELINE_SPECIALIZATION_CONSTANTS, &newReflection);
+
+	return ShaderLayoutDesc(oldReflection) == ShaderLayoutDesc(newReflection);
+}
+
+void Renderer::_watchShaders(PipelineStateDesc **ppStates, uint32_t stateCount) {
+	_shaderReloader = new ShaderReloader();
+
+	for (uint32_t i = 0; i < stateCount; i++) {
+		PipelineStateDesc *pState = ppStates[i];
+
+		// runs on the reload thread, the main thread swaps the shader in
+		_shaderReloader->watch(pState->pShader, [this, pState](ShaderRD *pShader, std::string *pError) {
+			ShaderRD *pCurrent;
+
+			{
+				std::lock_guard<std::mutex> lock(_reloadMutex);
+				pCurrent = pState->pShader;
+			}
+
+			if (!pShader->compileVariant(0, pError)) {
+				return false;
+			}
+
+			if (!hasSameLayout(pCurrent, pShader, pState->specialization)) {
+				*pError = "Descriptor bindings or push constants changed, restart to apply them";
+				return false;
+			}
+
+			// rebuild every state in use, e.g. material variants and debug views
+			std::vector<PipelineStateDesc> states = _pipelineRegistry->getStates(pCurrent);
+
+			if (states.empty()) {
+				states.push_back(*pState);
+				states.back().pShader = pCurrent;
+			}
 
-		VkShaderModule vertexModule = createShaderModule(_context->getDevice(), shader.getVertexCode());
-		VkShaderModule fragmentModulee = createShaderModule(_context->getDevice(), shader.getFragmentCode());
+			for (PipelineStateDesc &state : states) {
+				if (!pShader->compileVariant(state.variant, pError)) {
+					return false;
+				}
 
-		VkPipelineLayout pipelineLayout = _createPipelineLayout(&_subpassSetLayout, 1, nullptr, 0);
-		VkPipeline pipeline = _createPipeline(pipelineLayout, vertexModule, fragmentModulee, 1);
+				state.pShader = pShader;
+			}
 
-		vkDestroyShaderModule(_context->getDevice(), fragmentModulee, nullptr);
-		vkDestroyShaderModule(_context->getDevice(), vertexModule, nullptr);
+			_pipelineRegistry->prewarm(states.data(), static_cast<uint32_t>(states.size()), false);
 
-		_tonemapping = { VK_NULL_HANDLE, pipelineLayout, pipeline };
+			std::lock_guard<std::mutex> lock(_reloadMutex);
+			_pendingReloads.push_back({ pState, pShader });
+
+			return true;
+		});
+	}
+
+	_shaderReloader->start("src/rendering/shaders");
+}
+#endif
+
+void Renderer::_reportPrewarmErrors() {
+	for (const std::string &error : _pipelineRegistry->takePrewarmErrors()) {
+		printf("Failed to prewarm a pipeline: %s\n", error.c_str());
+	}
+}
+
+void Renderer::_rebuildGraphicsPipelines() {
+	VkDevice device = _context->getDevice();
+
+	// frames in flight may still use the old pipelines
+	vkDeviceWaitIdle(device);
+
+	std::vector<PipelineStateDesc> states;
+
+	for (VkPipeline pipeline : _pipelineRegistry->removeGraphicsPipelines(&states)) {
+		vkDestroyPipeline(device, pipeline, nullptr);
+	}
+
+	_pipelineRegistry->prewarm(states.data(), static_cast<uint32_t>(states.size()), false);
+	_reportPrewarmErrors();
+
+	// ImGui builds its pipeline for the render pass at init
+	if (_imguiPool != VK_NULL_HANDLE) {
+		ImGui_ImplVulkan_Shutdown();
+		vkDestroyDescriptorPool(device, _imguiPool, nullptr);
+		initImGui();
+	}
+
+	printf("Rebuilt %zu graphics pipelines for the new render passes\n", states.size());
+}
+
+void Renderer::_deferDeletion(std::function<void()> function) {
+	_pendingDeletions.push_back(std::move(function));
+}
+
+void Renderer::_retireDeletions() {
+	uint64_t completedValue = _context->getGraphicsTimeline()->getCompletedValue();
+	uint64_t completedComputeValue = _context->getComputeTimeline()->getCompletedValue();
+
+	// queued in submission order, so the values only grow
+	while (!_deletionQueue.empty() && _deletionQueue.front().timelineValue <= completedValue && _deletionQueue.front().computeValue <= completedComputeValue) {
+		_deletionQueue.front().function();
+		_deletionQueue.pop_front();
+	}
+}
+
+void Renderer::_applyShaderReloads() {
+	std::lock_guard<std::mutex> lock(_reloadMutex);
+
+	VkDevice device = _context->getDevice();
+
+	for (ShaderReload &reload : _pendingReloads) {
+		ShaderRD *pOld = reload.pState->pShader;
+		reload.pState->pShader = reload.pShader;
+
+		// the previous frame may still be using the old pipelines
+		for (VkPipeline pipeline : _pipelineRegistry->removeShader(pOld)) {
+			_deferDeletion([device, pipeline] { vkDestroyPipeline(device, pipeline, nullptr); });
+		}
+
+		delete pOld;
 	}
+
+	_pendingReloads.clear();
+}
+
+VkPipeline Renderer::_getMaterialPipeline(uint32_t features) {
+	PipelineStateDesc state = _material.state;
+	state.variant = features;
+	state.specialization[0] = _debugView;
+
+	return _pipelineRegistry->getPipeline(state);
 }
 
 void Renderer::_uploadMesh(Mesh *pMesh) {
@@ -296,105 +666,960 @@ void Renderer::_updateUniformBuffer(uint32_t p_currentFrame) {
 	ubo.proj = _camera->getProjectionMatrix(aspect);
 
 	memcpy(_uniformAllocInfos[_currentFrame].pMappedData, &ubo, sizeof(ubo));
+
+	_view = ubo.view;
+	_projection = ubo.proj;
+	_frustum = Frustum::fromMatrix(ubo.proj * ubo.view);
 }
 
-void Renderer::_writeImageSet(VkDescriptorSet dstSet, VkImageView imageView, VkSampler sampler, VkDescriptorType descriptorType) {
-	VkDescriptorImageInfo imageInfo = {};
-	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	imageInfo.imageView = imageView;
-	imageInfo.sampler = sampler;
+bool Renderer::_reserveBuffer(GrowableBuffer *pBuffer, VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible) {
+	if (size <= pBuffer->size) {
+		return false;
+	}
 
-	VkWriteDescriptorSet writeDescriptorSet = {};
-	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSet.dstSet = dstSet;
-	writeDescriptorSet.dstBinding = 0;
-	writeDescriptorSet.dstArrayElement = 0;
-	writeDescriptorSet.descriptorType = descriptorType;
-	writeDescriptorSet.descriptorCount = 1;
-	writeDescriptorSet.pImageInfo = &imageInfo;
+	// buffers are per frame, the frame's timeline value was already waited on
+	if (pBuffer->size > 0) {
+		vmaDestroyBuffer(_allocator, pBuffer->buffer.buffer, pBuffer->buffer.allocation);
+	}
 
-	vkUpdateDescriptorSets(_context->getDevice(), 1, &writeDescriptorSet, 0, nullptr);
-}
+	VkDeviceSize capacity = std::max(size, pBuffer->size * 2);
 
-AllocatedBuffer Renderer::_createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationInfo &allocInfo) {
-	VkBufferCreateInfo bufCreateInfo{};
-	bufCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufCreateInfo.size = size;
-	bufCreateInfo.usage = usage;
+	if (hostVisible) {
+		pBuffer->buffer = _createBuffer(capacity, usage, pBuffer->allocInfo);
+	} else {
+		pBuffer->buffer = _createDeviceBuffer(capacity, usage);
+		pBuffer->allocInfo = {};
+	}
 
-	VmaAllocationCreateInfo allocCreateInfo{};
-	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-	allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	pBuffer->size = capacity;
+	return true;
+}
 
-	AllocatedBuffer buffer;
-	VK_CHECK(vmaCreateBuffer(_allocator, &bufCreateInfo, &allocCreateInfo, &buffer.buffer, &buffer.allocation, &allocInfo), "Failed to allocate buffer!");
+void Renderer::_destroyBuffer(GrowableBuffer *pBuffer) {
+	if (pBuffer->size > 0) {
+		vmaDestroyBuffer(_allocator, pBuffer->buffer.buffer, pBuffer->buffer.allocation);
+	}
 
-	return buffer;
+	*pBuffer = {};
 }
 
-void Renderer::_copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-	VkCommandBuffer commandBuffer = _beginSingleTimeCommands();
+void Renderer::_reserveDrawBuffers(uint32_t currentFrame, uint32_t instanceCount, uint32_t batchCount) {
+	DrawBuffers *pBuffers = &_drawBuffers[currentFrame];
+	VkDescriptorSet cullSet = _cullSets[currentFrame];
 
-	VkBufferCopy bufCopy{};
-	bufCopy.srcOffset = 0;
-	bufCopy.dstOffset = 0;
-	bufCopy.size = size;
+	// occlusion culling keeps separate commands and instances for each phase
+	uint32_t phaseCount = _cullingMode == CULLING_MODE_GPU_OCCLUSION ? 2 : 1;
 
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &bufCopy);
+	if (_reserveBuffer(&pBuffers->instances, sizeof(ObjectData) * instanceCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true)) {
+		_writeBufferSet(cullSet, 0, pBuffers->instances.buffer.buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		pBuffers->boundInstances = VK_NULL_HANDLE;
+	}
 
-	_endSingleTimeCommands(commandBuffer);
+	if (_reserveBuffer(&pBuffers->objects, sizeof(uint32_t) * instanceCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true)) {
+		_writeBufferSet(cullSet, 1, pBuffers->objects.buffer.buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	}
+
+	if (_reserveBuffer(&pBuffers->batches, sizeof(glm::vec4) * batchCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true)) {
+		_writeBufferSet(cullSet, 2, pBuffers->batches.buffer.buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	}
+
+	if (_reserveBuffer(&pBuffers->commands, sizeof(VkDrawIndexedIndirectCommand) * batchCount * phaseCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, true)) {
+		_writeBufferSet(cullSet, 3, pBuffers->commands.buffer.buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	}
+
+	if (_reserveBuffer(&pBuffers->culledInstances, sizeof(ObjectData) * instanceCount * phaseCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false)) {
+		_writeBufferSet(cullSet, 4, pBuffers->culledInstances.buffer.buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		pBuffers->boundInstances = VK_NULL_HANDLE;
+	}
+
+	// with GPU culling the vertex stage reads the compacted instances
+	bool gpuCulling = _cullingMode == CULLING_MODE_GPU || _cullingMode == CULLING_MODE_GPU_OCCLUSION;
+	VkBuffer instanceBuffer = gpuCulling ? pBuffers->culledInstances.buffer.buffer : pBuffers->instances.buffer.buffer;
+
+	if (pBuffers->boundInstances != instanceBuffer) {
+		_writeBufferSet(_uniformSets[currentFrame], 1, instanceBuffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		pBuffers->boundInstances = instanceBuffer;
+	}
 }
 
-Texture Renderer::_createTexture(uint32_t width, uint32_t height, VkFormat format, const std::vector<uint8_t> &data) {
-	uint8_t mipmaps = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+void Renderer::_flushDrawCommands(uint32_t currentFrame) {
+	_drawBatches.clear();
 
-	AllocatedImage textureImage = _createImage(width, height, format, mipmaps, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	if (_cullingMode == CULLING_MODE_CPU) {
+		_cullDrawCommandsCpu();
+	}
 
-	// create staging buffer
-	VkDeviceSize size = width * height * 4;
+	// group draws sharing a mesh, all of them use the same material
+	std::sort(_drawCommands.begin(), _drawCommands.end(), [](const DrawCommand &a, const DrawCommand &b) {
+		if (a.pMesh != b.pMesh) {
+			return a.pMesh < b.pMesh;
+		}
 
-	VmaAllocationInfo stagingAllocInfo;
-	AllocatedBuffer stagingBuffer = _createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingAllocInfo);
-	memcpy(stagingAllocInfo.pMappedData, data.data(), (size_t)size);
-	vmaFlushAllocation(_allocator, stagingBuffer.allocation, 0, VK_WHOLE_SIZE);
+		return a.transformIndex < b.transformIndex;
+	});
 
-	// transition image layout
-	VkCommandBuffer commandBuffer = _beginSingleTimeCommands();
+	uint32_t instanceCount = static_cast<uint32_t>(_drawCommands.size());
 
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = textureImage.image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = mipmaps;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		const DrawCommand &command = _drawCommands[i];
 
-	VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-	VkPipelineStageFlags destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		if (_drawBatches.empty() || _drawBatches.back().pMesh != command.pMesh) {
+			_drawBatches.push_back({ command.pMesh, i, 0 });
+		}
 
-	vkCmdPipelineBarrier(
-			commandBuffer,
-			sourceStage, destinationStage,
-			0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
+		_drawBatches.back().instanceCount++;
+	}
 
-	_endSingleTimeCommands(commandBuffer);
+	uint32_t batchCount = static_cast<uint32_t>(_drawBatches.size());
+	_reserveDrawBuffers(currentFrame, instanceCount, batchCount);
 
-	// copy buffer to image
-	commandBuffer = _beginSingleTimeCommands();
+	if (_cullingMode == CULLING_MODE_GPU_OCCLUSION) {
+		_reserveVisibility(currentFrame, instanceCount);
+	}
 
-	VkBufferImageCopy region{};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	DrawBuffers *pBuffers = &_drawBuffers[currentFrame];
+
+	_drawObjectIndices.resize(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		_drawObjectIndices[i] = _drawCommands[i].transformIndex;
+	}
+
+	// model view and normal matrices once per object instead of once per vertex
+	ObjectData *pObjectData = (ObjectData *)pBuffers->instances.allocInfo.pMappedData;
+
+	if (_threadPool == nullptr) {
+		ObjectTransforms::compute(_view, _drawTransforms.data(), _drawObjectIndices.data(), pObjectData, instanceCount);
+	} else {
+		_threadPool->parallelFor(instanceCount, OBJECT_TRANSFORM_BATCH_SIZE, [this, pObjectData](uint32_t first, uint32_t last) {
+			ObjectTransforms::compute(_view, _drawTransforms.data(), _drawObjectIndices.data() + first, pObjectData + first, last - first);
+		});
+	}
+
+	vmaFlushAllocation(_allocator, pBuffers->instances.buffer.allocation, 0, VK_WHOLE_SIZE);
+
+	if (_cullingMode != CULLING_MODE_GPU && _cullingMode != CULLING_MODE_GPU_OCCLUSION) {
+		return;
+	}
+
+	uint32_t *pObjects = (uint32_t *)pBuffers->objects.allocInfo.pMappedData;
+	glm::vec4 *pSpheres = (glm::vec4 *)pBuffers->batches.allocInfo.pMappedData;
+	VkDrawIndexedIndirectCommand *pCommands = (VkDrawIndexedIndirectCommand *)pBuffers->commands.allocInfo.pMappedData;
+
+	for (uint32_t i = 0; i < batchCount; i++) {
+		const DrawBatch &batch = _drawBatches[i];
+
+		for (uint32_t j = 0; j < batch.instanceCount; j++) {
+			pObjects[batch.firstInstance + j] = i;
+		}
+
+		pSpheres[i] = batch.pMesh->boundingSphere;
+
+		// instance count is accumulated by the cull shader
+		pCommands[i].indexCount = static_cast<uint32_t>(batch.pMesh->indices.size());
+		pCommands[i].instanceCount = 0;
+		pCommands[i].firstIndex = 0;
+		pCommands[i].vertexOffset = 0;
+		pCommands[i].firstInstance = batch.firstInstance;
+
+		// late phase commands follow the early ones, with their own instances
+		if (_cullingMode == CULLING_MODE_GPU_OCCLUSION) {
+			pCommands[batchCount + i] = pCommands[i];
+			pCommands[batchCount + i].firstInstance = instanceCount + batch.firstInstance;
+		}
+	}
+
+	vmaFlushAllocation(_allocator, pBuffers->objects.buffer.allocation, 0, VK_WHOLE_SIZE);
+	vmaFlushAllocation(_allocator, pBuffers->batches.buffer.allocation, 0, VK_WHOLE_SIZE);
+	vmaFlushAllocation(_allocator, pBuffers->commands.buffer.allocation, 0, VK_WHOLE_SIZE);
+}
+
+void Renderer::_cullDrawCommandsCpu() {
+	size_t drawCount = _drawCommands.size();
+
+	_drawBounds.resize(drawCount);
+	_drawVisibility.resize((drawCount + 7) / 8);
+
+	for (size_t i = 0; i < drawCount; i++) {
+		const DrawCommand &command = _drawCommands[i];
+		_drawBounds.set(i, command.pMesh->boundingSphere, _drawTransforms[command.transformIndex]);
+	}
+
+	Culling::cullSpheres(_frustum, _drawBounds, _drawVisibility.data());
+
+	size_t visibleCount = 0;
+
+	for (size_t i = 0; i < drawCount; i++) {
+		if (_drawVisibility[i / 8] & (1 << (i % 8))) {
+			_drawCommands[visibleCount++] = _drawCommands[i];
+		}
+	}
+
+	_drawCommands.resize(visibleCount);
+}
+
+void Renderer::_cullDrawCommandsGpu(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+	uint32_t instanceCount = static_cast<uint32_t>(_drawCommands.size());
+
+	if (instanceCount == 0) {
+		return;
+	}
+
+	CullPushConstants constants;
+	for (int i = 0; i < 6; i++) {
+		constants.planes[i] = _frustum.planes[i];
+	}
+	constants.instanceCount = instanceCount;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineRegistry->getPipeline(_cullState));
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullState.layout, 0, 1, &_cullSets[currentFrame], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, _cullState.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &constants);
+
+	vkCmdDispatch(commandBuffer, (instanceCount + 63) / 64, 1, 1);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr);
+}
+
+void Renderer::_cullDrawCommandsOcclusion(VkCommandBuffer commandBuffer, uint32_t currentFrame, OcclusionPhase phase) {
+	uint32_t instanceCount = static_cast<uint32_t>(_drawCommands.size());
+
+	if (instanceCount == 0) {
+		return;
+	}
+
+	if (phase == OCCLUSION_PHASE_EARLY) {
+		if (_clearVisibility) {
+			vkCmdFillBuffer(commandBuffer, _visibility.buffer.buffer, 0, VK_WHOLE_SIZE, 0);
+			_clearVisibility = false;
+		}
+
+		// last frame's late phase wrote the visibility and read the pyramid
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				1, &barrier,
+				0, nullptr,
+				0, nullptr);
+	}
+
+	// symmetric side planes in view space, see the shader
+	glm::vec2 frustumX = glm::normalize(glm::vec2(1.0f, _projection[0][0]));
+	glm::vec2 frustumY = glm::normalize(glm::vec2(1.0f, std::abs(_projection[1][1])));
+
+	OcclusionCullPushConstants constants;
+	constants.frustum = glm::vec4(frustumX, frustumY);
+	constants.projection = glm::vec4(_projection[0][0], _projection[1][1], _projection[2][2], _projection[3][2]);
+	constants.zNear = _camera->zNear;
+	constants.zFar = _camera->zFar;
+	constants.pyramidSize = glm::vec2(_depthPyramid.width, _depthPyramid.height);
+	constants.instanceCount = instanceCount;
+	constants.phase = phase;
+	constants.firstCommand = phase == OCCLUSION_PHASE_LATE ? static_cast<uint32_t>(_drawBatches.size()) : 0;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineRegistry->getPipeline(_occlusionCullState));
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _occlusionCullState.layout, 0, 1, &_cullSets[currentFrame], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, _occlusionCullState.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(OcclusionCullPushConstants), &constants);
+
+	vkCmdDispatch(commandBuffer, (instanceCount + 63) / 64, 1, 1);
+
+	// the late phase dispatch also has to wait for the early one
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr);
+}
+
+void Renderer::_reserveVisibility(uint32_t currentFrame, uint32_t instanceCount) {
+	VkDeviceSize size = sizeof(uint32_t) * instanceCount;
+
+	if (size > _visibility.size) {
+		VkDeviceSize capacity = std::max(size, _visibility.size * 2);
+
+		// shared by all frames, the ones in flight may still read the old one
+		if (_visibility.size > 0) {
+			AllocatedBuffer old = _visibility.buffer;
+
+			_deferDeletion([this, old]() {
+				vmaDestroyBuffer(_allocator, old.buffer, old.allocation);
+			});
+
+			_visibility = {};
+		}
+
+		_reserveBuffer(&_visibility, capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false);
+		_clearVisibility = true;
+	}
+
+	// the cull sets of the other frames are rewritten when they come around
+	DrawBuffers *pBuffers = &_drawBuffers[currentFrame];
+
+	if (pBuffers->boundVisibility != _visibility.buffer.buffer) {
+		_writeBufferSet(_cullSets[currentFrame], 5, _visibility.buffer.buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		pBuffers->boundVisibility = _visibility.buffer.buffer;
+	}
+}
+
+void Renderer::_createDepthPyramid() {
+	DepthPyramid *pPyramid = &_depthPyramid;
+
+	if (pPyramid->levelCount > 0) {
+		// the views are referenced by frames in flight
+		DepthPyramid old = *pPyramid;
+
+		_deferDeletion([this, old]() {
+			_destroyDepthPyramid(old);
+		});
+	}
+
+	// largest power of two that fits, every following level halves exactly
+	VkExtent2D extent = _context->getSwapchainExtent();
+	pPyramid->width = previousPowerOfTwo(extent.width);
+	pPyramid->height = previousPowerOfTwo(extent.height);
+
+	uint32_t levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(pPyramid->width, pPyramid->height)))) + 1;
+	pPyramid->levelCount = std::min(levelCount, DEPTH_PYRAMID_MAX_LEVELS);
+
+	VkFormat format = VK_FORMAT_R32_SFLOAT;
+
+	pPyramid->image = _createImage(pPyramid->width, pPyramid->height, format, pPyramid->levelCount, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	pPyramid->view = _createImageView(pPyramid->image.image, format, pPyramid->levelCount, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	for (uint32_t i = 0; i < pPyramid->levelCount; i++) {
+		pPyramid->levelViews[i] = _createImageView(pPyramid->image.image, format, 1, VK_IMAGE_ASPECT_COLOR_BIT, i);
+	}
+
+	// written and sampled, it never leaves the general layout
+	VkCommandBuffer commandBuffer = _beginSingleTimeCommands();
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = pPyramid->image.image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = pPyramid->levelCount;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+	_endSingleTimeCommands(commandBuffer);
+
+	pPyramid->swapchainGeneration = _context->getSwapchainGeneration();
+}
+
+void Renderer::_destroyDepthPyramid(const DepthPyramid &pyramid) {
+	for (uint32_t i = 0; i < pyramid.levelCount; i++) {
+		vkDestroyImageView(_context->getDevice(), pyramid.levelViews[i], nullptr);
+	}
+
+	vkDestroyImageView(_context->getDevice(), pyramid.view, nullptr);
+	vmaDestroyImage(_allocator, pyramid.image.image, pyramid.image.allocation);
+}
+
+void Renderer::_writeDepthPyramidSets(uint32_t currentFrame) {
+	DepthPyramid *pPyramid = &_depthPyramid;
+
+	// the sets of the other frames are rewritten when they come around
+	if (pPyramid->boundViews[currentFrame] == pPyramid->view) {
+		return;
+	}
+
+	VkDescriptorSet *pLevelSets = pPyramid->levelSets[currentFrame];
+
+	for (uint32_t i = 0; i < pPyramid->levelCount; i++) {
+		if (i == 0) {
+			_writeImageSet(pLevelSets[i], 0, _context->getDepthImageView(), pPyramid->sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		} else {
+			_writeImageSet(pLevelSets[i], 0, pPyramid->levelViews[i - 1], pPyramid->sampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		}
+
+		_writeImageSet(pLevelSets[i], 1, pPyramid->levelViews[i], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	}
+
+	_writeImageSet(_cullSets[currentFrame], 6, pPyramid->view, pPyramid->sampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	pPyramid->boundViews[currentFrame] = pPyramid->view;
+}
+
+void Renderer::_buildDepthPyramid(VkCommandBuffer commandBuffer) {
+	// only the rendered part of the depth attachment, the pyramid stretches
+	// it over the whole screen
+	VkExtent2D extent = _renderExtent;
+
+	DepthPyramidPushConstants constants;
+	constants.inputWidth = extent.width;
+	constants.inputHeight = extent.height;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineRegistry->getPipeline(_depthPyramidState));
+
+	for (uint32_t i = 0; i < _depthPyramid.levelCount; i++) {
+		constants.outputWidth = std::max(_depthPyramid.width >> i, 1u);
+		constants.outputHeight = std::max(_depthPyramid.height >> i, 1u);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthPyramidState.layout, 0, 1, &_depthPyramid.levelSets[_currentFrame][i], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, _depthPyramidState.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPushConstants), &constants);
+
+		vkCmdDispatch(commandBuffer, (constants.outputWidth + 7) / 8, (constants.outputHeight + 7) / 8, 1);
+
+		// next level, or the late cull after the last one
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				1, &barrier,
+				0, nullptr,
+				0, nullptr);
+
+		constants.inputWidth = constants.outputWidth;
+		constants.inputHeight = constants.outputHeight;
+	}
+}
+
+// An image barrier, an ownership transfer when the families differ. The
+// release and the acquire take the same layouts, only the access masks differ.
+static VkImageMemoryBarrier imageBarrier(VkImage image, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQueueFamily, uint32_t dstQueueFamily) {
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = srcQueueFamily == dstQueueFamily ? VK_QUEUE_FAMILY_IGNORED : srcQueueFamily;
+	barrier.dstQueueFamilyIndex = srcQueueFamily == dstQueueFamily ? VK_QUEUE_FAMILY_IGNORED : dstQueueFamily;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = levelCount;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = srcAccessMask;
+	barrier.dstAccessMask = dstAccessMask;
+
+	return barrier;
+}
+
+// The next dispatch reads what the previous one wrote.
+static void computeBarrier(VkCommandBuffer commandBuffer) {
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr);
+}
+
+void Renderer::_destroyPostProcess() {
+	PostProcess *pPost = &_postProcess;
+	VkDevice device = _context->getDevice();
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		PostProcessFrame *pFrame = &pPost->frames[i];
+
+		for (uint32_t j = 0; j < pPost->bloomLevels; j++) {
+			vkDestroyImageView(device, pFrame->bloomViews[j], nullptr);
+		}
+
+		vkDestroyImageView(device, pFrame->tonemappedView, nullptr);
+		vkDestroyImageView(device, pFrame->outputView, nullptr);
+
+		vmaDestroyImage(_allocator, pFrame->bloom.image, pFrame->bloom.allocation);
+		vmaDestroyImage(_allocator, pFrame->tonemapped.image, pFrame->tonemapped.allocation);
+		vmaDestroyImage(_allocator, pFrame->output.image, pFrame->output.allocation);
+	}
+
+	pPost->bloomLevels = 0;
+}
+
+void Renderer::_createPostProcess() {
+	PostProcess *pPost = &_postProcess;
+
+	if (pPost->bloomLevels > 0) {
+		// the images are used by frames in flight
+		vkDeviceWaitIdle(_context->getDevice());
+		_destroyPostProcess();
+	}
+
+	VkExtent2D extent = _context->getSwapchainExtent();
+	pPost->bloomWidth = std::max(extent.width / 2, 1u);
+	pPost->bloomHeight = std::max(extent.height / 2, 1u);
+
+	uint32_t levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(pPost->bloomWidth, pPost->bloomHeight)))) + 1;
+	pPost->bloomLevels = std::min(levelCount, BLOOM_MAX_LEVELS);
+
+	// storage support is required for it, unlike for the smaller HDR formats
+	VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		PostProcessFrame *pFrame = &pPost->frames[i];
+
+		pFrame->bloom = _createImage(pPost->bloomWidth, pPost->bloomHeight, format, pPost->bloomLevels, usage);
+
+		for (uint32_t j = 0; j < pPost->bloomLevels; j++) {
+			pFrame->bloomViews[j] = _createImageView(pFrame->bloom.image, format, 1, VK_IMAGE_ASPECT_COLOR_BIT, j);
+		}
+
+		pFrame->tonemapped = _createImage(extent.width, extent.height, format, 1, usage);
+		pFrame->tonemappedView = _createImageView(pFrame->tonemapped.image, format, 1, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		pFrame->output = _createImage(extent.width, extent.height, format, 1, usage);
+		pFrame->outputView = _createImageView(pFrame->output.image, format, 1, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		// left by the scene passes in the shader read only layout
+		VkImageView sceneColor = _context->getSceneColorImageView(i);
+
+		for (uint32_t j = 0; j < pPost->bloomLevels; j++) {
+			if (j == 0) {
+				_writeImageSet(pFrame->downsampleSets[j], 0, sceneColor, _upscaleSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			} else {
+				_writeImageSet(pFrame->downsampleSets[j], 0, pFrame->bloomViews[j - 1], _upscaleSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			}
+
+			_writeImageSet(pFrame->downsampleSets[j], 1, pFrame->bloomViews[j], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+
+			// the last level has nothing below it
+			if (j + 1 < pPost->bloomLevels) {
+				_writeImageSet(pFrame->upsampleSets[j], 0, pFrame->bloomViews[j + 1], _upscaleSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+				_writeImageSet(pFrame->upsampleSets[j], 1, pFrame->bloomViews[j], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+			}
+		}
+
+		VkDescriptorSet tonemapSets[] = { pFrame->tonemapSet, pFrame->tonemapOutputSet };
+		VkImageView tonemapTargets[] = { pFrame->tonemappedView, pFrame->outputView };
+
+		for (uint32_t j = 0; j < 2; j++) {
+			_writeImageSet(tonemapSets[j], 0, sceneColor, _upscaleSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			_writeImageSet(tonemapSets[j], 1, pFrame->bloomViews[0], _upscaleSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			_writeImageSet(tonemapSets[j], 2, tonemapTargets[j], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		}
+
+		_writeImageSet(pFrame->sharpenSet, 0, pFrame->tonemappedView, _upscaleSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		_writeImageSet(pFrame->sharpenSet, 1, pFrame->outputView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	}
+
+	// nothing to show until a chain has run on the new images
+	pPost->resultFrame = UINT32_MAX;
+	pPost->swapchainGeneration = _context->getSwapchainGeneration();
+}
+
+uint64_t Renderer::_submitPostProcess(uint64_t sceneValue) {
+	PostProcess *pPost = &_postProcess;
+	PostProcessFrame *pFrame = &pPost->frames[_currentFrame];
+	VkCommandBuffer commandBuffer = pFrame->commandBuffer;
+	VkExtent2D extent = _renderExtent;
+	VkExtent2D swapchainExtent = _context->getSwapchainExtent();
+
+	uint32_t graphicsFamily = _context->getGraphicsQueueFamily();
+	uint32_t computeFamily = _context->getComputeQueueFamily();
+
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo), "Failed to begin recording command buffer!");
+
+	_postProfiler->beginFrame(commandBuffer, _currentFrame);
+	uint32_t postScope = _postProfiler->beginScope(commandBuffer, "Post");
+
+	{
+		// the scene color's acquire, released by drawEnd(), the rest is
+		// discarded from the last chain
+		VkImageMemoryBarrier barriers[] = {
+			imageBarrier(_context->getSceneColorImage(_currentFrame), 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_ACCESS_SHADER_READ_BIT, graphicsFamily, computeFamily),
+			imageBarrier(pFrame->bloom.image, pPost->bloomLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, computeFamily, computeFamily),
+			imageBarrier(pFrame->tonemapped.image, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, computeFamily, computeFamily),
+			imageBarrier(pFrame->output.image, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT, computeFamily, computeFamily),
+		};
+
+		// on one queue the semaphore wait is enough for the scene color
+		uint32_t first = _context->hasAsyncCompute() ? 0 : 1;
+
+		vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				4 - first, &barriers[first]);
+	}
+
+	if (_postProcessSettings.bloom) {
+		BloomPushConstants constants;
+		constants.inputSize = glm::vec2(extent.width, extent.height);
+		constants.texelSize = 1.0f / glm::vec2(swapchainExtent.width, swapchainExtent.height);
+		constants.threshold = _postProcessSettings.bloomThreshold;
+
+		{
+			GpuProfileScope scope(_postProfiler, commandBuffer, "Bloom downsample");
+
+			for (uint32_t i = 0; i < pPost->bloomLevels; i++) {
+				PipelineStateDesc state = _bloomState;
+				state.specialization[0] = i == 0 ? BLOOM_MODE_PREFILTER : BLOOM_MODE_DOWNSAMPLE;
+
+				constants.outputSize.x = std::max(extent.width >> (i + 1), 1u);
+				constants.outputSize.y = std::max(extent.height >> (i + 1), 1u);
+
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineRegistry->getPipeline(state));
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _bloomState.layout, 0, 1, &pFrame->downsampleSets[i], 0, nullptr);
+				vkCmdPushConstants(commandBuffer, _bloomState.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants), &constants);
+
+				vkCmdDispatch(commandBuffer, (constants.outputSize.x + 7) / 8, (constants.outputSize.y + 7) / 8, 1);
+				computeBarrier(commandBuffer);
+
+				// the next level reads this one
+				constants.inputSize = glm::vec2(constants.outputSize);
+				constants.texelSize = 1.0f / glm::vec2(std::max(pPost->bloomWidth >> i, 1u), std::max(pPost->bloomHeight >> i, 1u));
+			}
+		}
+
+		{
+			GpuProfileScope scope(_postProfiler, commandBuffer, "Bloom upsample");
+
+			PipelineStateDesc state = _bloomState;
+			state.specialization[0] = BLOOM_MODE_UPSAMPLE;
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineRegistry->getPipeline(state));
+
+			// from the smallest level up, each adds the blurred sum of those below
+			for (uint32_t i = pPost->bloomLevels - 1; i-- > 0;) {
+				constants.inputSize.x = static_cast<float>(std::max(extent.width >> (i + 2), 1u));
+				constants.inputSize.y = static_cast<float>(std::max(extent.height >> (i + 2), 1u));
+				constants.texelSize = 1.0f / glm::vec2(std::max(pPost->bloomWidth >> (i + 1), 1u), std::max(pPost->bloomHeight >> (i + 1), 1u));
+				constants.outputSize.x = std::max(extent.width >> (i + 1), 1u);
+				constants.outputSize.y = std::max(extent.height >> (i + 1), 1u);
+
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _bloomState.layout, 0, 1, &pFrame->upsampleSets[i], 0, nullptr);
+				vkCmdPushConstants(commandBuffer, _bloomState.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants), &constants);
+
+				vkCmdDispatch(commandBuffer, (constants.outputSize.x + 7) / 8, (constants.outputSize.y + 7) / 8, 1);
+				computeBarrier(commandBuffer);
+			}
+		}
+	}
+
+	bool sharpen = _postProcessSettings.sharpen;
+
+	{
+		GpuProfileScope scope(_postProfiler, commandBuffer, "Tonemap");
+
+		glm::vec2 bloomSize(std::max(extent.width >> 1, 1u), std::max(extent.height >> 1, 1u));
+
+		PostTonemapPushConstants constants;
+		constants.size = glm::uvec2(extent.width, extent.height);
+		constants.bloomScale = bloomSize / glm::vec2(pPost->bloomWidth, pPost->bloomHeight) / glm::vec2(constants.size);
+		// level 0 sums every level
+		constants.bloomIntensity = _postProcessSettings.bloom ? _postProcessSettings.bloomIntensity / pPost->bloomLevels : 0.0f;
+
+		VkDescriptorSet set = sharpen ? pFrame->tonemapSet : pFrame->tonemapOutputSet;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineRegistry->getPipeline(_postTonemapState));
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _postTonemapState.layout, 0, 1, &set, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, _postTonemapState.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostTonemapPushConstants), &constants);
+
+		vkCmdDispatch(commandBuffer, (extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+	}
+
+	if (sharpen) {
+		GpuProfileScope scope(_postProfiler, commandBuffer, "Sharpen");
+
+		computeBarrier(commandBuffer);
+
+		SharpenPushConstants constants;
+		constants.size = glm::uvec2(extent.width, extent.height);
+		constants.sharpness = _postProcessSettings.sharpness;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineRegistry->getPipeline(_sharpenState));
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _sharpenState.layout, 0, 1, &pFrame->sharpenSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, _sharpenState.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SharpenPushConstants), &constants);
+
+		vkCmdDispatch(commandBuffer, (extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+	}
+
+	{
+		// the release, the composite acquires it with the same barrier
+		VkImageMemoryBarrier barrier = imageBarrier(pFrame->output.image, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, 0, computeFamily, graphicsFamily);
+
+		vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				1, &barrier);
+	}
+
+	_postProfiler->endScope(commandBuffer, postScope);
+	_postProfiler->endFrame(commandBuffer);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	// the scene passes of this frame have written the scene color
+	SemaphoreWait sceneWait = { _context->getGraphicsTimeline()->getSemaphore(), sceneValue, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+
+	pFrame->timelineValue = _context->getComputeTimeline()->submit(&commandBuffer, 1, { sceneWait });
+	pFrame->extent = extent;
+	pFrame->shown = false;
+
+	return pFrame->timelineValue;
+}
+
+void Renderer::_beginRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, RenderPassType type) {
+	// the scene passes only cover the render extent
+	VkExtent2D extent = type == RENDER_PASS_TYPE_UPSCALE ? _context->getSwapchainExtent() : _renderExtent;
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = _context->getRenderPass(type);
+	// with post-processing only the upscale pass touches the swapchain image
+	bool sceneFramebuffer = _context->hasPostProcessing() && type != RENDER_PASS_TYPE_UPSCALE;
+	renderPassInfo.framebuffer = sceneFramebuffer ? _context->getSceneFramebuffer(_currentFrame) : _context->getFramebuffer(imageIndex, type);
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = extent;
+
+	std::array<VkClearValue, 3> clearValues{};
+	clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+	clearValues[2].depthStencil = { 1.0f, 0 };
+
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)extent.width;
+	viewport.height = (float)extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void Renderer::_recordDrawBatches(VkCommandBuffer commandBuffer, uint32_t firstCommand) {
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _material.state.layout, 0, 1, &_uniformSets[_currentFrame], 0, nullptr);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _material.state.layout, 1, 1, &_material.textureSet, 0, nullptr);
+
+	VkBuffer commandsBuffer = _drawBuffers[_currentFrame].commands.buffer.buffer;
+	bool indirect = _cullingMode == CULLING_MODE_GPU || _cullingMode == CULLING_MODE_GPU_OCCLUSION;
+
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+
+	for (uint32_t i = 0; i < _drawBatches.size(); i++) {
+		const DrawBatch &batch = _drawBatches[i];
+		Mesh *pMesh = batch.pMesh;
+
+		// layouts match, so the bound sets survive a pipeline switch
+		VkPipeline pipeline = _getMaterialPipeline(pMesh->materialFeatures);
+
+		if (pipeline != boundPipeline) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+		}
+
+		// the table stays bound, only the index changes between draws
+		MaterialPushConstants constants = { pMesh->textureIndex };
+		vkCmdPushConstants(commandBuffer, _material.state.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &pMesh->vertexBuffer.buffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, pMesh->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		if (indirect) {
+			VkDeviceSize commandOffset = sizeof(VkDrawIndexedIndirectCommand) * (firstCommand + i);
+			vkCmdDrawIndexedIndirect(commandBuffer, commandsBuffer, commandOffset, 1, sizeof(VkDrawIndexedIndirectCommand));
+		} else {
+			vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(pMesh->indices.size()), batch.instanceCount, 0, 0, batch.firstInstance);
+		}
+
+		_frameStatistics.drawCalls++;
+		_frameStatistics.instances += batch.instanceCount;
+		_frameStatistics.triangles += static_cast<uint64_t>(pMesh->indices.size() / 3) * batch.instanceCount;
+	}
+}
+
+void Renderer::_upscale(VkCommandBuffer commandBuffer, VkDescriptorSet set, VkExtent2D renderExtent) {
+	// the sampled image is swapchain sized, the scene color or the post output
+	VkExtent2D extent = _context->getSwapchainExtent();
+
+	PipelineStateDesc state = _upscaleState;
+	state.specialization[0] = _upscaleFilter;
+
+	UpscalePushConstants constants;
+	constants.renderSize = glm::vec2(renderExtent.width, renderExtent.height);
+	constants.texelSize = 1.0f / glm::vec2(extent.width, extent.height);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineRegistry->getPipeline(state));
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _upscaleState.layout, 0, 1, &set, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, _upscaleState.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(UpscalePushConstants), &constants);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void Renderer::_writeImageSet(VkDescriptorSet dstSet, uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout, VkDescriptorType descriptorType, uint32_t arrayElement) {
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = imageLayout;
+	imageInfo.imageView = imageView;
+	imageInfo.sampler = sampler;
+
+	VkWriteDescriptorSet writeDescriptorSet = {};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.dstSet = dstSet;
+	writeDescriptorSet.dstBinding = binding;
+	writeDescriptorSet.dstArrayElement = arrayElement;
+	writeDescriptorSet.descriptorType = descriptorType;
+	writeDescriptorSet.descriptorCount = 1;
+	writeDescriptorSet.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(_context->getDevice(), 1, &writeDescriptorSet, 0, nullptr);
+}
+
+void Renderer::_writeBufferSet(VkDescriptorSet dstSet, uint32_t binding, VkBuffer buffer, VkDeviceSize range, VkDescriptorType descriptorType) {
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = range;
+
+	VkWriteDescriptorSet writeDescriptorSet = {};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.dstSet = dstSet;
+	writeDescriptorSet.dstBinding = binding;
+	writeDescriptorSet.dstArrayElement = 0;
+	writeDescriptorSet.descriptorType = descriptorType;
+	writeDescriptorSet.descriptorCount = 1;
+	writeDescriptorSet.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(_context->getDevice(), 1, &writeDescriptorSet, 0, nullptr);
+}
+
+AllocatedBuffer Renderer::_createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationInfo &allocInfo) {
+	VkBufferCreateInfo bufCreateInfo{};
+	bufCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufCreateInfo.size = size;
+	bufCreateInfo.usage = usage;
+
+	VmaAllocationCreateInfo allocCreateInfo{};
+	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+	allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	AllocatedBuffer buffer;
+	VK_CHECK(vmaCreateBuffer(_allocator, &bufCreateInfo, &allocCreateInfo, &buffer.buffer, &buffer.allocation, &allocInfo), "Failed to allocate buffer!");
+
+	return buffer;
+}
+
+AllocatedBuffer Renderer::_createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage) {
+	VkBufferCreateInfo bufCreateInfo{};
+	bufCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufCreateInfo.size = size;
+	bufCreateInfo.usage = usage;
+
+	VmaAllocationCreateInfo allocCreateInfo{};
+	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	AllocatedBuffer buffer;
+	VK_CHECK(vmaCreateBuffer(_allocator, &bufCreateInfo, &allocCreateInfo, &buffer.buffer, &buffer.allocation, nullptr), "Failed to allocate device buffer!");
+
+	return buffer;
+}
+
+void Renderer::_copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+	VkCommandBuffer commandBuffer = _beginSingleTimeCommands();
+
+	VkBufferCopy bufCopy{};
+	bufCopy.srcOffset = 0;
+	bufCopy.dstOffset = 0;
+	bufCopy.size = size;
+
+	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &bufCopy);
+
+	_endSingleTimeCommands(commandBuffer);
+}
+
+Texture Renderer::_createTexture(uint32_t width, uint32_t height, VkFormat format, const std::vector<uint8_t> &data) {
+	uint8_t mipmaps = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+	AllocatedImage textureImage = _createImage(width, height, format, mipmaps, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	// create staging buffer
+	VkDeviceSize size = width * height * 4;
+
+	VmaAllocationInfo stagingAllocInfo;
+	AllocatedBuffer stagingBuffer = _createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingAllocInfo);
+	memcpy(stagingAllocInfo.pMappedData, data.data(), (size_t)size);
+	vmaFlushAllocation(_allocator, stagingBuffer.allocation, 0, VK_WHOLE_SIZE);
+
+	// transition image layout
+	VkCommandBuffer commandBuffer = _beginSingleTimeCommands();
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = textureImage.image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipmaps;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	VkPipelineStageFlags destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	vkCmdPipelineBarrier(
+			commandBuffer,
+			sourceStage, destinationStage,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+	_endSingleTimeCommands(commandBuffer);
+
+	// copy buffer to image
+	commandBuffer = _beginSingleTimeCommands();
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	region.imageSubresource.mipLevel = 0;
 	region.imageSubresource.baseArrayLayer = 0;
 	region.imageSubresource.layerCount = 1;
@@ -570,14 +1795,14 @@ AllocatedImage Renderer::_createImage(uint32_t width, uint32_t height, VkFormat
 	return allocatedImage;
 }
 
-VkImageView Renderer::_createImageView(VkImage image, VkFormat format, uint32_t mipmaps, VkImageAspectFlags aspectFlags) {
+VkImageView Renderer::_createImageView(VkImage image, VkFormat format, uint32_t mipmaps, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel) {
 	VkImageViewCreateInfo viewInfo{};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewInfo.image = image;
 	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
-	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
 	viewInfo.subresourceRange.levelCount = mipmaps;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
@@ -588,125 +1813,6 @@ VkImageView Renderer::_createImageView(VkImage image, VkFormat format, uint32_t
 	return imageView;
 }
 
-VkPipelineLayout Renderer::_createPipelineLayout(VkDescriptorSetLayout *pSetLayouts, uint32_t layoutCount, VkPushConstantRange *pPushConstants, uint32_t constantCount) {
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = layoutCount;
-	pipelineLayoutInfo.pSetLayouts = pSetLayouts;
-	pipelineLayoutInfo.pushConstantRangeCount = constantCount;
-	pipelineLayoutInfo.pPushConstantRanges = pPushConstants;
-
-	VkPipelineLayout pipelineLayout;
-	VK_CHECK(vkCreatePipelineLayout(_context->getDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout), "Failed to create pipeline layout!");
-
-	return pipelineLayout;
-}
-
-VkPipeline Renderer::_createPipeline(VkPipelineLayout layout, VkShaderModule vertex, VkShaderModule fragment, uint32_t subpass) {
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertex;
-	vertShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragment;
-	fragShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.scissorCount = 1;
-
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizer.depthBiasEnable = VK_FALSE;
-
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;
-	depthStencil.stencilTestEnable = VK_FALSE;
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f;
-	colorBlending.blendConstants[1] = 0.0f;
-	colorBlending.blendConstants[2] = 0.0f;
-	colorBlending.blendConstants[3] = 0.0f;
-
-	std::vector<VkDynamicState> dynamicStates = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR
-	};
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-	dynamicState.pDynamicStates = dynamicStates.data();
-
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = &depthStencil;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = &dynamicState;
-	pipelineInfo.layout = layout;
-	pipelineInfo.renderPass = _context->getRenderPass();
-	pipelineInfo.subpass = subpass;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-	VkPipeline pipeline;
-	VK_CHECK(vkCreateGraphicsPipelines(_context->getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline), "Failed to create graphics pipeline!");
-
-	return pipeline;
-}
-
 VkCommandBuffer Renderer::_beginSingleTimeCommands() {
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -727,34 +1833,142 @@ VkCommandBuffer Renderer::_beginSingleTimeCommands() {
 }
 
 void Renderer::_endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+	PROFILE_ZONE("Upload wait");
+
 	vkEndCommandBuffer(commandBuffer);
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	// only waits for this upload, not for the frames in flight
+	QueueTimeline *pTimeline = _context->getGraphicsTimeline();
+	pTimeline->wait(pTimeline->submit(&commandBuffer, 1));
+
+	vkFreeCommandBuffers(_context->getDevice(), _context->getCommandPool(), 1, &commandBuffer);
+}
+
+VkInstance Renderer::getInstance() {
+	return _context->getInstance();
+}
+
+Camera *Renderer::getCamera() {
+	return _camera;
+}
+
+bool Renderer::_initResources() {
+	_initAllocator();
+	_initCommands();
+	_initQueries();
+
+	if (!_initShaders()) {
+		return false;
+	}
+
+	_initDescriptors();
+	_initTextureTable();
+	_initPipelines();
+
+	// until the first frame picks a scale
+	_renderExtent = _context->getSwapchainExtent();
+
+	printf("Created %u pipelines in %.2f ms (%s)\n", _pipelineCount, _pipelineCreationTime,
+			_context->getPipelineCache() != VK_NULL_HANDLE ? "pipeline cache" : "no pipeline cache");
+
+#ifdef SHADER_RUNTIME_COMPILE
+	ShaderCache::printStatistics();
+#endif
+
+	return true;
+}
+
+void Renderer::_destroyResources() {
+	VkDevice device = _context->getDevice();
+
+	// nothing in flight may use what is destroyed below
+	vkDeviceWaitIdle(device);
+
+#ifdef SHADER_RUNTIME_COMPILE
+	delete _shaderReloader;
+#endif
+
+	// a reload that arrived after the last frame, its old pipelines join the
+	// deletions that are still queued
+	_applyShaderReloads();
+
+	for (std::function<void()> &function : _pendingDeletions) {
+		function();
+	}
+
+	_pendingDeletions.clear();
+
+	for (DeferredDeletion &deletion : _deletionQueue) {
+		deletion.function();
+	}
+
+	_deletionQueue.clear();
+
+	// waits for background prewarming
+	delete _pipelineRegistry;
+
+	// each state owns its shader, reloaded ones included
+	PipelineStateDesc *states[] = { &_material.state, &_tonemapping.state, &_cullState, &_occlusionCullState, &_depthPyramidState, &_upscaleState, &_bloomState, &_postTonemapState, &_sharpenState };
+
+	for (PipelineStateDesc *pState : states) {
+		delete pState->pShader;
+		pState->pShader = nullptr;
+	}
+
+	// ImGui's pipeline is in there too
+	_context->savePipelineCache();
+
+	if (_imguiPool != VK_NULL_HANDLE) {
+		ImGui_ImplVulkan_Shutdown();
+		vkDestroyDescriptorPool(device, _imguiPool, nullptr);
+	}
+
+	delete _gpuProfiler;
+	delete _postProfiler;
+
+	if (_depthPyramid.levelCount > 0) {
+		_destroyDepthPyramid(_depthPyramid);
+	}
+
+	if (_postProcess.bloomLevels > 0) {
+		_destroyPostProcess();
+	}
+
+	vkDestroySampler(device, _depthPyramid.sampler, nullptr);
+	vkDestroySampler(device, _upscaleSampler, nullptr);
+
+	textureDestroy(&_defaultTexture);
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		vmaDestroyBuffer(_allocator, _uniformBuffers[i].buffer, _uniformBuffers[i].allocation);
 
-	vkQueueSubmit(_context->getGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(_context->getGraphicsQueue());
+		DrawBuffers *pBuffers = &_drawBuffers[i];
+		_destroyBuffer(&pBuffers->instances);
+		_destroyBuffer(&pBuffers->objects);
+		_destroyBuffer(&pBuffers->batches);
+		_destroyBuffer(&pBuffers->commands);
+		_destroyBuffer(&pBuffers->culledInstances);
 
-	vkFreeCommandBuffers(_context->getDevice(), _context->getCommandPool(), 1, &commandBuffer);
-}
+		delete _frameDescriptors[i];
+	}
 
-VkInstance Renderer::getInstance() {
-	return _context->getInstance();
-}
+	_destroyBuffer(&_visibility);
 
-Camera *Renderer::getCamera() {
-	return _camera;
+	delete _textureAllocator;
+	delete _descriptorAllocator;
+
+	// the command buffers go with the context's pools
+	vmaDestroyAllocator(_allocator);
 }
 
-void Renderer::windowInit(VkSurfaceKHR surface, uint32_t width, uint32_t height) {
+bool Renderer::windowInit(VkSurfaceKHR surface, uint32_t width, uint32_t height) {
 	_context->windowCreate(surface, width, height);
+	return _initResources();
+}
 
-	_initAllocator();
-	_initCommands();
-	_initDescriptors();
-	_initPipelines();
+bool Renderer::headlessInit(uint32_t width, uint32_t height) {
+	_context->headlessCreate(width, height);
+	return _initResources();
 }
 
 void Renderer::windowResize(uint32_t width, uint32_t height) {
@@ -767,41 +1981,131 @@ Mesh Renderer::meshCreate(std::vector<Vertex> vertices, std::vector<uint32_t> in
 	mesh.vertices = vertices;
 	mesh.indices = indices;
 
+	mesh.aabb = Culling::computeAABB(vertices);
+	mesh.boundingSphere = Culling::computeBoundingSphere(vertices, mesh.aabb);
+
 	_uploadMesh(&mesh);
 	return mesh;
 }
 
+void Renderer::meshDestroy(Mesh *pMesh) {
+	vmaDestroyBuffer(_allocator, pMesh->vertexBuffer.buffer, pMesh->vertexBuffer.allocation);
+	vmaDestroyBuffer(_allocator, pMesh->indexBuffer.buffer, pMesh->indexBuffer.allocation);
+
+	pMesh->vertexBuffer = {};
+	pMesh->indexBuffer = {};
+}
+
 Texture Renderer::textureCreate(uint32_t width, uint32_t height, VkFormat format, const std::vector<uint8_t> &data) {
 	Texture texture = _createTexture(width, height, format, data);
 
-	// TODO: this does not belong here!
-	_writeImageSet(_material.textureSet, texture.view, texture.sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	if (_textureCount == _textureTableSize) {
+		printf("Texture table is full, using the default texture!\n");
+		texture.index = _defaultTexture.index;
+		return texture;
+	}
+
+	texture.index = _textureCount++;
+
+	// a fixed size table can't be written while a frame in flight uses it
+	if (!_context->hasDescriptorIndexing()) {
+		vkDeviceWaitIdle(_context->getDevice());
+	}
+
+	_writeImageSet(_material.textureSet, 0, texture.view, texture.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture.index);
 
 	return texture;
 }
 
+void Renderer::textureDestroy(Texture *pTexture) {
+	VkDevice device = _context->getDevice();
+
+	vkDestroySampler(device, pTexture->sampler, nullptr);
+	vkDestroyImageView(device, pTexture->view, nullptr);
+	vmaDestroyImage(_allocator, pTexture->image.image, pTexture->image.allocation);
+}
+
 void Renderer::drawBegin() {
-	SyncObject sync = _context->getSyncObject(_currentFrame);
+	PROFILE_ZONE("drawBegin");
+
 	VkCommandBuffer commandBuffer = _commandBuffers[_currentFrame];
 
-	vkWaitForFences(_context->getDevice(), 1, &sync.renderFence, VK_TRUE, UINT64_MAX);
+	// the frame that last used this slot has retired
+	{
+		PROFILE_ZONE("Frame wait");
+
+		auto start = std::chrono::steady_clock::now();
+		_context->getGraphicsTimeline()->wait(_frameTimelineValues[_currentFrame]);
+
+		// with async compute its chain can still be running, its images and
+		// command buffer are reused below
+		if (_context->hasPostProcessing()) {
+			_context->getComputeTimeline()->wait(_postProcess.frames[_currentFrame].timelineValue);
+		}
+
+		_frameStatistics.waitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	_retireDeletions();
+
+	_frameDescriptors[_currentFrame]->reset();
+
+	// the frame has finished, so the results are available without waiting
+	uint32_t collectedFrames = _gpuProfiler->getCollectedFrameCount();
+	_gpuProfiler->collect(_currentFrame);
+
+	if (_postProfiler != nullptr) {
+		_postProfiler->collect(_currentFrame);
+	}
+
+	// frame boundary, nothing is recorded with the old pipelines from here on
+	_applyShaderReloads();
+
+	// from the background prewarm, those pipelines are created again on use
+	_reportPrewarmErrors();
 
 	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(_context->getDevice(), _context->getSwapchain(), UINT64_MAX, sync.presentSemaphore, VK_NULL_HANDLE, &imageIndex);
+	VkResult result = _context->acquireNextImage(_currentFrame, &imageIndex);
 
+	// nothing was acquired, retry with the new swapchain
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		_context->recreateSwapchain();
-	} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+		result = _context->acquireNextImage(_currentFrame, &imageIndex);
+	}
+
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
 		printf("Failed to acquire swapchain image!");
 	}
 
-	// update subpass attachment
-	vkDeviceWaitIdle(_context->getDevice());
-	_writeImageSet(_subpassSet, _context->getColorImageView(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+	// a swapchain format change recreated the render passes
+	uint32_t renderPassRecreations = _context->getSwapchainStatistics().renderPassRecreations;
 
-	_updateUniformBuffer(_currentFrame);
+	if (renderPassRecreations != _renderPassRecreations) {
+		_renderPassRecreations = renderPassRecreations;
+		_rebuildGraphicsPipelines();
+	}
+
+	// after the acquire, which may have resized the swapchain
+	_updateRenderScale(collectedFrames);
+
+	// a set of this frame's own, nothing in flight has to be waited on when the
+	// color attachment changes. A scaled or post-processed frame tonemaps the
+	// color of the upscale pass.
+	bool upscalePass = _scaled || _context->hasPostProcessing();
+	VkImageView tonemapInput = upscalePass ? _context->getUpscaleColorImageView() : _context->getColorImageView();
+
+	DescriptorSetDesc subpassDesc(_subpassSetLayout);
+	subpassDesc.addImage(0, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, tonemapInput, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	_subpassSet = _frameDescriptors[_currentFrame]->getSet(subpassDesc);
 
-	vkResetFences(_context->getDevice(), 1, &sync.renderFence);
+	// with post-processing drawEnd() gets the set of the output it shows
+	if (_scaled && !_context->hasPostProcessing()) {
+		DescriptorSetDesc upscaleDesc(_upscaleSetLayout);
+		upscaleDesc.addImage(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _context->getColorImageView(), _upscaleSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		_upscaleSet = _frameDescriptors[_currentFrame]->getSet(upscaleDesc);
+	}
+
+	_updateUniformBuffer(_currentFrame);
 
 	vkResetCommandBuffer(commandBuffer, 0);
 
@@ -810,115 +2114,476 @@ void Renderer::drawBegin() {
 
 	VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo), "Failed to begin recording command buffer!");
 
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = _context->getRenderPass();
-	renderPassInfo.framebuffer = _context->getFramebuffer(imageIndex);
-	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = _context->getSwapchainExtent();
-
-	std::array<VkClearValue, 3> clearValues{};
-	clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-	clearValues[2].depthStencil = { 1.0f, 0 };
-
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
+	_drawCommands.clear();
+	_drawTransforms.clear();
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	_renderHandle = new RenderHandle;
+	_renderHandle->commandBuffer = commandBuffer;
+	_renderHandle->imageIndex = imageIndex;
+}
 
+void Renderer::_updateRenderScale(uint32_t collectedFrames) {
 	VkExtent2D extent = _context->getSwapchainExtent();
+	float scale = 1.0f;
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)extent.width;
-	viewport.height = (float)extent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+	if (_context->hasDynamicResolution()) {
+		// only when collecting read a new frame, each is counted once
+		if (_gpuProfiler->getCollectedFrameCount() != collectedFrames) {
+			// the frames recorded since still have the old scale
+			_dynamicResolution.update(_gpuProfiler->getFrameMilliseconds(collectedFrames), MAX_FRAMES_IN_FLIGHT - 1);
+		}
 
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = extent;
+		scale = _dynamicResolution.getScale();
+	}
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _material.pipeline);
+	_renderExtent.width = std::max(static_cast<uint32_t>(std::lround(extent.width * scale)), 1u);
+	_renderExtent.height = std::max(static_cast<uint32_t>(std::lround(extent.height * scale)), 1u);
 
-	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	_scaled = _renderExtent.width < extent.width || _renderExtent.height < extent.height;
+}
 
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _material.pipelineLayout, 0, 1, &_uniformSets[_currentFrame], 0, nullptr);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _material.pipelineLayout, 1, 1, &_material.textureSet, 0, nullptr);
+void Renderer::drawMesh(Mesh *pMesh, const glm::mat4 &transform) {
+	uint32_t transformIndex = static_cast<uint32_t>(_drawTransforms.size());
 
-	_renderHandle = new RenderHandle;
-	_renderHandle->commandBuffer = commandBuffer;
-	_renderHandle->imageIndex = imageIndex;
+	_drawTransforms.push_back(transform);
+	_drawCommands.push_back({ pMesh, transformIndex });
 }
 
-void Renderer::drawMesh(Mesh *pMesh, const glm::mat4 &transform) {
-	VkCommandBuffer commandBuffer = _renderHandle->commandBuffer;
+void Renderer::drawScene(Scene *pScene) {
+	// a zone per drawMesh() would cost more than the call itself
+	PROFILE_ZONE("drawScene");
+
+	pScene->update();
 
-	MeshPushConstants constants;
-	constants.model = transform;
+	const std::vector<Mesh *> &meshes = pScene->getMeshes();
+	const std::vector<glm::mat4> &transforms = pScene->getWorldTransforms();
 
-	vkCmdPushConstants(commandBuffer, _material.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+	_drawTransforms.reserve(_drawTransforms.size() + transforms.size());
+	_drawCommands.reserve(_drawCommands.size() + transforms.size());
 
-	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &pMesh->vertexBuffer.buffer, &offset);
-	vkCmdBindIndexBuffer(commandBuffer, pMesh->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(pMesh->indices.size()), 1, 0, 0, 0);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (meshes[i] != nullptr) {
+			drawMesh(meshes[i], transforms[i]);
+		}
+	}
 }
 
 void Renderer::drawEnd() {
+	PROFILE_ZONE("drawEnd");
+
 	VkCommandBuffer commandBuffer = _renderHandle->commandBuffer;
 	uint32_t imageIndex = _renderHandle->imageIndex;
 
-	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+	// instance buffer may be reallocated, must happen before the uniform set is bound
+	_flushDrawCommands(_currentFrame);
+
+	_frameStatistics.drawCalls = 0;
+	_frameStatistics.instances = 0;
+	_frameStatistics.triangles = 0;
+
+	bool post = _context->hasPostProcessing();
+	// the scene passes keep the HDR color for the upscale pass or the chain
+	bool keepColor = _scaled || post;
+
+	if (post && _postProcess.swapchainGeneration != _context->getSwapchainGeneration()) {
+		_createPostProcess();
+	}
+
+	// covers culling and every render pass of the frame, with post-processing
+	// only the scene passes and "Composite" the rest
+	_gpuProfiler->beginFrame(commandBuffer, _currentFrame);
+	uint32_t frameScope = _gpuProfiler->beginScope(commandBuffer, "Frame");
+
+	if (_cullingMode == CULLING_MODE_GPU) {
+		GpuProfileScope scope(_gpuProfiler, commandBuffer, "Culling");
+		_cullDrawCommandsGpu(commandBuffer, _currentFrame);
+	}
+
+	uint32_t drawScope;
+
+	if (_cullingMode == CULLING_MODE_GPU_OCCLUSION) {
+		if (_depthPyramid.swapchainGeneration != _context->getSwapchainGeneration()) {
+			_createDepthPyramid();
+		}
+
+		_writeDepthPyramidSets(_currentFrame);
+
+		{
+			GpuProfileScope scope(_gpuProfiler, commandBuffer, "Early culling");
+
+			// last frame's visible objects, the pyramid is built from their depth
+			_cullDrawCommandsOcclusion(commandBuffer, _currentFrame, OCCLUSION_PHASE_EARLY);
+		}
+
+		{
+			GpuProfileScope scope(_gpuProfiler, commandBuffer, "Early pass");
+
+			_beginRenderPass(commandBuffer, imageIndex, RENDER_PASS_TYPE_EARLY);
+			_recordDrawBatches(commandBuffer, 0);
+			vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdEndRenderPass(commandBuffer);
+		}
+
+		{
+			GpuProfileScope scope(_gpuProfiler, commandBuffer, "Depth pyramid");
+			_buildDepthPyramid(commandBuffer);
+		}
+
+		{
+			GpuProfileScope scope(_gpuProfiler, commandBuffer, "Late culling");
+
+			// everything else that passes the occlusion test
+			_cullDrawCommandsOcclusion(commandBuffer, _currentFrame, OCCLUSION_PHASE_LATE);
+		}
+
+		drawScope = _gpuProfiler->beginScope(commandBuffer, "Late pass");
+		_beginRenderPass(commandBuffer, imageIndex, keepColor ? RENDER_PASS_TYPE_LATE_SCALED : RENDER_PASS_TYPE_LATE);
+		_recordDrawBatches(commandBuffer, static_cast<uint32_t>(_drawBatches.size()));
+	} else {
+		drawScope = _gpuProfiler->beginScope(commandBuffer, "Geometry");
+		_beginRenderPass(commandBuffer, imageIndex, keepColor ? RENDER_PASS_TYPE_MAIN_SCALED : RENDER_PASS_TYPE_MAIN);
+		_recordDrawBatches(commandBuffer, 0);
+	}
+
+	// a scaled scene is tonemapped in a pass of its own, after the upsample
+	if (keepColor) {
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	_gpuProfiler->endScope(commandBuffer, drawScope);
+
+	std::vector<SemaphoreWait> waits;
+
+	if (post) {
+		uint32_t computeFamily = _context->getComputeQueueFamily();
+		uint32_t graphicsFamily = _context->getGraphicsQueueFamily();
+
+		if (_context->hasAsyncCompute()) {
+			// the release, _submitPostProcess() acquires it with the same barrier
+			VkImageMemoryBarrier barrier = imageBarrier(_context->getSceneColorImage(_currentFrame), 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0, graphicsFamily, computeFamily);
+
+			vkCmdPipelineBarrier(commandBuffer,
+					VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+					0, nullptr,
+					0, nullptr,
+					1, &barrier);
+		}
+
+		_gpuProfiler->endScope(commandBuffer, frameScope);
+		_gpuProfiler->endFrame(commandBuffer);
+
+		vkEndCommandBuffer(commandBuffer);
+
+		// doesn't touch the swapchain image, so it needn't wait for the acquire
+		uint64_t sceneValue = _context->getGraphicsTimeline()->submit(&commandBuffer, 1);
+		_submitPostProcess(sceneValue);
+
+		// with async compute the chain overlaps the next frame's scene passes,
+		// this frame shows the previous frame's output
+		uint32_t resultFrame = _currentFrame;
+
+		if (_context->hasAsyncCompute()) {
+			if (_postProcess.resultFrame != UINT32_MAX) {
+				resultFrame = _postProcess.resultFrame;
+			}
+
+			_postProcess.resultFrame = _currentFrame;
+		}
+
+		PostProcessFrame *pResult = &_postProcess.frames[resultFrame];
+		waits.push_back({ _context->getComputeTimeline()->getSemaphore(), pResult->timelineValue, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT });
+
+		DescriptorSetDesc upscaleDesc(_upscaleSetLayout);
+		upscaleDesc.addImage(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pResult->outputView, _upscaleSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkDescriptorSet upscaleSet = _frameDescriptors[_currentFrame]->getSet(upscaleDesc);
+
+		// the composite, everything that touches the swapchain image
+		commandBuffer = _compositeCommandBuffers[_currentFrame];
+		vkResetCommandBuffer(commandBuffer, 0);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+		VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo), "Failed to begin recording command buffer!");
+
+		frameScope = _gpuProfiler->beginScope(commandBuffer, "Composite");
+
+		if (_context->hasAsyncCompute() && !pResult->shown) {
+			// the acquire of the output, released by _submitPostProcess()
+			VkImageMemoryBarrier barrier = imageBarrier(pResult->output.image, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_ACCESS_SHADER_READ_BIT, computeFamily, graphicsFamily);
+
+			vkCmdPipelineBarrier(commandBuffer,
+					VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+					0, nullptr,
+					0, nullptr,
+					1, &barrier);
+		}
+
+		pResult->shown = true;
+
+		{
+			GpuProfileScope scope(_gpuProfiler, commandBuffer, "Upscale");
+
+			_beginRenderPass(commandBuffer, imageIndex, RENDER_PASS_TYPE_UPSCALE);
+			_upscale(commandBuffer, upscaleSet, pResult->extent);
+		}
+	} else if (_scaled) {
+		GpuProfileScope scope(_gpuProfiler, commandBuffer, "Upscale");
+
+		_beginRenderPass(commandBuffer, imageIndex, RENDER_PASS_TYPE_UPSCALE);
+		_upscale(commandBuffer, _upscaleSet, _renderExtent);
+	}
+
+	{
+		GpuProfileScope scope(_gpuProfiler, commandBuffer, "ImGui");
+		ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+	}
 
 	// Tonemapping
 	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 
-	VkExtent2D extent = _context->getSwapchainExtent();
+	{
+		GpuProfileScope scope(_gpuProfiler, commandBuffer, "Tonemap");
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)extent.width;
-	viewport.height = (float)extent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+		// the post output is tonemapped already
+		PipelineStateDesc state = _tonemapping.state;
+		state.specialization[0] = post ? TONEMAP_OPERATOR_NONE : TONEMAP_OPERATOR_ACES;
 
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = extent;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineRegistry->getPipeline(state));
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _tonemapping.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _tonemapping.state.layout, 0, 1, &_subpassSet, 0, nullptr);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	}
 
-	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	vkCmdEndRenderPass(commandBuffer);
 
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _tonemapping.pipelineLayout, 0, 1, &_subpassSet, 0, nullptr);
-	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	_gpuProfiler->endScope(commandBuffer, frameScope);
 
-	vkCmdEndRenderPass(commandBuffer);
+	// ended with the scene passes
+	if (!post) {
+		_gpuProfiler->endFrame(commandBuffer);
+	}
 
 	vkEndCommandBuffer(commandBuffer);
 
-	_context->submit(_currentFrame, imageIndex, commandBuffer);
+	uint64_t timelineValue = _context->submit(_currentFrame, imageIndex, commandBuffer, waits);
+	_frameTimelineValues[_currentFrame] = timelineValue;
+
+	// deferred while recording, this frame may still use them, on either queue
+	uint64_t computeValue = _context->getComputeTimeline()->getSubmittedValue();
+
+	for (std::function<void()> &function : _pendingDeletions) {
+		_deletionQueue.push_back({ timelineValue, computeValue, std::move(function) });
+	}
+
+	_pendingDeletions.clear();
 
 	_currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 
-	free(_renderHandle);
+	delete _renderHandle;
+	_renderHandle = nullptr;
+}
+
+void Renderer::setDebugView(MaterialDebugView view) {
+	_debugView = view;
+}
+
+MaterialDebugView Renderer::getDebugView() {
+	return _debugView;
+}
+
+void Renderer::setCullingMode(CullingMode mode) {
+	bool gpuCulling = mode == CULLING_MODE_GPU || mode == CULLING_MODE_GPU_OCCLUSION;
+
+	// indirect draws start at the first instance of their batch
+	if (gpuCulling && !_context->getEnabledFeatures().drawIndirectFirstInstance) {
+		printf("GPU culling requires drawIndirectFirstInstance!\n");
+		return;
+	}
+
+	// visibility from an earlier session no longer matches the draw order
+	if (mode == CULLING_MODE_GPU_OCCLUSION && _cullingMode != mode) {
+		_clearVisibility = true;
+	}
+
+	_cullingMode = mode;
+}
+
+CullingMode Renderer::getCullingMode() {
+	return _cullingMode;
+}
+
+void Renderer::setThreadPool(ThreadPool *pThreadPool) {
+	_threadPool = pThreadPool;
+}
+
+void Renderer::setRenderPassConfig(RenderPassConfig config) {
+	_context->setRenderPassConfig(config);
+}
+
+void Renderer::setDynamicResolution(bool enabled) {
+	_context->setDynamicResolution(enabled);
+}
+
+bool Renderer::hasDynamicResolution() {
+	return _context->hasDynamicResolution();
+}
+
+void Renderer::setFrameBudget(float milliseconds) {
+	_dynamicResolution.setBudget(milliseconds);
+}
+
+float Renderer::getFrameBudget() {
+	return _dynamicResolution.getBudget();
+}
+
+void Renderer::setRenderScale(float scale) {
+	_dynamicResolution.setScale(scale);
+}
+
+float Renderer::getRenderScale() {
+	return _context->hasDynamicResolution() ? _dynamicResolution.getScale() : 1.0f;
+}
+
+VkExtent2D Renderer::getRenderExtent() {
+	return _renderExtent;
+}
+
+void Renderer::setUpscaleFilter(UpscaleFilter filter) {
+	_upscaleFilter = filter;
+}
+
+UpscaleFilter Renderer::getUpscaleFilter() {
+	return _upscaleFilter;
+}
+
+void Renderer::setPostProcessing(bool enabled) {
+	_context->setPostProcessing(enabled);
+}
+
+bool Renderer::hasPostProcessing() {
+	return _context->hasPostProcessing();
+}
+
+void Renderer::setPostProcessSettings(const PostProcessSettings &settings) {
+	_postProcessSettings = settings;
+}
+
+PostProcessSettings Renderer::getPostProcessSettings() {
+	return _postProcessSettings;
+}
+
+void Renderer::setAsyncCompute(bool enabled) {
+	_context->setAsyncCompute(enabled);
+}
+
+bool Renderer::hasAsyncCompute() {
+	return _context->hasAsyncCompute();
+}
+
+std::vector<std::string> Renderer::getShaderErrors() {
+#ifdef SHADER_RUNTIME_COMPILE
+	if (_shaderReloader != nullptr) {
+		return _shaderReloader->getErrors();
+	}
+#endif
+
+	return std::vector<std::string>();
+}
+
+bool Renderer::getPipelineStatistics(PipelineStatistics *pStatistics) {
+	return _gpuProfiler->getPipelineStatistics(pStatistics);
+}
+
+GpuProfiler *Renderer::getGpuProfiler() {
+	return _gpuProfiler;
+}
+
+GpuProfiler *Renderer::getPostProcessProfiler() {
+	return _postProfiler;
+}
+
+SwapchainStatistics Renderer::getSwapchainStatistics() {
+	return _context->getSwapchainStatistics();
+}
+
+FrameStatistics Renderer::getFrameStatistics() {
+	return _frameStatistics;
+}
+
+MemoryStatistics Renderer::getMemoryStatistics() {
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(_context->getPhysicalDevice(), &memoryProperties);
+
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(_allocator, budgets);
+
+	MemoryStatistics statistics{};
+
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+		statistics.allocationCount += budgets[i].statistics.allocationCount;
+		statistics.allocationBytes += budgets[i].statistics.allocationBytes;
+		statistics.blockBytes += budgets[i].statistics.blockBytes;
+	}
+
+	return statistics;
+}
+
+std::string Renderer::getDeviceName() {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(_context->getPhysicalDevice(), &properties);
+
+	return properties.deviceName;
+}
+
+AttachmentTraffic Renderer::getAttachmentTraffic() {
+	// the scene passes only cover the render extent, the upscale pass the
+	// whole swapchain. The post-processing chain's storage images aren't
+	// attachments and aren't counted.
+	std::vector<std::pair<RenderPassType, VkExtent2D>> passes;
+	bool keepColor = _scaled || _context->hasPostProcessing();
+
+	if (_cullingMode == CULLING_MODE_GPU_OCCLUSION) {
+		passes.push_back({ RENDER_PASS_TYPE_EARLY, _renderExtent });
+		passes.push_back({ keepColor ? RENDER_PASS_TYPE_LATE_SCALED : RENDER_PASS_TYPE_LATE, _renderExtent });
+	} else {
+		passes.push_back({ keepColor ? RENDER_PASS_TYPE_MAIN_SCALED : RENDER_PASS_TYPE_MAIN, _renderExtent });
+	}
+
+	if (keepColor) {
+		passes.push_back({ RENDER_PASS_TYPE_UPSCALE, _context->getSwapchainExtent() });
+	}
+
+	AttachmentTraffic traffic;
+
+	for (const std::pair<RenderPassType, VkExtent2D> &pass : passes) {
+		AttachmentTraffic passTraffic = _context->getAttachmentTraffic(pass.first, pass.second);
+
+		traffic.loads += passTraffic.loads;
+		traffic.stores += passTraffic.stores;
+		traffic.loadBytes += passTraffic.loadBytes;
+		traffic.storeBytes += passTraffic.storeBytes;
+	}
+
+	return traffic;
 }
 
 void Renderer::waitIdle() {
 	vkDeviceWaitIdle(_context->getDevice());
 }
 
-Renderer::Renderer(std::vector<const char *> extensions, bool useValidation) {
-	_context = new VulkanContext(extensions, useValidation);
+Renderer::Renderer(std::vector<const char *> extensions, bool useValidation, bool usePipelineCache) {
+	_context = new VulkanContext(extensions, useValidation, usePipelineCache);
 	_camera = new Camera();
 }
 
 Renderer::~Renderer() {
-	free(_camera);
-	free(_context);
+	// nothing was created without windowInit() or headlessInit()
+	if (_allocator != VK_NULL_HANDLE) {
+		_destroyResources();
+	}
+
+	delete _camera;
+	delete _context;
 }
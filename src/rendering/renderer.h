@@ -2,28 +2,97 @@
 #define RENDERER_H
 
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <imgui.h>
 
 #include "camera.h"
+#include "culling.h"
+#include "dynamic_resolution.h"
+#include "frustum.h"
+#include "gpu_profiler.h"
+#include "pipeline_registry.h"
 #include "types.h"
 #include "vertex.h"
 #include "vulkan_context.h"
 
+class DescriptorAllocator;
+class DescriptorCache;
+class Scene;
+class ShaderRD;
+class ShaderReloader;
+class ThreadPool;
+
 struct UniformBufferObject {
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
 };
 
-struct MeshPushConstants {
-	glm::vec4 data;
-	glm::mat4 model;
+// Initial per-frame instance buffer capacity, it grows when exceeded.
+const uint32_t INSTANCE_BUFFER_CAPACITY = 1024;
+
+// Texture table slots with descriptor indexing, lowered to the device limits.
+const uint32_t BINDLESS_TEXTURE_CAPACITY = 4096;
+// Without it every slot has to hold a valid texture, Vulkan guarantees 16
+// samplers per stage.
+const uint32_t FALLBACK_TEXTURE_CAPACITY = 16;
+
+// Bits of the #[FEATURES] section of material.glsl, each combination is a
+// shader variant.
+enum MaterialFeature {
+	MATERIAL_FEATURE_TEXTURE = 1 << 0,
+	MATERIAL_FEATURE_VERTEX_COLOR = 1 << 1,
+};
+
+// Specialization constant of material.glsl, no shader recompile needed.
+enum MaterialDebugView {
+	MATERIAL_DEBUG_VIEW_NONE,
+	MATERIAL_DEBUG_VIEW_NORMALS,
+	MATERIAL_DEBUG_VIEW_TEXCOORDS,
+	MATERIAL_DEBUG_VIEW_MAX,
+};
+
+// Specialization constant of upscale.glsl.
+enum UpscaleFilter {
+	UPSCALE_FILTER_BILINEAR,
+	// bilinear that keeps luminance edges sharp
+	UPSCALE_FILTER_EDGE_AWARE,
+	UPSCALE_FILTER_MAX,
+};
+
+// Specialization constant of tonemapping.glsl.
+enum TonemapOperator {
+	TONEMAP_OPERATOR_ACES,
+	// the compute post-processing has tonemapped already
+	TONEMAP_OPERATOR_NONE,
+};
+
+// Specialization constant of bloom.glsl.
+enum BloomMode {
+	// the first level, from the scene color above the threshold
+	BLOOM_MODE_PREFILTER,
+	BLOOM_MODE_DOWNSAMPLE,
+	// adds the blurred level below to a level
+	BLOOM_MODE_UPSAMPLE,
 };
 
 struct Mesh {
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
 
+	// MaterialFeature bits, selects the material variant
+	uint32_t materialFeatures = MATERIAL_FEATURE_TEXTURE;
+	// slot in the texture table, 0 is plain white
+	uint32_t textureIndex = 0;
+
+	AABB aabb;
+	// xyz center, w radius
+	glm::vec4 boundingSphere;
+
 	AllocatedBuffer vertexBuffer;
 	AllocatedBuffer indexBuffer;
 
@@ -34,13 +103,231 @@ struct Texture {
 	AllocatedImage image;
 	VkImageView view;
 	VkSampler sampler;
+
+	// slot in the texture table, set as Mesh::textureIndex
+	uint32_t index;
+};
+
+// Destroys something once the GPU work that used it has finished.
+struct DeferredDeletion {
+	uint64_t timelineValue;
+	// the post-processing chain runs on the compute timeline
+	uint64_t computeValue;
+	std::function<void()> function;
+};
+
+// A changed shader whose pipelines are already in the registry, swapped in
+// at a frame boundary.
+struct ShaderReload {
+	PipelineStateDesc *pState;
+	ShaderRD *pShader;
 };
 
 struct Material {
+	// the texture table, indexed per draw
 	VkDescriptorSet textureSet;
 
-	VkPipelineLayout pipelineLayout;
-	VkPipeline pipeline;
+	// variant and specialization are filled in per draw, materials with the
+	// same state share pipelines through the registry
+	PipelineStateDesc state;
+};
+
+struct MaterialPushConstants {
+	uint32_t textureIndex;
+};
+
+struct DrawCommand {
+	Mesh *pMesh;
+	uint32_t transformIndex;
+};
+
+struct DrawBatch {
+	Mesh *pMesh;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+// What the last frame recorded, counted on the CPU.
+struct FrameStatistics {
+	// summed over the geometry passes, occlusion culling draws everything twice
+	uint32_t drawCalls = 0;
+	uint32_t instances = 0;
+	// before GPU culling, the pipeline statistics count what is left of it
+	uint64_t triangles = 0;
+	// drawBegin() blocked on the frame that last used the slot
+	double waitMilliseconds = 0.0;
+};
+
+// Device memory allocated through VMA, summed over every heap.
+struct MemoryStatistics {
+	uint32_t allocationCount;
+	uint64_t allocationBytes;
+	// VkDeviceMemory blocks the allocations live in
+	uint64_t blockBytes;
+};
+
+enum CullingMode {
+	CULLING_MODE_NONE,
+	CULLING_MODE_CPU,
+	CULLING_MODE_GPU,
+	// two phase, frustum and Hi-Z occlusion on the GPU
+	CULLING_MODE_GPU_OCCLUSION,
+};
+
+struct CullPushConstants {
+	glm::vec4 planes[6];
+	uint32_t instanceCount;
+};
+
+enum OcclusionPhase {
+	OCCLUSION_PHASE_EARLY,
+	OCCLUSION_PHASE_LATE,
+};
+
+struct OcclusionCullPushConstants {
+	glm::vec4 frustum;
+	glm::vec4 projection;
+	float zNear;
+	float zFar;
+	glm::vec2 pyramidSize;
+	uint32_t instanceCount;
+	uint32_t phase;
+	uint32_t firstCommand;
+};
+
+struct UpscalePushConstants {
+	glm::vec2 renderSize;
+	glm::vec2 texelSize;
+};
+
+struct BloomPushConstants {
+	glm::vec2 inputSize;
+	glm::vec2 texelSize;
+	glm::uvec2 outputSize;
+	float threshold;
+};
+
+struct PostTonemapPushConstants {
+	glm::uvec2 size;
+	glm::vec2 bloomScale;
+	float bloomIntensity;
+};
+
+struct SharpenPushConstants {
+	glm::uvec2 size;
+	float sharpness;
+};
+
+struct DepthPyramidPushConstants {
+	uint32_t inputWidth;
+	uint32_t inputHeight;
+	uint32_t outputWidth;
+	uint32_t outputHeight;
+};
+
+// Enough levels for a 32768 texel wide pyramid.
+const uint32_t DEPTH_PYRAMID_MAX_LEVELS = 16;
+
+// Max depth reduction of the depth attachment, kept in the general layout.
+struct DepthPyramid {
+	AllocatedImage image;
+	VkImageView view = VK_NULL_HANDLE;
+	VkImageView levelViews[DEPTH_PYRAMID_MAX_LEVELS];
+	// per frame, sets of a frame in flight can't be rewritten
+	VkDescriptorSet levelSets[MAX_FRAMES_IN_FLIGHT][DEPTH_PYRAMID_MAX_LEVELS];
+	VkSampler sampler = VK_NULL_HANDLE;
+
+	// view each frame's level sets and cull set were last written with
+	VkImageView boundViews[MAX_FRAMES_IN_FLIGHT] = {};
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t levelCount = 0;
+
+	// swapchain the first level reads the depth attachment of
+	uint32_t swapchainGeneration = 0;
+};
+
+// Levels below the half size first one, the last is 1/64 of the screen.
+const uint32_t BLOOM_MAX_LEVELS = 6;
+
+// What the compute post-processing chain runs.
+struct PostProcessSettings {
+	bool bloom = true;
+	// scene color where bloom starts, with a soft knee below
+	float bloomThreshold = 1.0f;
+	float bloomIntensity = 0.5f;
+	bool sharpen = true;
+	// 0 to 1
+	float sharpness = 0.5f;
+};
+
+// Storage images and sets of the chain of one frame slot. Bloom and the
+// tonemapped color never leave the compute queue, the output is released to
+// the graphics queue for the composite.
+struct PostProcessFrame {
+	// half size, a mip per level, written and sampled in the general layout
+	AllocatedImage bloom;
+	VkImageView bloomViews[BLOOM_MAX_LEVELS];
+	VkDescriptorSet downsampleSets[BLOOM_MAX_LEVELS];
+	VkDescriptorSet upsampleSets[BLOOM_MAX_LEVELS];
+
+	// tonemapped, before sharpening
+	AllocatedImage tonemapped;
+	VkImageView tonemappedView;
+	AllocatedImage output;
+	VkImageView outputView;
+
+	// tonemapping into the tonemapped color, or into the output without sharpening
+	VkDescriptorSet tonemapSet;
+	VkDescriptorSet tonemapOutputSet;
+	VkDescriptorSet sharpenSet;
+
+	// from the compute command pool
+	VkCommandBuffer commandBuffer;
+	// compute timeline value of the last chain recorded into it
+	uint64_t timelineValue = 0;
+	// render extent the last chain ran at, the top left of every image
+	VkExtent2D extent = {};
+	// the output of the last chain was acquired by a composite, the first
+	// frame after a swapchain change shows it twice
+	bool shown = false;
+};
+
+// Compute passes over the HDR scene color of a frame slot. With async
+// compute a frame's chain runs on the compute queue while the next frame's
+// scene passes render, and the composite shows the previous frame's output.
+struct PostProcess {
+	PostProcessFrame frames[MAX_FRAMES_IN_FLIGHT];
+
+	uint32_t bloomWidth = 0;
+	uint32_t bloomHeight = 0;
+	uint32_t bloomLevels = 0;
+
+	// frame slot whose output the next frame can show, UINT32_MAX when none
+	uint32_t resultFrame = UINT32_MAX;
+
+	// swapchain the scene colors the sets read belong to
+	uint32_t swapchainGeneration = 0;
+};
+
+struct GrowableBuffer {
+	AllocatedBuffer buffer;
+	VmaAllocationInfo allocInfo;
+	VkDeviceSize size = 0;
+};
+
+struct DrawBuffers {
+	GrowableBuffer instances;
+	GrowableBuffer objects;
+	GrowableBuffer batches;
+	GrowableBuffer commands;
+	GrowableBuffer culledInstances;
+
+	// instance buffer currently written to the uniform set
+	VkBuffer boundInstances = VK_NULL_HANDLE;
+	// shared visibility buffer currently written to the cull set
+	VkBuffer boundVisibility = VK_NULL_HANDLE;
 };
 
 class Renderer {
@@ -49,25 +336,124 @@ class Renderer {
 
 	Camera *_camera;
 
-	VmaAllocator _allocator;
+	VmaAllocator _allocator = VK_NULL_HANDLE;
 
 	VkCommandBuffer _commandBuffers[MAX_FRAMES_IN_FLIGHT];
+	// post-processing, the upscale pass after the chain, submitted apart
+	// from the scene passes
+	VkCommandBuffer _compositeCommandBuffers[MAX_FRAMES_IN_FLIGHT];
 
-	VkDescriptorPool _descriptorPool;
+	// sets that live as long as the renderer
+	DescriptorAllocator *_descriptorAllocator = nullptr;
+	// sets of a single frame, reset when its frame slot comes around again
+	DescriptorCache *_frameDescriptors[MAX_FRAMES_IN_FLIGHT] = {};
+	// VK_NULL_HANDLE until initImGui()
+	VkDescriptorPool _imguiPool = VK_NULL_HANDLE;
 
 	VkDescriptorSetLayout _uniformSetLayout;
 	VkDescriptorSetLayout _subpassSetLayout;
 	VkDescriptorSetLayout _textureSetLayout;
+	DescriptorAllocator *_textureAllocator = nullptr;
+	uint32_t _textureTableSize = 0;
+	uint32_t _textureCount = 0;
+	Texture _defaultTexture = {};
 
-	AllocatedBuffer _uniformBuffers[MAX_FRAMES_IN_FLIGHT];
+	AllocatedBuffer _uniformBuffers[MAX_FRAMES_IN_FLIGHT] = {};
 	VmaAllocationInfo _uniformAllocInfos[MAX_FRAMES_IN_FLIGHT];
 	VkDescriptorSet _uniformSets[MAX_FRAMES_IN_FLIGHT];
 
+	DrawBuffers _drawBuffers[MAX_FRAMES_IN_FLIGHT];
+
+	std::vector<DrawCommand> _drawCommands;
+	std::vector<glm::mat4> _drawTransforms;
+	// transform index of each draw, in draw order
+	std::vector<uint32_t> _drawObjectIndices;
+	std::vector<DrawBatch> _drawBatches;
+
+	SphereBounds _drawBounds;
+	std::vector<uint8_t> _drawVisibility;
+
+	PipelineRegistry *_pipelineRegistry = nullptr;
+
 	Material _material;
+	MaterialDebugView _debugView = MATERIAL_DEBUG_VIEW_NONE;
 
 	VkDescriptorSet _subpassSet;
 	Material _tonemapping;
 
+	// the scene passes render into the top left of the attachments, the
+	// upscale pass samples it up to the swapchain extent
+	DynamicResolution _dynamicResolution;
+	VkExtent2D _renderExtent = {};
+	// the frame being recorded renders below the swapchain extent
+	bool _scaled = false;
+	UpscaleFilter _upscaleFilter = UPSCALE_FILTER_EDGE_AWARE;
+	VkDescriptorSetLayout _upscaleSetLayout;
+	VkDescriptorSet _upscaleSet;
+	VkSampler _upscaleSampler = VK_NULL_HANDLE;
+	PipelineStateDesc _upscaleState;
+
+	PostProcess _postProcess;
+	PostProcessSettings _postProcessSettings;
+	VkDescriptorSetLayout _bloomSetLayout;
+	VkDescriptorSetLayout _postTonemapSetLayout;
+	VkDescriptorSetLayout _sharpenSetLayout;
+	PipelineStateDesc _bloomState;
+	PipelineStateDesc _postTonemapState;
+	PipelineStateDesc _sharpenState;
+
+	CullingMode _cullingMode = CULLING_MODE_NONE;
+	Frustum _frustum;
+
+	glm::mat4 _view;
+	glm::mat4 _projection;
+
+	VkDescriptorSetLayout _cullSetLayout;
+	VkDescriptorSet _cullSets[MAX_FRAMES_IN_FLIGHT];
+	PipelineStateDesc _cullState;
+	PipelineStateDesc _occlusionCullState;
+
+	// per instance visibility from the last frame, shared by all frames
+	GrowableBuffer _visibility;
+	bool _clearVisibility = false;
+
+	DepthPyramid _depthPyramid;
+	VkDescriptorSetLayout _depthPyramidSetLayout;
+	PipelineStateDesc _depthPyramidState;
+
+	ThreadPool *_threadPool = nullptr;
+
+	// wall time of creating all pipelines, shows what the pipeline cache saves
+	double _pipelineCreationTime = 0.0;
+	uint32_t _pipelineCount = 0;
+
+	// pass timings and pipeline statistics
+	GpuProfiler *_gpuProfiler = nullptr;
+	// the post-processing effects, timestamps are per queue
+	GpuProfiler *_postProfiler = nullptr;
+
+	FrameStatistics _frameStatistics;
+
+	// graphics timeline value of the last frame submitted in each slot
+	uint64_t _frameTimelineValues[MAX_FRAMES_IN_FLIGHT] = {};
+
+	// deferred during the frame being recorded, queued with its timeline
+	// values once it is submitted
+	std::vector<std::function<void()>> _pendingDeletions;
+	// run once both timelines reach their values
+	std::deque<DeferredDeletion> _deletionQueue;
+
+	// the context's count the graphics pipelines were built for
+	uint32_t _renderPassRecreations = 0;
+
+	// guards _pendingReloads and the shaders of the pipeline states
+	std::mutex _reloadMutex;
+	std::vector<ShaderReload> _pendingReloads;
+
+#ifdef SHADER_RUNTIME_COMPILE
+	ShaderReloader *_shaderReloader = nullptr;
+#endif
+
 	typedef struct {
 		VkCommandBuffer commandBuffer;
 		uint32_t imageIndex;
@@ -75,28 +461,73 @@ class Renderer {
 
 	RenderHandle *_renderHandle = nullptr;
 
+	// false when a dev_shaders build fails to compile a shader
+	bool _initResources();
 	void _initAllocator();
 	void _initCommands();
+	void _initQueries();
+	bool _initShaders();
 	void _initDescriptors();
+	void _initTextureTable();
 	void _initPipelines();
+	// Everything the init functions created, once the device is idle.
+	void _destroyResources();
 
 	void _uploadMesh(Mesh *pMesh);
 
 	void _updateUniformBuffer(uint32_t currentFrame);
 
-	void _writeImageSet(VkDescriptorSet dstSet, VkImageView imageView, VkSampler sampler, VkDescriptorType descriptorType);
+	bool _reserveBuffer(GrowableBuffer *pBuffer, VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible);
+	void _destroyBuffer(GrowableBuffer *pBuffer);
+	void _reserveDrawBuffers(uint32_t currentFrame, uint32_t instanceCount, uint32_t batchCount);
+	void _flushDrawCommands(uint32_t currentFrame);
+	void _cullDrawCommandsCpu();
+	void _cullDrawCommandsGpu(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+	void _cullDrawCommandsOcclusion(VkCommandBuffer commandBuffer, uint32_t currentFrame, OcclusionPhase phase);
+	void _reserveVisibility(uint32_t currentFrame, uint32_t instanceCount);
+
+	void _createDepthPyramid();
+	void _destroyDepthPyramid(const DepthPyramid &pyramid);
+	void _writeDepthPyramidSets(uint32_t currentFrame);
+	void _buildDepthPyramid(VkCommandBuffer commandBuffer);
+
+	void _createPostProcess();
+	void _destroyPostProcess();
+	// Submits the chain of the current frame, returns its compute timeline value.
+	uint64_t _submitPostProcess(uint64_t sceneValue);
+
+	void _updateRenderScale(uint32_t collectedFrames);
+
+	void _beginRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, RenderPassType type);
+	void _recordDrawBatches(VkCommandBuffer commandBuffer, uint32_t firstCommand);
+	void _upscale(VkCommandBuffer commandBuffer, VkDescriptorSet set, VkExtent2D renderExtent);
+
+	void _writeImageSet(VkDescriptorSet dstSet, uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout, VkDescriptorType descriptorType, uint32_t arrayElement = 0);
+	void _writeBufferSet(VkDescriptorSet dstSet, uint32_t binding, VkBuffer buffer, VkDeviceSize range, VkDescriptorType descriptorType);
 
 	AllocatedBuffer _createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationInfo &allocInfo);
+	AllocatedBuffer _createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
 	void _copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
 	Texture _createTexture(uint32_t width, uint32_t height, VkFormat format, const std::vector<uint8_t> &data);
 	bool _generateMipmaps(int32_t width, int32_t height, VkFormat format, uint32_t mipmaps, VkImage image);
 
 	AllocatedImage _createImage(uint32_t width, uint32_t height, VkFormat format, uint32_t mipmaps, VkImageUsageFlags usage);
-	VkImageView _createImageView(VkImage image, VkFormat format, uint32_t mipmaps, VkImageAspectFlags aspectFlags);
+	VkImageView _createImageView(VkImage image, VkFormat format, uint32_t mipmaps, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel = 0);
+
+	VkPipeline _getMaterialPipeline(uint32_t features);
 
-	VkPipelineLayout _createPipelineLayout(VkDescriptorSetLayout *pSetLayouts, uint32_t layoutCount, VkPushConstantRange *pPushConstants, uint32_t constantCount);
-	VkPipeline _createPipeline(VkPipelineLayout layout, VkShaderModule vertex, VkShaderModule fragment, uint32_t subpass);
+	// prints what failed since the last call
+	void _reportPrewarmErrors();
+	// after the context recreated the render passes for a new format
+	void _rebuildGraphicsPipelines();
+	void _deferDeletion(std::function<void()> function);
+	void _retireDeletions();
+	void _applyShaderReloads();
+
+#ifdef SHADER_RUNTIME_COMPILE
+	void _watchShaders(PipelineStateDesc **ppStates, uint32_t stateCount);
+#endif
 
 	VkCommandBuffer _beginSingleTimeCommands();
 	void _endSingleTimeCommands(VkCommandBuffer commandBuffer);
@@ -105,21 +536,106 @@ public:
 	VkInstance getInstance();
 	Camera *getCamera();
 
-	void windowInit(VkSurfaceKHR surface, uint32_t width, uint32_t height);
+	// Returns false when the shaders fail to compile in dev_shaders builds,
+	// the renderer can only be deleted then.
+	bool windowInit(VkSurfaceKHR surface, uint32_t width, uint32_t height);
 	void windowResize(uint32_t width, uint32_t height);
 
+	// Renders offscreen without a window or surface, see
+	// VulkanContext::headlessCreate(). Used instead of windowInit().
+	bool headlessInit(uint32_t width, uint32_t height);
+
 	void initImGui();
 
 	Mesh meshCreate(std::vector<Vertex> vertices, std::vector<uint32_t> indices);
 	Texture textureCreate(uint32_t width, uint32_t height, VkFormat format, const std::vector<uint8_t> &data);
 
+	// Call once no frame in flight uses them, e.g. after waitIdle(). A
+	// destroyed texture's table slot isn't reused.
+	void meshDestroy(Mesh *pMesh);
+	void textureDestroy(Texture *pTexture);
+
 	void drawBegin();
 	void drawMesh(Mesh *pMesh, const glm::mat4 &transform);
+	void drawScene(Scene *pScene);
 	void drawEnd();
 
+	void setDebugView(MaterialDebugView view);
+	MaterialDebugView getDebugView();
+
+	void setCullingMode(CullingMode mode);
+	CullingMode getCullingMode();
+
+	// Used for startup work, set before windowInit() or headlessInit().
+	void setThreadPool(ThreadPool *pThreadPool);
+
+	// Set before windowInit() or headlessInit().
+	void setRenderPassConfig(RenderPassConfig config);
+
+	// Lets the scene render below the swapchain extent, at the scale set or
+	// the one that keeps the GPU inside the frame budget. Set before
+	// windowInit() or headlessInit().
+	void setDynamicResolution(bool enabled);
+	bool hasDynamicResolution();
+
+	// GPU milliseconds per frame the render scale adapts to, 0 keeps the
+	// scale fixed.
+	void setFrameBudget(float milliseconds);
+	float getFrameBudget();
+
+	// Fixed scale while there is no budget, each side of the render extent
+	// is the scale times the swapchain's.
+	void setRenderScale(float scale);
+	float getRenderScale();
+	// of the last recorded frame
+	VkExtent2D getRenderExtent();
+
+	void setUpscaleFilter(UpscaleFilter filter);
+	UpscaleFilter getUpscaleFilter();
+
+	// Tonemaps with a chain of compute passes instead of the tonemap
+	// subpass, with bloom and sharpening. Set before windowInit() or
+	// headlessInit().
+	void setPostProcessing(bool enabled);
+	bool hasPostProcessing();
+
+	void setPostProcessSettings(const PostProcessSettings &settings);
+	PostProcessSettings getPostProcessSettings();
+
+	// Runs the post-processing chain on a compute only queue family when the
+	// device has one. Set before windowInit() or headlessInit().
+	void setAsyncCompute(bool enabled);
+	// false until initialized, without post-processing and on devices
+	// without such a family
+	bool hasAsyncCompute();
+
+	// Shaders that failed to hot reload, always empty unless built with
+	// dev_shaders=1.
+	std::vector<std::string> getShaderErrors();
+
+	// Statistics of the last finished frame, false when the device can't
+	// count them.
+	bool getPipelineStatistics(PipelineStatistics *pStatistics);
+
+	// GPU time of the passes over the last frames.
+	GpuProfiler *getGpuProfiler();
+	// Of the post-processing effects, on the compute queue. Null without
+	// post-processing.
+	GpuProfiler *getPostProcessProfiler();
+
+	SwapchainStatistics getSwapchainStatistics();
+
+	FrameStatistics getFrameStatistics();
+	MemoryStatistics getMemoryStatistics();
+
+	std::string getDeviceName();
+
+	// Summed over the render passes the current culling mode begins per frame.
+	AttachmentTraffic getAttachmentTraffic();
+
 	void waitIdle();
 
-	Renderer(std::vector<const char *> extensions, bool useValidation);
+	Renderer(std::vector<const char *> extensions, bool useValidation, bool usePipelineCache = true);
 	~Renderer();
 };
 
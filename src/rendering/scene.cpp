@@ -0,0 +1,210 @@
+#include "scene.h"
+
+#include <algorithm>
+
+#include "../cpu_profiler.h"
+#include "../thread_pool.h"
+
+// nodes per task when a level is updated in parallel
+const uint32_t SCENE_UPDATE_BATCH_SIZE = 4096;
+
+void Scene::_sortNodes() {
+	uint32_t nodeCount = getNodeCount();
+	uint32_t levelCount = 0;
+
+	for (uint32_t depth : _depths) {
+		levelCount = std::max(levelCount, depth + 1);
+	}
+
+	// counting sort by depth, stable so existing order is kept within a level
+	_levelOffsets.assign(levelCount + 1, 0);
+
+	for (uint32_t depth : _depths) {
+		_levelOffsets[depth + 1]++;
+	}
+
+	for (uint32_t i = 0; i < levelCount; i++) {
+		_levelOffsets[i + 1] += _levelOffsets[i];
+	}
+
+	std::vector<uint32_t> newSlots(nodeCount);
+	std::vector<uint32_t> cursors(_levelOffsets.begin(), _levelOffsets.end() - 1);
+
+	for (uint32_t slot = 0; slot < nodeCount; slot++) {
+		newSlots[slot] = cursors[_depths[slot]]++;
+	}
+
+	std::vector<NodeId> nodes(nodeCount);
+	std::vector<uint32_t> parents(nodeCount);
+	std::vector<uint32_t> depths(nodeCount);
+	std::vector<glm::mat4> localTransforms(nodeCount);
+	std::vector<glm::mat4> worldTransforms(nodeCount);
+	std::vector<Mesh *> meshes(nodeCount);
+	std::vector<uint8_t> dirty(nodeCount);
+
+	for (uint32_t slot = 0; slot < nodeCount; slot++) {
+		uint32_t newSlot = newSlots[slot];
+		uint32_t parent = _parents[slot];
+
+		nodes[newSlot] = _nodes[slot];
+		parents[newSlot] = parent == NODE_NONE ? NODE_NONE : newSlots[parent];
+		depths[newSlot] = _depths[slot];
+		localTransforms[newSlot] = _localTransforms[slot];
+		worldTransforms[newSlot] = _worldTransforms[slot];
+		meshes[newSlot] = _meshes[slot];
+		dirty[newSlot] = _dirty[slot];
+
+		_nodeSlots[_nodes[slot]] = newSlot;
+	}
+
+	_nodes = std::move(nodes);
+	_parents = std::move(parents);
+	_depths = std::move(depths);
+	_localTransforms = std::move(localTransforms);
+	_worldTransforms = std::move(worldTransforms);
+	_meshes = std::move(meshes);
+	_dirty = std::move(dirty);
+
+	_orderDirty = false;
+}
+
+void Scene::_updateTransforms(uint32_t begin, uint32_t end) {
+	for (uint32_t slot = begin; slot < end; slot++) {
+		uint32_t parent = _parents[slot];
+
+		if (parent == NODE_NONE) {
+			if (_dirty[slot]) {
+				_worldTransforms[slot] = _localTransforms[slot];
+			}
+
+			continue;
+		}
+
+		// parents live in the previous level, which is already done
+		if (_dirty[parent]) {
+			_dirty[slot] = 1;
+		}
+
+		if (_dirty[slot]) {
+			_worldTransforms[slot] = _worldTransforms[parent] * _localTransforms[slot];
+		}
+	}
+}
+
+NodeId Scene::createNode(NodeId parent, const glm::mat4 &localTransform, Mesh *pMesh) {
+	NodeId node = static_cast<NodeId>(_nodeSlots.size());
+	uint32_t slot = static_cast<uint32_t>(_nodes.size());
+
+	uint32_t parentSlot = parent == NODE_NONE ? NODE_NONE : _nodeSlots[parent];
+	uint32_t depth = parent == NODE_NONE ? 0 : _depths[parentSlot] + 1;
+
+	_nodeSlots.push_back(slot);
+
+	_nodes.push_back(node);
+	_parents.push_back(parentSlot);
+	_depths.push_back(depth);
+	_localTransforms.push_back(localTransform);
+	_worldTransforms.push_back(localTransform);
+	_meshes.push_back(pMesh);
+	_dirty.push_back(1);
+
+	_orderDirty = true;
+	_transformsDirty = true;
+
+	return node;
+}
+
+void Scene::clear() {
+	_nodeSlots.clear();
+
+	_nodes.clear();
+	_parents.clear();
+	_depths.clear();
+	_localTransforms.clear();
+	_worldTransforms.clear();
+	_meshes.clear();
+	_dirty.clear();
+
+	_levelOffsets.clear();
+
+	_orderDirty = false;
+	_transformsDirty = false;
+}
+
+void Scene::setLocalTransform(NodeId node, const glm::mat4 &transform) {
+	uint32_t slot = _nodeSlots[node];
+
+	_localTransforms[slot] = transform;
+	_dirty[slot] = 1;
+
+	_transformsDirty = true;
+}
+
+glm::mat4 Scene::getLocalTransform(NodeId node) {
+	return _localTransforms[_nodeSlots[node]];
+}
+
+glm::mat4 Scene::getWorldTransform(NodeId node) {
+	return _worldTransforms[_nodeSlots[node]];
+}
+
+void Scene::setMesh(NodeId node, Mesh *pMesh) {
+	_meshes[_nodeSlots[node]] = pMesh;
+}
+
+Mesh *Scene::getMesh(NodeId node) {
+	return _meshes[_nodeSlots[node]];
+}
+
+NodeId Scene::getParent(NodeId node) {
+	uint32_t parent = _parents[_nodeSlots[node]];
+	return parent == NODE_NONE ? NODE_NONE : _nodes[parent];
+}
+
+uint32_t Scene::getNodeCount() {
+	return static_cast<uint32_t>(_nodes.size());
+}
+
+void Scene::update() {
+	PROFILE_ZONE("Scene::update");
+
+	if (_orderDirty) {
+		_sortNodes();
+	}
+
+	if (!_transformsDirty) {
+		return;
+	}
+
+	uint32_t levelCount = static_cast<uint32_t>(_levelOffsets.size()) - 1;
+
+	for (uint32_t level = 0; level < levelCount; level++) {
+		uint32_t begin = _levelOffsets[level];
+		uint32_t count = _levelOffsets[level + 1] - begin;
+
+		if (_threadPool == nullptr) {
+			_updateTransforms(begin, begin + count);
+			continue;
+		}
+
+		_threadPool->parallelFor(count, SCENE_UPDATE_BATCH_SIZE, [this, begin](uint32_t first, uint32_t last) {
+			PROFILE_ZONE("Scene::update batch");
+			_updateTransforms(begin + first, begin + last);
+		});
+	}
+
+	std::fill(_dirty.begin(), _dirty.end(), 0);
+	_transformsDirty = false;
+}
+
+const std::vector<glm::mat4> &Scene::getWorldTransforms() {
+	return _worldTransforms;
+}
+
+const std::vector<Mesh *> &Scene::getMeshes() {
+	return _meshes;
+}
+
+Scene::Scene(ThreadPool *pThreadPool) {
+	_threadPool = pThreadPool;
+}
@@ -0,0 +1,70 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class ThreadPool;
+struct Mesh;
+
+typedef uint32_t NodeId;
+
+const NodeId NODE_NONE = UINT32_MAX;
+
+// Node hierarchy stored as parallel arrays. Slots are sorted by depth, so
+// parents always come before their children and every level is a
+// contiguous range whose nodes can be updated independently.
+class Scene {
+private:
+	ThreadPool *_threadPool = nullptr;
+
+	// indexed by node id
+	std::vector<uint32_t> _nodeSlots;
+
+	// indexed by slot
+	std::vector<NodeId> _nodes;
+	std::vector<uint32_t> _parents;
+	std::vector<uint32_t> _depths;
+	std::vector<glm::mat4> _localTransforms;
+	std::vector<glm::mat4> _worldTransforms;
+	std::vector<Mesh *> _meshes;
+	std::vector<uint8_t> _dirty;
+
+	// level d spans slots [_levelOffsets[d], _levelOffsets[d + 1])
+	std::vector<uint32_t> _levelOffsets;
+
+	bool _orderDirty = false;
+	bool _transformsDirty = false;
+
+	void _sortNodes();
+	void _updateTransforms(uint32_t begin, uint32_t end);
+
+public:
+	NodeId createNode(NodeId parent, const glm::mat4 &localTransform, Mesh *pMesh = nullptr);
+	void clear();
+
+	void setLocalTransform(NodeId node, const glm::mat4 &transform);
+	glm::mat4 getLocalTransform(NodeId node);
+
+	// valid after update()
+	glm::mat4 getWorldTransform(NodeId node);
+
+	void setMesh(NodeId node, Mesh *pMesh);
+	Mesh *getMesh(NodeId node);
+
+	NodeId getParent(NodeId node);
+	uint32_t getNodeCount();
+
+	// Recomputes world transforms of dirty nodes and their subtrees.
+	void update();
+
+	// indexed by slot, not by node id
+	const std::vector<glm::mat4> &getWorldTransforms();
+	const std::vector<Mesh *> &getMeshes();
+
+	Scene(ThreadPool *pThreadPool = nullptr);
+};
+
+#endif // !SCENE_H
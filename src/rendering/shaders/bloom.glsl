@@ -0,0 +1,107 @@
+#[COMPUTE]
+
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// BloomMode, a specialization constant so each pass is a pipeline of its own
+layout(constant_id = 0) const uint MODE = 0;
+
+const uint MODE_PREFILTER = 0;
+const uint MODE_DOWNSAMPLE = 1;
+const uint MODE_UPSAMPLE = 2;
+
+// the soft knee below the threshold, as a fraction of it
+const float KNEE = 0.5;
+
+// the scene color or the level above when downsampling, the level below
+// when upsampling
+layout(set = 0, binding = 0) uniform sampler2D inputColor;
+// read too when upsampling, the blurred level below is added to it
+layout(set = 0, binding = 1, rgba16f) uniform image2D outputColor;
+
+layout(push_constant) uniform PushConstants {
+	// rendered part of the input in texels
+	vec2 inputSize;
+	// one over the size of the input image
+	vec2 texelSize;
+	uvec2 outputSize;
+	float threshold;
+} constants;
+
+float luminance(vec3 color) {
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Bilinear tap, kept inside the rendered part of the input.
+vec3 tap(vec2 position) {
+	position = clamp(position, vec2(0.5), constants.inputSize - 0.5);
+	return textureLod(inputColor, position * constants.texelSize, 0.0).rgb;
+}
+
+vec3 prefilter(vec3 color) {
+	float brightness = max(color.r, max(color.g, color.b));
+	float knee = constants.threshold * KNEE;
+
+	float soft = clamp(brightness - constants.threshold + knee, 0.0, 2.0 * knee);
+	soft = soft * soft / (4.0 * knee + 1e-4);
+
+	return color * max(soft, brightness - constants.threshold) / max(brightness, 1e-4);
+}
+
+// Four bilinear taps averaging a 4x4 footprint.
+vec3 downsample(vec2 center) {
+	vec3 colors[4];
+	colors[0] = tap(center + vec2(-1.0, -1.0));
+	colors[1] = tap(center + vec2(1.0, -1.0));
+	colors[2] = tap(center + vec2(-1.0, 1.0));
+	colors[3] = tap(center + vec2(1.0, 1.0));
+
+	if (MODE != MODE_PREFILTER) {
+		return (colors[0] + colors[1] + colors[2] + colors[3]) * 0.25;
+	}
+
+	// weighted by inverse luminance so a single bright texel doesn't flicker
+	vec3 color = vec3(0.0);
+	float total = 0.0;
+
+	for (uint i = 0; i < 4; i++) {
+		float weight = 1.0 / (1.0 + luminance(colors[i]));
+		color += colors[i] * weight;
+		total += weight;
+	}
+
+	return prefilter(color / total);
+}
+
+// 3x3 tent of bilinear taps, one input texel apart.
+vec3 upsample(vec2 center) {
+	vec3 color = tap(center) * 4.0;
+
+	color += (tap(center + vec2(-1.0, 0.0)) + tap(center + vec2(1.0, 0.0)) +
+			tap(center + vec2(0.0, -1.0)) + tap(center + vec2(0.0, 1.0))) * 2.0;
+
+	color += tap(center + vec2(-1.0, -1.0)) + tap(center + vec2(1.0, -1.0)) +
+			tap(center + vec2(-1.0, 1.0)) + tap(center + vec2(1.0, 1.0));
+
+	return color / 16.0;
+}
+
+void main() {
+	uvec2 position = gl_GlobalInvocationID.xy;
+
+	if (any(greaterThanEqual(position, constants.outputSize))) {
+		return;
+	}
+
+	// the output texel's center in input texels
+	vec2 center = (vec2(position) + 0.5) * constants.inputSize / vec2(constants.outputSize);
+
+	if (MODE == MODE_UPSAMPLE) {
+		vec3 color = imageLoad(outputColor, ivec2(position)).rgb + upsample(center);
+		imageStore(outputColor, ivec2(position), vec4(color, 1.0));
+		return;
+	}
+
+	imageStore(outputColor, ivec2(position), vec4(downsample(center), 1.0));
+}
@@ -0,0 +1,71 @@
+#[COMPUTE]
+
+#version 450
+
+layout(local_size_x = 64) in;
+
+// ObjectData in object_transforms.h
+struct ObjectData {
+	mat4 model;
+	mat4 modelView;
+	mat3 normal;
+};
+
+struct DrawCommand {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer InstanceBuffer {
+	ObjectData objects[];
+} instances;
+
+layout(std430, set = 0, binding = 1) readonly buffer ObjectBuffer {
+	uint batches[];
+} objects;
+
+layout(std430, set = 0, binding = 2) readonly buffer BatchBuffer {
+	vec4 spheres[];
+} batches;
+
+layout(std430, set = 0, binding = 3) buffer DrawBuffer {
+	DrawCommand commands[];
+} draws;
+
+layout(std430, set = 0, binding = 4) writeonly buffer CulledBuffer {
+	ObjectData objects[];
+} culled;
+
+layout(push_constant) uniform PushConstants {
+	vec4 planes[6];
+	uint instanceCount;
+} constants;
+
+void main() {
+	uint index = gl_GlobalInvocationID.x;
+
+	if (index >= constants.instanceCount) {
+		return;
+	}
+
+	ObjectData object = instances.objects[index];
+	mat4 model = object.model;
+	uint batch = objects.batches[index];
+	vec4 sphere = batches.spheres[batch];
+
+	vec3 center = vec3(model * vec4(sphere.xyz, 1.0));
+	float scale = max(max(length(model[0].xyz), length(model[1].xyz)), length(model[2].xyz));
+	float radius = sphere.w * scale;
+
+	for (int i = 0; i < 6; i++) {
+		if (dot(constants.planes[i].xyz, center) + constants.planes[i].w < -radius) {
+			return;
+		}
+	}
+
+	uint slot = atomicAdd(draws.commands[batch].instanceCount, 1);
+	culled.objects[draws.commands[batch].firstInstance + slot] = object;
+}
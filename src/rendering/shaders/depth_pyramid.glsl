@@ -0,0 +1,36 @@
+#[COMPUTE]
+
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D inputDepth;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D outputDepth;
+
+layout(push_constant) uniform PushConstants {
+	uvec2 inputSize;
+	uvec2 outputSize;
+} constants;
+
+void main() {
+	uvec2 position = gl_GlobalInvocationID.xy;
+
+	if (any(greaterThanEqual(position, constants.outputSize))) {
+		return;
+	}
+
+	// every input texel touched by this output texel, the first level
+	// is a power of two smaller than the depth buffer and covers up to 3x3
+	uvec2 begin = (position * constants.inputSize) / constants.outputSize;
+	uvec2 end = ((position + 1) * constants.inputSize + constants.outputSize - 1) / constants.outputSize;
+
+	float depth = 0.0;
+
+	for (uint y = begin.y; y < end.y; y++) {
+		for (uint x = begin.x; x < end.x; x++) {
+			depth = max(depth, texelFetch(inputDepth, ivec2(x, y), 0).r);
+		}
+	}
+
+	imageStore(outputDepth, ivec2(position), vec4(depth));
+}
@@ -0,0 +1,125 @@
+#include "glsl_compiler.h"
+
+#include <mutex>
+
+#include <SPIRV/GlslangToSpv.h>
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/Public/ShaderLang.h>
+
+const glslang::EShTargetClientVersion TARGET_API_VERSION = glslang::EShTargetVulkan_1_0;
+const glslang::EShTargetLanguageVersion TARGET_SPIRV_VERSION = glslang::EShTargetSpv_1_0;
+
+const int DEFAULT_VERSION = 450;
+const bool FORWARD_COMPATIBLE = false;
+const EShMessages MESSAGE_FLAGS = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
+const EProfile DEFAULT_PROFILE = ENoProfile;
+
+static bool getLanguage(ShaderStage stage, EShLanguage *pLanguage) {
+	switch (stage) {
+		case SHADER_STAGE_VERTEX:
+			*pLanguage = EShLangVertex;
+			return true;
+		case SHADER_STAGE_FRAGMENT:
+			*pLanguage = EShLangFragment;
+			return true;
+		case SHADER_STAGE_COMPUTE:
+			*pLanguage = EShLangCompute;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void setEnvironment(glslang::TShader *pShader) {
+	pShader->setEnvClient(glslang::EShClientVulkan, TARGET_API_VERSION);
+	pShader->setEnvTarget(glslang::EshTargetSpv, TARGET_SPIRV_VERSION);
+	pShader->setEntryPoint("main");
+}
+
+static std::once_flag initializeFlag;
+
+void GlslCompiler::initialize() {
+	std::call_once(initializeFlag, [] { glslang::InitializeProcess(); });
+}
+
+void GlslCompiler::finalize() {
+	glslang::FinalizeProcess();
+}
+
+std::string GlslCompiler::getTargetDescription() {
+	glslang::Version version = glslang::GetVersion();
+
+	return "glslang " + std::to_string(version.major) + "." + std::to_string(version.minor) + "." + std::to_string(version.patch) + version.flavor +
+			", client " + std::to_string(TARGET_API_VERSION) + ", spirv " + std::to_string(TARGET_SPIRV_VERSION);
+}
+
+bool GlslCompiler::preprocess(const char *glslCode, ShaderStage stage, const std::string &preamble, std::string *pPreprocessed, std::string *pLog) {
+	EShLanguage glslStage;
+
+	if (!getLanguage(stage, &glslStage)) {
+		*pLog = "invalid shader stage";
+		return false;
+	}
+
+	glslang::TShader glslShader(glslStage);
+	glslShader.setStrings(&glslCode, 1);
+	glslShader.setPreamble(preamble.c_str());
+	setEnvironment(&glslShader);
+
+	glslang::TShader::ForbidIncluder includer;
+
+	if (!glslShader.preprocess(GetDefaultResources(), DEFAULT_VERSION, DEFAULT_PROFILE, false, FORWARD_COMPATIBLE, MESSAGE_FLAGS, pPreprocessed, includer)) {
+		*pLog = "failed to preprocess GLSL shader!\n" + std::string(glslShader.getInfoLog());
+		return false;
+	}
+
+	return true;
+}
+
+bool GlslCompiler::compile(const char *glslCode, ShaderStage stage, const std::string &preamble, std::vector<uint32_t> *pSpirv, std::string *pLog) {
+	std::string preprocessedStr;
+
+	if (!preprocess(glslCode, stage, preamble, &preprocessedStr, pLog)) {
+		return false;
+	}
+
+	return compilePreprocessed(preprocessedStr, stage, pSpirv, pLog);
+}
+
+bool GlslCompiler::compilePreprocessed(const std::string &preprocessedCode, ShaderStage stage, std::vector<uint32_t> *pSpirv, std::string *pLog) {
+	EShLanguage glslStage;
+
+	if (!getLanguage(stage, &glslStage)) {
+		*pLog = "invalid shader stage";
+		return false;
+	}
+
+	glslang::TShader glslShader(glslStage);
+	setEnvironment(&glslShader);
+
+	const char *preprocessedSources[1] = { preprocessedCode.c_str() };
+	glslShader.setStrings(preprocessedSources, 1);
+
+	glslang::TShader::ForbidIncluder includer;
+
+	if (!glslShader.parse(GetDefaultResources(), DEFAULT_VERSION, DEFAULT_PROFILE, false, FORWARD_COMPATIBLE, MESSAGE_FLAGS, includer)) {
+		*pLog = "failed to parse GLSL shader!\n" + std::string(glslShader.getInfoLog());
+		return false;
+	}
+
+	glslang::TProgram program;
+	program.addShader(&glslShader);
+	if (!program.link(MESSAGE_FLAGS)) {
+		*pLog = "failed to link shader!\n" + std::string(program.getInfoLog());
+		return false;
+	}
+
+	glslang::TIntermediate &intermediateRef = *(program.getIntermediate(glslStage));
+	glslang::SpvOptions options{};
+	options.validate = true;
+
+	pSpirv->clear();
+	glslang::GlslangToSpv(intermediateRef, *pSpirv, &options);
+
+	return true;
+}
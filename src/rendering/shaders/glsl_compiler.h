@@ -0,0 +1,37 @@
+#ifndef GLSL_COMPILER_H
+#define GLSL_COMPILER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum ShaderStage {
+	SHADER_STAGE_VERTEX,
+	SHADER_STAGE_FRAGMENT,
+	SHADER_STAGE_COMPUTE,
+	SHADER_STAGE_MAX,
+};
+
+// glslang front end, shared by the build time shader compiler and the
+// runtime compilation of the shader development mode. Targets Vulkan 1.0
+// and SPIR-V 1.0.
+class GlslCompiler {
+public:
+	// Once per process before the first compile, later calls do nothing.
+	// Compiling from several threads is fine afterwards.
+	static void initialize();
+
+	// After the last compile, only for short lived tools.
+	static void finalize();
+
+	// glslang version and target environment, part of every cache key
+	static std::string getTargetDescription();
+
+	// The preamble is inserted after #version, used for variant defines.
+	static bool preprocess(const char *glslCode, ShaderStage stage, const std::string &preamble, std::string *pPreprocessed, std::string *pLog);
+
+	static bool compile(const char *glslCode, ShaderStage stage, const std::string &preamble, std::vector<uint32_t> *pSpirv, std::string *pLog);
+	static bool compilePreprocessed(const std::string &preprocessedCode, ShaderStage stage, std::vector<uint32_t> *pSpirv, std::string *pLog);
+};
+
+#endif // !GLSL_COMPILER_H
@@ -1,3 +1,8 @@
+#[FEATURES]
+
+TEXTURE
+VERTEX_COLOR
+
 #[VERTEX]
 
 #version 450
@@ -7,10 +12,16 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
 	mat4 proj;
 } ubo;
 
-layout(push_constant) uniform PushConstants {
-	vec4 data;
+// ObjectData in object_transforms.h, computed once per object on the CPU
+struct ObjectData {
 	mat4 model;
-} constants;
+	mat4 modelView;
+	mat3 normal;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer InstanceBuffer {
+	ObjectData objects[];
+} instances;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
@@ -23,22 +34,30 @@ layout(location = 2) out vec3 fragColor;
 layout(location = 3) out vec2 fragTexCoord;
 
 void main() {
-	mat4 model = constants.model;
-	mat4 view = ubo.view;
-	mat4 proj = ubo.proj;
+	vec4 position = instances.objects[gl_InstanceIndex].modelView * vec4(inPosition, 1.0);
 
-	fragPosition = vec3(view * model * vec4(inPosition, 1.0));
-	fragNormal = normalize(mat3(transpose(inverse(view * model))) * inNormal); 
+	fragPosition = position.xyz;
+	fragNormal = normalize(instances.objects[gl_InstanceIndex].normal * inNormal);
 	fragColor = inColor;
 	fragTexCoord = inTexCoord;
-	gl_Position = proj * view * model * vec4(inPosition, 1.0f);
+	gl_Position = ubo.proj * position;
 }
 
 #[FRAGMENT]
 
 #version 450
 
-layout(set = 1, binding = 0) uniform sampler2D texSampler;
+// MaterialDebugView, a specialization constant so switching needs no recompile
+layout(constant_id = 0) const uint DEBUG_VIEW = 0;
+
+// size of the texture table, depends on descriptor indexing support
+layout(constant_id = 1) const uint TEXTURE_COUNT = 16;
+
+layout(set = 1, binding = 0) uniform sampler2D textures[TEXTURE_COUNT];
+
+layout(push_constant) uniform PushConstants {
+	uint textureIndex;
+} constants;
 
 layout(location = 0) in vec3 fragPosition;
 layout(location = 1) in vec3 fragNormal;
@@ -48,5 +67,21 @@ layout(location = 3) in vec2 fragTexCoord;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-	outColor = texture(texSampler, fragTexCoord);
+	vec4 color = vec4(1.0);
+
+#ifdef FEATURE_TEXTURE
+	color *= texture(textures[constants.textureIndex], fragTexCoord);
+#endif
+
+#ifdef FEATURE_VERTEX_COLOR
+	color.rgb *= fragColor;
+#endif
+
+	if (DEBUG_VIEW == 1) {
+		color = vec4(normalize(fragNormal) * 0.5 + 0.5, 1.0);
+	} else if (DEBUG_VIEW == 2) {
+		color = vec4(fragTexCoord, 0.0, 1.0);
+	}
+
+	outColor = color;
 }
@@ -0,0 +1,165 @@
+#[COMPUTE]
+
+#version 450
+
+#define PHASE_EARLY 0
+#define PHASE_LATE 1
+
+layout(local_size_x = 64) in;
+
+// ObjectData in object_transforms.h
+struct ObjectData {
+	mat4 model;
+	mat4 modelView;
+	mat3 normal;
+};
+
+struct DrawCommand {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer InstanceBuffer {
+	ObjectData objects[];
+} instances;
+
+layout(std430, set = 0, binding = 1) readonly buffer ObjectBuffer {
+	uint batches[];
+} objects;
+
+layout(std430, set = 0, binding = 2) readonly buffer BatchBuffer {
+	vec4 spheres[];
+} batches;
+
+layout(std430, set = 0, binding = 3) buffer DrawBuffer {
+	DrawCommand commands[];
+} draws;
+
+layout(std430, set = 0, binding = 4) writeonly buffer CulledBuffer {
+	ObjectData objects[];
+} culled;
+
+layout(std430, set = 0, binding = 5) buffer VisibilityBuffer {
+	uint visible[];
+} visibility;
+
+layout(set = 0, binding = 6) uniform sampler2D depthPyramid;
+
+layout(push_constant) uniform PushConstants {
+	// normalized side planes in view space, (x, z) and (y, z)
+	vec4 frustum;
+	// P[0][0], P[1][1], P[2][2], P[3][2]
+	vec4 projection;
+	float zNear;
+	float zFar;
+	vec2 pyramidSize;
+	uint instanceCount;
+	uint phase;
+	uint firstCommand;
+} constants;
+
+// 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere, Mara and McGuire 2013
+bool projectSphere(vec3 center, float radius, out vec4 rect) {
+	float depth = -center.z;
+
+	if (depth - radius < constants.zNear) {
+		return false;
+	}
+
+	vec2 cx = vec2(center.x, depth);
+	vec2 vx = vec2(sqrt(dot(cx, cx) - radius * radius), radius);
+	vec2 minX = mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+	vec2 maxX = mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+	vec2 cy = vec2(center.y, depth);
+	vec2 vy = vec2(sqrt(dot(cy, cy) - radius * radius), radius);
+	vec2 minY = mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+	vec2 maxY = mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+	vec2 x = vec2(minX.x / minX.y, maxX.x / maxX.y) * constants.projection.x;
+	vec2 y = vec2(minY.x / minY.y, maxY.x / maxY.y) * constants.projection.y;
+
+	rect = vec4(min(x.x, x.y), min(y.x, y.y), max(x.x, x.y), max(y.x, y.y)) * 0.5 + 0.5;
+	return true;
+}
+
+bool isOccluded(vec3 center, float radius) {
+	vec4 rect;
+
+	// spheres crossing the near plane are always drawn
+	if (!projectSphere(center, radius, rect)) {
+		return false;
+	}
+
+	rect = clamp(rect, 0.0, 1.0);
+
+	// pick the level where the rectangle covers at most 2x2 texels
+	vec2 size = (rect.zw - rect.xy) * constants.pyramidSize;
+	int level = int(ceil(log2(max(max(size.x, size.y), 1.0))));
+	level = min(level, textureQueryLevels(depthPyramid) - 1);
+
+	ivec2 levelSize = textureSize(depthPyramid, level);
+	ivec2 begin = min(ivec2(rect.xy * vec2(levelSize)), levelSize - 1);
+	ivec2 end = min(ivec2(rect.zw * vec2(levelSize)), levelSize - 1);
+
+	float occluderDepth = 0.0;
+
+	for (int y = begin.y; y <= end.y; y++) {
+		for (int x = begin.x; x <= end.x; x++) {
+			occluderDepth = max(occluderDepth, texelFetch(depthPyramid, ivec2(x, y), level).r);
+		}
+	}
+
+	// depth of the sphere's closest point
+	float closest = -center.z - radius;
+	float sphereDepth = (constants.projection.w - constants.projection.z * closest) / closest;
+
+	return sphereDepth > occluderDepth;
+}
+
+void main() {
+	uint index = gl_GlobalInvocationID.x;
+
+	if (index >= constants.instanceCount) {
+		return;
+	}
+
+	ObjectData object = instances.objects[index];
+	mat4 model = object.model;
+	uint batch = objects.batches[index];
+	vec4 sphere = batches.spheres[batch];
+
+	vec3 center = vec3(object.modelView * vec4(sphere.xyz, 1.0));
+	float scale = max(max(length(model[0].xyz), length(model[1].xyz)), length(model[2].xyz));
+	float radius = sphere.w * scale;
+
+	// camera looks down -z
+	float depth = -center.z;
+
+	bool visible = depth * constants.frustum.x - abs(center.x) * constants.frustum.y > -radius;
+	visible = visible && depth * constants.frustum.z - abs(center.y) * constants.frustum.w > -radius;
+	visible = visible && depth + radius > constants.zNear && depth - radius < constants.zFar;
+
+	if (constants.phase == PHASE_EARLY) {
+		// draw what was visible last frame, the pyramid is built from it
+		visible = visible && visibility.visible[index] != 0;
+	} else {
+		visible = visible && !isOccluded(center, radius);
+
+		bool drawnEarly = visibility.visible[index] != 0;
+		visibility.visible[index] = visible ? 1 : 0;
+
+		visible = visible && !drawnEarly;
+	}
+
+	if (!visible) {
+		return;
+	}
+
+	uint command = constants.firstCommand + batch;
+	uint slot = atomicAdd(draws.commands[command].instanceCount, 1);
+	culled.objects[draws.commands[command].firstInstance + slot] = object;
+}
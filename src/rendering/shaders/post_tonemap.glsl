@@ -0,0 +1,56 @@
+#[COMPUTE]
+
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+// the first bloom level, half the size of the scene
+layout(set = 0, binding = 1) uniform sampler2D bloomColor;
+layout(set = 0, binding = 2, rgba16f) uniform writeonly image2D outputColor;
+
+layout(push_constant) uniform PushConstants {
+	// the render extent, the scene was rendered into the top left
+	uvec2 size;
+	// from output texels to the uv of the rendered part of the bloom
+	vec2 bloomScale;
+	// 0 when bloom is off, the bloom image isn't written then
+	float bloomIntensity;
+} constants;
+
+// the same curve as tonemapping.glsl
+vec3 aces(vec3 color) {
+	mat3 m1 = mat3(
+		0.59719, 0.07600, 0.02840,
+		0.35458, 0.90834, 0.13383,
+		0.04823, 0.01566, 0.83777
+	);
+
+	mat3 m2 = mat3(
+		1.60475, -0.10208, -0.00327,
+		-0.53108,  1.10813, -0.07276,
+		-0.07367, -0.00605,  1.07602
+	);
+
+	vec3 v = m1 * color;
+	vec3 a = v * (v + 0.0245786) - 0.000090537;
+	vec3 b = v * (0.983729 * v + 0.4329510) + 0.238081;
+	return clamp(m2 * (a / b), vec3(0.0), vec3(1.0));
+}
+
+void main() {
+	uvec2 position = gl_GlobalInvocationID.xy;
+
+	if (any(greaterThanEqual(position, constants.size))) {
+		return;
+	}
+
+	vec3 color = texelFetch(sceneColor, ivec2(position), 0).rgb;
+
+	if (constants.bloomIntensity > 0.0) {
+		vec2 uv = (vec2(position) + 0.5) * constants.bloomScale;
+		color += textureLod(bloomColor, uv, 0.0).rgb * constants.bloomIntensity;
+	}
+
+	imageStore(outputColor, ivec2(position), vec4(aces(color), 1.0));
+}
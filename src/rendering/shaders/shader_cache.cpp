@@ -0,0 +1,137 @@
+#include "shader_cache.h"
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <thread>
+
+#include "../types.h"
+
+const char *SHADER_CACHE_DIRECTORY = "shader_cache";
+const uint32_t SPIRV_MAGIC = 0x07230203;
+
+static std::atomic<uint32_t> cacheHits = 0;
+static std::atomic<uint32_t> cacheMisses = 0;
+static std::atomic<uint32_t> cacheWrites = 0;
+static std::atomic<uint32_t> cacheFailedWrites = 0;
+static std::atomic<uint64_t> cacheBytesLoaded = 0;
+
+static std::string getEntryPath(uint64_t key) {
+	char fileName[32];
+	snprintf(fileName, sizeof(fileName), "%016" PRIx64 ".spv", key);
+
+	return std::string(SHADER_CACHE_DIRECTORY) + "/" + fileName;
+}
+
+uint64_t ShaderCache::computeKey(const std::string &preprocessedCode, ShaderStage stage, const std::string &target) {
+	uint32_t stageValue = stage;
+
+	// sizes keep the fields from running into each other
+	uint64_t sizes[] = { target.size(), preprocessedCode.size() };
+
+	uint64_t hash = hashBytes(sizes, sizeof(sizes));
+	hash = hashBytes(target.data(), target.size(), hash);
+	hash = hashBytes(&stageValue, sizeof(stageValue), hash);
+	hash = hashBytes(preprocessedCode.data(), preprocessedCode.size(), hash);
+
+	return hash;
+}
+
+bool ShaderCache::load(uint64_t key, std::vector<uint32_t> *pSpirv) {
+	std::ifstream file(getEntryPath(key), std::ios::binary);
+
+	if (!file.is_open()) {
+		cacheMisses++;
+		return false;
+	}
+
+	std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	// truncated or foreign files count as a miss and get overwritten
+	if (data.size() < sizeof(uint32_t) || data.size() % sizeof(uint32_t) != 0) {
+		cacheMisses++;
+		return false;
+	}
+
+	pSpirv->resize(data.size() / sizeof(uint32_t));
+	memcpy(pSpirv->data(), data.data(), data.size());
+
+	if ((*pSpirv)[0] != SPIRV_MAGIC) {
+		pSpirv->clear();
+		cacheMisses++;
+		return false;
+	}
+
+	cacheHits++;
+	cacheBytesLoaded += data.size();
+
+	return true;
+}
+
+void ShaderCache::store(uint64_t key, const std::vector<uint32_t> &spirv) {
+	std::error_code error;
+	std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+
+	std::string path = getEntryPath(key);
+
+	// unique per thread, two threads may store the same entry
+	std::string temporaryPath = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char *>(spirv.data()), spirv.size() * sizeof(uint32_t));
+
+		if (!file.good()) {
+			cacheFailedWrites++;
+			return;
+		}
+	}
+
+	std::filesystem::rename(temporaryPath, path, error);
+
+	if (error) {
+		std::filesystem::remove(temporaryPath, error);
+		cacheFailedWrites++;
+		return;
+	}
+
+	cacheWrites++;
+}
+
+uint32_t ShaderCache::clear() {
+	std::error_code error;
+	uint32_t count = 0;
+
+	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(SHADER_CACHE_DIRECTORY, error)) {
+		if (entry.path().extension() == ".spv") {
+			count++;
+		}
+	}
+
+	std::filesystem::remove_all(SHADER_CACHE_DIRECTORY, error);
+
+	return count;
+}
+
+ShaderCacheStatistics ShaderCache::getStatistics() {
+	ShaderCacheStatistics statistics;
+	statistics.hits = cacheHits;
+	statistics.misses = cacheMisses;
+	statistics.writes = cacheWrites;
+	statistics.failedWrites = cacheFailedWrites;
+	statistics.bytesLoaded = cacheBytesLoaded;
+
+	return statistics;
+}
+
+void ShaderCache::printStatistics() {
+	ShaderCacheStatistics statistics = getStatistics();
+
+	printf("Shader cache: %u hits, %u misses, %u writes, %u failed writes, %" PRIu64 " bytes loaded\n",
+			statistics.hits, statistics.misses, statistics.writes, statistics.failedWrites, statistics.bytesLoaded);
+}
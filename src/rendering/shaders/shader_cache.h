@@ -0,0 +1,36 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glsl_compiler.h"
+
+struct ShaderCacheStatistics {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t writes;
+	uint32_t failedWrites;
+	uint64_t bytesLoaded;
+};
+
+// On disk SPIR-V cache for runtime shader compilation. Entries are keyed by
+// a hash of the preprocessed source, the stage and the compiler target, so
+// an edited shader or a glslang update simply misses. Safe to use from
+// several threads.
+class ShaderCache {
+public:
+	static uint64_t computeKey(const std::string &preprocessedCode, ShaderStage stage, const std::string &target);
+
+	static bool load(uint64_t key, std::vector<uint32_t> *pSpirv);
+	static void store(uint64_t key, const std::vector<uint32_t> &spirv);
+
+	// Removes every entry, returns how many there were.
+	static uint32_t clear();
+
+	static ShaderCacheStatistics getStatistics();
+	static void printStatistics();
+};
+
+#endif // !SHADER_CACHE_H
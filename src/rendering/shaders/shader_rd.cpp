@@ -1,109 +1,386 @@
 #include "shader_rd.h"
 
-#include <SPIRV/GlslangToSpv.h>
-#include <glslang/Public/ResourceLimits.h>
-#include <glslang/Public/ShaderLang.h>
-
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <stdexcept>
 
-void ShaderRD::setup(const char *vertexCode, const char *fragmentCode, const char *computeCode, const char *name) {
+#ifdef SHADER_RUNTIME_COMPILE
+#include <filesystem>
+#include <fstream>
+#endif
+
+#include "../../cpu_profiler.h"
+#include "../../thread_pool.h"
+#include "shader_cache.h"
+
+void ShaderRD::setupSpirv(const ShaderSpirvVariant *pVariants, const char **ppFeatures, uint32_t featureCount, const char *name) {
+	this->name = name;
+	this->features = ppFeatures;
+	this->featureCount = featureCount;
+
+	spirvVariants = pVariants;
+
+	// mutexes can't be moved, so the vector is never resized in place
+	variants = std::vector<Variant>(1u << featureCount);
+}
+
+#ifdef SHADER_RUNTIME_COMPILE
+void ShaderRD::setup(const char *vertexCode, const char *fragmentCode, const char *computeCode, const char **ppFeatures, uint32_t featureCount, const char *name, const char *path) {
+	this->name = name;
+	this->path = path;
+	this->features = ppFeatures;
+	this->featureCount = featureCount;
+
 	const char *stage[] = { vertexCode, fragmentCode, computeCode };
 
-	for (int i = 0; i < STAGE_TYPE_MAX; i++) {
-		spirv[i] = processShader(stage[i], StageType(i));
+	for (int i = 0; i < SHADER_STAGE_MAX; i++) {
+		glslCode[i] = stage[i];
 	}
+
+	variants = std::vector<Variant>(1u << featureCount);
 }
 
-std::vector<uint32_t> ShaderRD::processShader(const char *glslCode, StageType stage) {
+std::vector<uint32_t> ShaderRD::processShader(const char *glslCode, ShaderStage stage, const std::string &preamble) {
 	if (glslCode == nullptr) {
 		return std::vector<uint32_t>();
 	}
 
-	glslang::InitializeProcess();
+	GlslCompiler::initialize();
+
+	std::vector<uint32_t> spirv;
+	std::string preprocessed;
+	std::string log;
+
+	// the key covers includes and defines, so only preprocessing runs on a hit
+	bool compiled = GlslCompiler::preprocess(glslCode, stage, preamble, &preprocessed, &log);
+
+	if (compiled) {
+		uint64_t key = ShaderCache::computeKey(preprocessed, stage, GlslCompiler::getTargetDescription());
 
-	EShLanguage glslStage;
-	bool validStage = false;
+		if (!ShaderCache::load(key, &spirv)) {
+			compiled = GlslCompiler::compilePreprocessed(preprocessed, stage, &spirv, &log);
 
-	switch (stage) {
-		case STAGE_TYPE_VERTEX:
-			glslStage = EShLangVertex;
-			validStage = true;
-			break;
-		case STAGE_TYPE_FRAGMENT:
-			glslStage = EShLangFragment;
-			validStage = true;
-			break;
-		case STAGE_TYPE_COMPUTE:
-			glslStage = EShLangCompute;
-			validStage = true;
-			break;
-		default:
-			break;
+			if (compiled) {
+				ShaderCache::store(key, spirv);
+			}
+		}
 	}
 
-	if (!validStage) {
-		return std::vector<uint32_t>();
+	if (!compiled) {
+		std::cout << name << ": " << log << "\n";
+		throw std::runtime_error(std::string(name) + ": " + log);
 	}
 
-	glslang::TShader glslShader(glslStage);
-	glslShader.setStrings(&glslCode, 1);
+	return spirv;
+}
+
+namespace {
+
+const int SECTION_NONE = -1;
+const int SECTION_FEATURES = -2;
+
+struct ParseState {
+	int reading = SECTION_NONE;
+	std::string code[SHADER_STAGE_MAX];
+	std::vector<std::string> stageIncludes[SHADER_STAGE_MAX];
+	std::vector<std::string> features;
+	std::vector<std::string> includedFiles;
+};
+
+// mirrors include_file_in_header() in shader_gen.py
+bool parseShaderFile(const std::string &path, ParseState *pState, std::string *pError) {
+	std::ifstream file(path);
+
+	if (!file) {
+		*pError = "can't open " + path;
+		return false;
+	}
+
+	const char *markers[] = { "#[VERTEX]", "#[FRAGMENT]", "#[COMPUTE]" };
+	std::string directory = std::filesystem::path(path).parent_path().string();
+	std::string line;
+
+	while (std::getline(file, line)) {
+		size_t comment = line.find("//");
+
+		if (comment != std::string::npos) {
+			line.resize(comment);
+		}
+
+		if (line.find("#[FEATURES]") != std::string::npos) {
+			pState->reading = SECTION_FEATURES;
+			continue;
+		}
 
-	glslang::EShTargetClientVersion targetApiVersion = glslang::EShTargetVulkan_1_0;
-	glslShader.setEnvClient(glslang::EShClientVulkan, targetApiVersion);
+		bool marker = false;
 
-	glslang::EShTargetLanguageVersion spirvVersion = glslang::EShTargetSpv_1_0;
-	glslShader.setEnvTarget(glslang::EshTargetSpv, spirvVersion);
+		for (int stage = 0; stage < SHADER_STAGE_MAX; stage++) {
+			if (line.find(markers[stage]) != std::string::npos) {
+				pState->reading = stage;
+				marker = true;
+			}
+		}
 
-	glslShader.setEntryPoint("main");
+		if (marker) {
+			continue;
+		}
 
-	const TBuiltInResource *resources = GetDefaultResources();
+		size_t include = line.find("#include ");
 
-	const int defaultVersion = 450;
-	const bool forwardCompatible = false;
-	const EShMessages messageFlags = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
-	EProfile defaultProfile = ENoProfile;
+		if (include != std::string::npos) {
+			size_t begin = line.find_first_of("\"<", include);
+			size_t end = line.find_last_of("\">");
 
-	glslang::TShader::ForbidIncluder includer;
+			if (begin == std::string::npos || end <= begin) {
+				*pError = path + ": malformed #include";
+				return false;
+			}
 
-	std::string preprocessedStr;
-	if (!glslShader.preprocess(resources, defaultVersion, defaultProfile, false, forwardCompatible, messageFlags, &preprocessedStr, includer)) {
-		throw std::runtime_error("failed to preprocess GLSL shader!");
+			std::string includeName = line.substr(begin + 1, end - begin - 1);
+			std::filesystem::path includePath = includeName.rfind("thirdparty/", 0) == 0 ? includeName : directory + "/" + includeName;
+			std::string includedFile = includePath.lexically_normal().generic_string();
+
+			if (pState->reading < 0) {
+				continue;
+			}
+
+			std::vector<std::string> &stageIncludes = pState->stageIncludes[pState->reading];
+
+			if (std::find(stageIncludes.begin(), stageIncludes.end(), includedFile) != stageIncludes.end()) {
+				continue;
+			}
+
+			stageIncludes.push_back(includedFile);
+
+			if (std::find(pState->includedFiles.begin(), pState->includedFiles.end(), includedFile) == pState->includedFiles.end()) {
+				pState->includedFiles.push_back(includedFile);
+			}
+
+			if (!parseShaderFile(includedFile, pState, pError)) {
+				*pError = path + ": " + *pError;
+				return false;
+			}
+
+			continue;
+		}
+
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+
+		if (pState->reading == SECTION_FEATURES) {
+			size_t begin = line.find_first_not_of(" \t");
+
+			if (begin != std::string::npos) {
+				size_t end = line.find_last_not_of(" \t");
+				pState->features.push_back(line.substr(begin, end - begin + 1));
+			}
+		} else if (pState->reading >= 0) {
+			pState->code[pState->reading] += line + "\n";
+		}
 	}
 
-	const char *preprocessedSources[1] = { preprocessedStr.c_str() };
-	glslShader.setStrings(preprocessedSources, 1);
+	return true;
+}
+
+} // namespace
+
+ShaderRD *ShaderRD::loadFile(const char *path, const char *name, std::string *pError) {
+	ParseState state;
 
-	if (!glslShader.parse(resources, defaultVersion, defaultProfile, false, forwardCompatible, messageFlags, includer)) {
-		std::cout << glslShader.getInfoLog() << "\n";
-		throw std::runtime_error("failed to parse GLSL shader!");
+	if (!parseShaderFile(path, &state, pError)) {
+		return nullptr;
 	}
 
-	glslang::TProgram program;
-	program.addShader(&glslShader);
-	if (!program.link(messageFlags)) {
-		throw std::runtime_error("failed to link shader!");
+	if (state.features.size() > SHADER_MAX_FEATURES) {
+		*pError = std::string(path) + ": at most " + std::to_string(SHADER_MAX_FEATURES) + " features are supported";
+		return nullptr;
 	}
 
-	glslang::TIntermediate &intermediateRef = *(program.getIntermediate(glslStage));
-	std::vector<uint32_t> spirv;
-	glslang::SpvOptions options{};
-	options.validate = true;
-	glslang::GlslangToSpv(intermediateRef, spirv, &options);
+	ShaderRD *pShader = new ShaderRD();
+	pShader->loadedName = name;
+	pShader->loadedPath = path;
+	pShader->includedFiles = state.includedFiles;
 
-	glslang::FinalizeProcess();
+	for (const std::string &feature : state.features) {
+		pShader->loadedFeatures.push_back("FEATURE_" + feature);
+	}
 
-	return spirv;
+	for (const std::string &feature : pShader->loadedFeatures) {
+		pShader->loadedFeaturePointers.push_back(feature.c_str());
+	}
+
+	// compute shaders have no graphics stages, like shader_gen.py
+	bool compute = !state.code[SHADER_STAGE_COMPUTE].empty();
+	const char *code[SHADER_STAGE_MAX] = {};
+
+	for (int stage = 0; stage < SHADER_STAGE_MAX; stage++) {
+		pShader->loadedCode[stage] = state.code[stage];
+
+		if ((stage == SHADER_STAGE_COMPUTE) == compute) {
+			code[stage] = pShader->loadedCode[stage].c_str();
+		}
+	}
+
+	const char **ppFeatures = pShader->loadedFeaturePointers.empty() ? nullptr : pShader->loadedFeaturePointers.data();
+	uint32_t featureCount = static_cast<uint32_t>(pShader->loadedFeaturePointers.size());
+
+	pShader->setup(code[SHADER_STAGE_VERTEX], code[SHADER_STAGE_FRAGMENT], code[SHADER_STAGE_COMPUTE], ppFeatures, featureCount, pShader->loadedName.c_str(), pShader->loadedPath.c_str());
+
+	return pShader;
+}
+
+const char *ShaderRD::getPath() {
+	return path;
+}
+
+const std::vector<std::string> &ShaderRD::getIncludedFiles() {
+	return includedFiles;
+}
+
+bool ShaderRD::compileVariant(uint32_t variant, std::string *pError) {
+	if (variant >= variants.size()) {
+		*pError = std::string(name) + " has no variant " + std::to_string(variant);
+		return false;
+	}
+
+	try {
+		for (int stage = 0; stage < SHADER_STAGE_MAX; stage++) {
+			prepareStage(variant, ShaderStage(stage));
+		}
+	} catch (const std::runtime_error &error) {
+		*pError = error.what();
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+void ShaderRD::prepareStage(uint32_t variant, ShaderStage stage) {
+	Variant *pVariant = &variants[variant];
+
+	// other callers wait for the stage, a failed compile throws and leaves it
+	// unprepared for the next call to retry
+	std::lock_guard<std::mutex> lock(pVariant->mutex[stage]);
+
+	if (pVariant->prepared[stage]) {
+		return;
+	}
+
+	PROFILE_ZONE("ShaderRD::prepareStage");
+
+#ifdef SHADER_RUNTIME_COMPILE
+	std::string preamble;
+
+	for (uint32_t i = 0; i < featureCount; i++) {
+		if (variant & (1u << i)) {
+			preamble += "#define " + std::string(features[i]) + "\n";
+		}
+	}
+
+	pVariant->spirv[stage] = processShader(glslCode[stage], stage, preamble);
+#else
+	const ShaderSpirvVariant &spirvVariant = spirvVariants[variant];
+
+	if (spirvVariant.code[stage] != nullptr) {
+		pVariant->spirv[stage].assign(spirvVariant.code[stage], spirvVariant.code[stage] + spirvVariant.size[stage]);
+	}
+#endif
+
+	pVariant->prepared[stage] = true;
+}
+
+bool ShaderRD::compileAll(ShaderRD **ppShaders, uint32_t count, ThreadPool *pThreadPool, std::vector<std::string> *pErrors) {
+	PROFILE_ZONE("ShaderRD::compileAll");
+
+	struct PendingStage {
+		ShaderRD *pShader;
+		ShaderStage stage;
+	};
+
+	std::vector<PendingStage> pending;
+
+	for (uint32_t i = 0; i < count; i++) {
+		for (int stage = 0; stage < SHADER_STAGE_MAX; stage++) {
+			pending.push_back({ ppShaders[i], ShaderStage(stage) });
+		}
+	}
+
+#ifdef SHADER_RUNTIME_COMPILE
+	// glslang keeps per thread state, but the process wide init must not race
+	GlslCompiler::initialize();
+#endif
+
+	// an exception must not leave a pool task, each stage keeps its own log
+	std::vector<std::string> errors(pending.size());
+
+	auto compileRange = [&pending, &errors](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			try {
+				pending[i].pShader->prepareStage(0, pending[i].stage);
+			} catch (const std::runtime_error &error) {
+				errors[i] = error.what();
+			}
+		}
+	};
+
+	uint32_t pendingCount = static_cast<uint32_t>(pending.size());
+
+	if (pThreadPool == nullptr) {
+		compileRange(0, pendingCount);
+	} else {
+		pThreadPool->parallelFor(pendingCount, 1, compileRange);
+	}
+
+	bool success = true;
+
+	for (const std::string &error : errors) {
+		if (!error.empty()) {
+			pErrors->push_back(error);
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+std::vector<uint32_t> ShaderRD::getCode(uint32_t variant, ShaderStage stage) {
+	if (variant >= variants.size()) {
+		printf("%s has no variant %u!\n", name, variant);
+		return std::vector<uint32_t>();
+	}
+
+	prepareStage(variant, stage);
+
+	return variants[variant].spirv[stage];
+}
+
+const char *ShaderRD::getName() {
+	return name;
+}
+
+uint32_t ShaderRD::getVariantCount() {
+	return static_cast<uint32_t>(variants.size());
+}
+
+bool ShaderRD::isCompute() {
+#ifdef SHADER_RUNTIME_COMPILE
+	return glslCode[SHADER_STAGE_COMPUTE] != nullptr;
+#else
+	return spirvVariants[0].code[SHADER_STAGE_COMPUTE] != nullptr;
+#endif
 }
 
-std::vector<uint32_t> ShaderRD::getVertexCode() {
-	return spirv[STAGE_TYPE_VERTEX];
+std::vector<uint32_t> ShaderRD::getVertexCode(uint32_t variant) {
+	return getCode(variant, SHADER_STAGE_VERTEX);
 }
 
-std::vector<uint32_t> ShaderRD::getFragmentCode() {
-	return spirv[STAGE_TYPE_FRAGMENT];
+std::vector<uint32_t> ShaderRD::getFragmentCode(uint32_t variant) {
+	return getCode(variant, SHADER_STAGE_FRAGMENT);
 }
 
-std::vector<uint32_t> ShaderRD::getComputeCode() {
-	return spirv[STAGE_TYPE_COMPUTE];
+std::vector<uint32_t> ShaderRD::getComputeCode(uint32_t variant) {
+	return getCode(variant, SHADER_STAGE_COMPUTE);
 }
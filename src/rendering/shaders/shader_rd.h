@@ -1,29 +1,106 @@
 #ifndef SHADER_RD_H
 #define SHADER_RD_H
 
+#include <cstddef>
 #include <cstdint>
+#include <mutex>
+#include <string>
 #include <vector>
 
+#include "glsl_compiler.h"
+
+class ThreadPool;
+
+// MAX_FEATURES in shader_gen.py
+const uint32_t SHADER_MAX_FEATURES = 4;
+
+// Build time SPIR-V of one variant, nullptr for missing stages.
+struct ShaderSpirvVariant {
+	const uint32_t *code[SHADER_STAGE_MAX];
+	size_t size[SHADER_STAGE_MAX];
+};
+
+// Generated from the .glsl files by shader_gen.py. The default build embeds
+// SPIR-V compiled at build time, building with dev_shaders=1 embeds the GLSL
+// source instead and compiles it at startup (SHADER_RUNTIME_COMPILE).
+//
+// A shader may list features in a #[FEATURES] section. Every combination is
+// a variant, indexed by its feature mask, that sees FEATURE_<NAME> defined
+// for each of its bits. Variants are prepared on first use.
 class ShaderRD {
 private:
-	enum StageType {
-		STAGE_TYPE_VERTEX,
-		STAGE_TYPE_FRAGMENT,
-		STAGE_TYPE_COMPUTE,
-		STAGE_TYPE_MAX,
+	struct Variant {
+		std::vector<uint32_t> spirv[SHADER_STAGE_MAX];
+		// held while a stage is prepared, set once it succeeded
+		std::mutex mutex[SHADER_STAGE_MAX];
+		bool prepared[SHADER_STAGE_MAX] = {};
 	};
 
-	std::vector<uint32_t> processShader(const char *glslCode, StageType stage);
-	std::vector<uint32_t> spirv[STAGE_TYPE_MAX];
+	const char *name = "";
+	const char **features = nullptr;
+	uint32_t featureCount = 0;
+
+	// indexed by feature mask
+	std::vector<Variant> variants;
+
+	const ShaderSpirvVariant *spirvVariants = nullptr;
+
+#ifdef SHADER_RUNTIME_COMPILE
+	const char *glslCode[SHADER_STAGE_MAX] = {};
+	const char *path = "";
+
+	// owned copies when loaded by loadFile()
+	std::string loadedName;
+	std::string loadedPath;
+	std::string loadedCode[SHADER_STAGE_MAX];
+	std::vector<std::string> loadedFeatures;
+	std::vector<const char *> loadedFeaturePointers;
+	std::vector<std::string> includedFiles;
+
+	std::vector<uint32_t> processShader(const char *glslCode, ShaderStage stage, const std::string &preamble);
+#endif
+
+	void prepareStage(uint32_t variant, ShaderStage stage);
+	std::vector<uint32_t> getCode(uint32_t variant, ShaderStage stage);
 
 protected:
 	ShaderRD(){};
-	void setup(const char *vertexCode, const char *fragmentCode, const char *computeCode, const char *name);
+	void setupSpirv(const ShaderSpirvVariant *pVariants, const char **ppFeatures, uint32_t featureCount, const char *name);
+#ifdef SHADER_RUNTIME_COMPILE
+	void setup(const char *vertexCode, const char *fragmentCode, const char *computeCode, const char **ppFeatures, uint32_t featureCount, const char *name, const char *path);
+#endif
 
 public:
-	std::vector<uint32_t> getVertexCode();
-	std::vector<uint32_t> getFragmentCode();
-	std::vector<uint32_t> getComputeCode();
+	// Prepares the base variant of all shaders, in dev_shaders builds every
+	// stage is compiled on its own task. Returns false with a compiler log per
+	// failed stage in pErrors instead of throwing.
+	static bool compileAll(ShaderRD **ppShaders, uint32_t count, ThreadPool *pThreadPool, std::vector<std::string> *pErrors);
+
+#ifdef SHADER_RUNTIME_COMPILE
+	// Parses a .glsl file the way shader_gen.py does, used for hot reloading.
+	// Returns nullptr and sets pError when the file can't be read.
+	static ShaderRD *loadFile(const char *path, const char *name, std::string *pError);
+
+	const char *getPath();
+
+	// only known for shaders created by loadFile()
+	const std::vector<std::string> &getIncludedFiles();
+
+	// Prepares every stage of a variant, returns false with the compiler log
+	// in pError instead of throwing.
+	bool compileVariant(uint32_t variant, std::string *pError);
+#endif
+
+	const char *getName();
+	uint32_t getVariantCount();
+	bool isCompute();
+
+	// Thread safe, a stage is prepared once and callers wait for it.
+	std::vector<uint32_t> getVertexCode(uint32_t variant = 0);
+	std::vector<uint32_t> getFragmentCode(uint32_t variant = 0);
+	std::vector<uint32_t> getComputeCode(uint32_t variant = 0);
+
+	virtual ~ShaderRD(){};
 };
 
 #endif // !SHADER_RD_H
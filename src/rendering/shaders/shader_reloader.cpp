@@ -0,0 +1,170 @@
+#include "shader_reloader.h"
+
+#ifdef SHADER_RUNTIME_COMPILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "shader_rd.h"
+
+// editors save in several steps, changes are collected for this long
+const std::chrono::milliseconds SHADER_RELOAD_DEBOUNCE(50);
+const int SHADER_RELOAD_POLL_MS = 100;
+
+void ShaderReloader::_readEvents(std::vector<std::string> *pChanged) {
+	alignas(inotify_event) char buffer[4096];
+
+	while (true) {
+		ssize_t length = read(_inotify, buffer, sizeof(buffer));
+
+		if (length <= 0) {
+			return;
+		}
+
+		for (ssize_t offset = 0; offset < length;) {
+			const inotify_event *pEvent = reinterpret_cast<const inotify_event *>(buffer + offset);
+			offset += sizeof(inotify_event) + pEvent->len;
+
+			if (pEvent->len == 0) {
+				continue;
+			}
+
+			std::string file = (std::filesystem::path(_directory) / pEvent->name).lexically_normal().generic_string();
+
+			if (std::find(pChanged->begin(), pChanged->end(), file) == pChanged->end()) {
+				pChanged->push_back(file);
+			}
+		}
+	}
+}
+
+void ShaderReloader::_reload(Target *pTarget) {
+	std::string error;
+	ShaderRD *pShader = ShaderRD::loadFile(pTarget->path.c_str(), pTarget->name.c_str(), &error);
+
+	if (pShader != nullptr) {
+		// includes may have been added or removed
+		pTarget->files = pShader->getIncludedFiles();
+		pTarget->files.push_back(pTarget->path);
+
+		if (!pTarget->reload(pShader, &error)) {
+			delete pShader;
+			pShader = nullptr;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(_errorMutex);
+
+	if (pShader == nullptr) {
+		printf("Failed to reload %s, keeping the previous version\n", pTarget->path.c_str());
+		_errors[pTarget->path] = error;
+	} else {
+		printf("Reloaded %s\n", pTarget->path.c_str());
+		_errors.erase(pTarget->path);
+	}
+}
+
+void ShaderReloader::_run() {
+	while (!_quit) {
+		pollfd descriptor = { _inotify, POLLIN, 0 };
+
+		if (poll(&descriptor, 1, SHADER_RELOAD_POLL_MS) <= 0) {
+			continue;
+		}
+
+		std::vector<std::string> changed;
+		_readEvents(&changed);
+
+		std::this_thread::sleep_for(SHADER_RELOAD_DEBOUNCE);
+		_readEvents(&changed);
+
+		for (Target &target : _targets) {
+			for (const std::string &file : target.files) {
+				if (std::find(changed.begin(), changed.end(), file) != changed.end()) {
+					_reload(&target);
+					break;
+				}
+			}
+		}
+	}
+}
+
+void ShaderReloader::watch(ShaderRD *pShader, ReloadFunction reload) {
+	Target target;
+	target.path = std::filesystem::path(pShader->getPath()).lexically_normal().generic_string();
+	target.name = pShader->getName();
+	target.reload = reload;
+
+	// generated shaders have their includes inlined, parse once to find them
+	std::string error;
+	ShaderRD *pParsed = ShaderRD::loadFile(target.path.c_str(), target.name.c_str(), &error);
+
+	if (pParsed != nullptr) {
+		target.files = pParsed->getIncludedFiles();
+		delete pParsed;
+	}
+
+	target.files.push_back(target.path);
+
+	_targets.push_back(target);
+}
+
+bool ShaderReloader::start(const char *directory) {
+	_directory = directory;
+	_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (_inotify < 0) {
+		printf("inotify is not available, shader hot reloading is disabled\n");
+		return false;
+	}
+
+	// editors either write in place or rename a temporary file over the original
+	if (inotify_add_watch(_inotify, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		printf("Can't watch %s, shader hot reloading is disabled\n", directory);
+		close(_inotify);
+		_inotify = -1;
+		return false;
+	}
+
+	_quit = false;
+	_thread = std::thread(&ShaderReloader::_run, this);
+
+	printf("Watching %s for shader changes\n", directory);
+	return true;
+}
+
+void ShaderReloader::stop() {
+	if (_inotify < 0) {
+		return;
+	}
+
+	_quit = true;
+	_thread.join();
+
+	close(_inotify);
+	_inotify = -1;
+}
+
+std::vector<std::string> ShaderReloader::getErrors() {
+	std::lock_guard<std::mutex> lock(_errorMutex);
+
+	std::vector<std::string> errors;
+
+	for (auto &entry : _errors) {
+		errors.push_back(entry.first + ": " + entry.second);
+	}
+
+	return errors;
+}
+
+ShaderReloader::~ShaderReloader() {
+	stop();
+}
+
+#endif // SHADER_RUNTIME_COMPILE
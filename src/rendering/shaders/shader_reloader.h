@@ -0,0 +1,63 @@
+#ifndef SHADER_RELOADER_H
+#define SHADER_RELOADER_H
+
+#ifdef SHADER_RUNTIME_COMPILE
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ShaderRD;
+
+// Watches a shader directory with inotify and reloads the shaders whose file
+// or includes changed on a background thread. Only built with dev_shaders=1.
+class ShaderReloader {
+public:
+	// Called on the reload thread with the freshly parsed shader. Takes
+	// ownership of pShader when it returns true, otherwise pError explains
+	// why the shader can't be used.
+	typedef std::function<bool(ShaderRD *pShader, std::string *pError)> ReloadFunction;
+
+private:
+	struct Target {
+		std::string path;
+		std::string name;
+		std::vector<std::string> files;
+		ReloadFunction reload;
+	};
+
+	std::vector<Target> _targets;
+	std::string _directory;
+
+	int _inotify = -1;
+	std::thread _thread;
+	std::atomic<bool> _quit = false;
+
+	// by shader path, cleared when the shader compiles again
+	std::mutex _errorMutex;
+	std::map<std::string, std::string> _errors;
+
+	void _run();
+	void _readEvents(std::vector<std::string> *pChanged);
+	void _reload(Target *pTarget);
+
+public:
+	// Must be called before start().
+	void watch(ShaderRD *pShader, ReloadFunction reload);
+
+	bool start(const char *directory);
+	void stop();
+
+	// "path: log" of every shader that failed to reload
+	std::vector<std::string> getErrors();
+
+	~ShaderReloader();
+};
+
+#endif // SHADER_RUNTIME_COMPILE
+
+#endif // !SHADER_RELOADER_H
@@ -0,0 +1,48 @@
+#[COMPUTE]
+
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// tonemapped, in [0, 1]
+layout(set = 0, binding = 0) uniform sampler2D inputColor;
+layout(set = 0, binding = 1, rgba16f) uniform writeonly image2D outputColor;
+
+layout(push_constant) uniform PushConstants {
+	uvec2 size;
+	// 0 to 1
+	float sharpness;
+} constants;
+
+vec3 fetch(ivec2 position) {
+	return texelFetch(inputColor, clamp(position, ivec2(0), ivec2(constants.size) - 1), 0).rgb;
+}
+
+// Contrast adaptive sharpening: a negative lobe on the four neighbors,
+// weaker where the neighborhood already spans most of the range, so edges
+// don't ring.
+void main() {
+	uvec2 position = gl_GlobalInvocationID.xy;
+
+	if (any(greaterThanEqual(position, constants.size))) {
+		return;
+	}
+
+	ivec2 p = ivec2(position);
+
+	vec3 center = fetch(p);
+	vec3 north = fetch(p + ivec2(0, -1));
+	vec3 south = fetch(p + ivec2(0, 1));
+	vec3 west = fetch(p + ivec2(-1, 0));
+	vec3 east = fetch(p + ivec2(1, 0));
+
+	vec3 minimum = min(center, min(min(north, south), min(west, east)));
+	vec3 maximum = max(center, max(max(north, south), max(west, east)));
+
+	vec3 amount = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, 1e-4), 0.0, 1.0));
+	vec3 weight = amount * (-1.0 / mix(8.0, 5.0, constants.sharpness));
+
+	vec3 color = (center + (north + south + west + east) * weight) / (1.0 + 4.0 * weight);
+
+	imageStore(outputColor, ivec2(position), vec4(clamp(color, 0.0, 1.0), 1.0));
+}
@@ -0,0 +1,486 @@
+#include "spirv_reflection.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+
+#include "shader_rd.h"
+
+const uint32_t SPIRV_MAGIC = 0x07230203;
+const uint32_t SPIRV_HEADER_WORDS = 5;
+const uint32_t SPIRV_UNSET = ~0u;
+
+enum SpirvOp {
+	SPIRV_OP_ENTRY_POINT = 15,
+	SPIRV_OP_TYPE_INT = 21,
+	SPIRV_OP_TYPE_FLOAT = 22,
+	SPIRV_OP_TYPE_VECTOR = 23,
+	SPIRV_OP_TYPE_MATRIX = 24,
+	SPIRV_OP_TYPE_IMAGE = 25,
+	SPIRV_OP_TYPE_SAMPLER = 26,
+	SPIRV_OP_TYPE_SAMPLED_IMAGE = 27,
+	SPIRV_OP_TYPE_ARRAY = 28,
+	SPIRV_OP_TYPE_RUNTIME_ARRAY = 29,
+	SPIRV_OP_TYPE_STRUCT = 30,
+	SPIRV_OP_TYPE_POINTER = 32,
+	SPIRV_OP_CONSTANT = 43,
+	SPIRV_OP_SPEC_CONSTANT = 50,
+	SPIRV_OP_FUNCTION = 54,
+	SPIRV_OP_VARIABLE = 59,
+	SPIRV_OP_DECORATE = 71,
+	SPIRV_OP_MEMBER_DECORATE = 72,
+};
+
+enum SpirvDecoration {
+	SPIRV_DECORATION_SPEC_ID = 1,
+	SPIRV_DECORATION_BUFFER_BLOCK = 3,
+	SPIRV_DECORATION_ARRAY_STRIDE = 6,
+	SPIRV_DECORATION_MATRIX_STRIDE = 7,
+	SPIRV_DECORATION_BUILT_IN = 11,
+	SPIRV_DECORATION_LOCATION = 30,
+	SPIRV_DECORATION_BINDING = 33,
+	SPIRV_DECORATION_DESCRIPTOR_SET = 34,
+	SPIRV_DECORATION_OFFSET = 35,
+};
+
+enum SpirvStorageClass {
+	SPIRV_STORAGE_CLASS_UNIFORM_CONSTANT = 0,
+	SPIRV_STORAGE_CLASS_INPUT = 1,
+	SPIRV_STORAGE_CLASS_UNIFORM = 2,
+	SPIRV_STORAGE_CLASS_PUSH_CONSTANT = 9,
+	SPIRV_STORAGE_CLASS_STORAGE_BUFFER = 12,
+};
+
+const uint32_t SPIRV_DIM_BUFFER = 5;
+const uint32_t SPIRV_DIM_SUBPASS_DATA = 6;
+
+// A type, constant or variable and the decorations that apply to it.
+struct SpirvId {
+	uint32_t opcode = 0;
+	// words after the result id, constants and variables skip the result type
+	const uint32_t *pOperands = nullptr;
+	uint32_t operandCount = 0;
+	// result type of constants and variables
+	uint32_t type = 0;
+
+	uint32_t set = SPIRV_UNSET;
+	uint32_t binding = SPIRV_UNSET;
+	uint32_t location = SPIRV_UNSET;
+	uint32_t specId = SPIRV_UNSET;
+	uint32_t arrayStride = 0;
+	bool builtIn = false;
+	bool bufferBlock = false;
+
+	std::vector<uint32_t> memberOffsets;
+	std::vector<uint32_t> memberMatrixStrides;
+};
+
+struct SpirvModule {
+	std::vector<SpirvId> ids;
+	std::vector<uint32_t> variables;
+	VkShaderStageFlags stage = 0;
+
+	const uint32_t *pSpecialization;
+	uint32_t specializationCount;
+
+	uint32_t operand(uint32_t id, uint32_t index) const {
+		const SpirvId &spirvId = ids[id];
+		return index < spirvId.operandCount ? spirvId.pOperands[index] : 0;
+	}
+
+	uint32_t opcode(uint32_t id) const {
+		return id < ids.size() ? ids[id].opcode : 0;
+	}
+};
+
+static VkShaderStageFlags getStage(uint32_t executionModel) {
+	switch (executionModel) {
+		case 0:
+			return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1:
+			return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2:
+			return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3:
+			return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4:
+			return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5:
+			return VK_SHADER_STAGE_COMPUTE_BIT;
+		default:
+			return 0;
+	}
+}
+
+static void setMember(std::vector<uint32_t> *pMembers, uint32_t member, uint32_t value) {
+	if (pMembers->size() <= member) {
+		pMembers->resize(member + 1, 0);
+	}
+
+	(*pMembers)[member] = value;
+}
+
+static bool parseModule(const std::vector<uint32_t> &spirv, SpirvModule *pModule) {
+	if (spirv.size() < SPIRV_HEADER_WORDS || spirv[0] != SPIRV_MAGIC) {
+		return false;
+	}
+
+	// the header holds the upper bound of all ids
+	uint32_t bound = spirv[3];
+	pModule->ids.resize(bound);
+
+	auto validId = [bound](uint32_t id) { return id < bound; };
+
+	size_t offset = SPIRV_HEADER_WORDS;
+
+	while (offset < spirv.size()) {
+		const uint32_t *pWords = &spirv[offset];
+		uint32_t wordCount = pWords[0] >> 16;
+		uint32_t opcode = pWords[0] & 0xffff;
+
+		if (wordCount == 0 || offset + wordCount > spirv.size()) {
+			return false;
+		}
+
+		// everything the layout needs is declared before the first function
+		if (opcode == SPIRV_OP_FUNCTION) {
+			break;
+		}
+
+		switch (opcode) {
+			case SPIRV_OP_ENTRY_POINT:
+				if (wordCount > 1) {
+					pModule->stage |= getStage(pWords[1]);
+				}
+				break;
+
+			case SPIRV_OP_TYPE_INT:
+			case SPIRV_OP_TYPE_FLOAT:
+			case SPIRV_OP_TYPE_VECTOR:
+			case SPIRV_OP_TYPE_MATRIX:
+			case SPIRV_OP_TYPE_IMAGE:
+			case SPIRV_OP_TYPE_SAMPLER:
+			case SPIRV_OP_TYPE_SAMPLED_IMAGE:
+			case SPIRV_OP_TYPE_ARRAY:
+			case SPIRV_OP_TYPE_RUNTIME_ARRAY:
+			case SPIRV_OP_TYPE_STRUCT:
+			case SPIRV_OP_TYPE_POINTER:
+				if (wordCount > 1 && validId(pWords[1])) {
+					SpirvId *pId = &pModule->ids[pWords[1]];
+					pId->opcode = opcode;
+					pId->pOperands = pWords + 2;
+					pId->operandCount = wordCount - 2;
+				}
+				break;
+
+			case SPIRV_OP_CONSTANT:
+			case SPIRV_OP_SPEC_CONSTANT:
+			case SPIRV_OP_VARIABLE:
+				if (wordCount > 3 && validId(pWords[2])) {
+					SpirvId *pId = &pModule->ids[pWords[2]];
+					pId->opcode = opcode;
+					pId->type = pWords[1];
+					pId->pOperands = pWords + 3;
+					pId->operandCount = wordCount - 3;
+
+					if (opcode == SPIRV_OP_VARIABLE) {
+						pModule->variables.push_back(pWords[2]);
+					}
+				}
+				break;
+
+			case SPIRV_OP_DECORATE:
+				if (wordCount > 2 && validId(pWords[1])) {
+					SpirvId *pId = &pModule->ids[pWords[1]];
+					uint32_t value = wordCount > 3 ? pWords[3] : 0;
+
+					switch (pWords[2]) {
+						case SPIRV_DECORATION_SPEC_ID:
+							pId->specId = value;
+							break;
+						case SPIRV_DECORATION_BUFFER_BLOCK:
+							pId->bufferBlock = true;
+							break;
+						case SPIRV_DECORATION_ARRAY_STRIDE:
+							pId->arrayStride = value;
+							break;
+						case SPIRV_DECORATION_BUILT_IN:
+							pId->builtIn = true;
+							break;
+						case SPIRV_DECORATION_LOCATION:
+							pId->location = value;
+							break;
+						case SPIRV_DECORATION_BINDING:
+							pId->binding = value;
+							break;
+						case SPIRV_DECORATION_DESCRIPTOR_SET:
+							pId->set = value;
+							break;
+					}
+				}
+				break;
+
+			case SPIRV_OP_MEMBER_DECORATE:
+				if (wordCount > 4 && validId(pWords[1])) {
+					SpirvId *pId = &pModule->ids[pWords[1]];
+
+					if (pWords[3] == SPIRV_DECORATION_OFFSET) {
+						setMember(&pId->memberOffsets, pWords[2], pWords[4]);
+					} else if (pWords[3] == SPIRV_DECORATION_MATRIX_STRIDE) {
+						setMember(&pId->memberMatrixStrides, pWords[2], pWords[4]);
+					}
+				}
+				break;
+		}
+
+		offset += wordCount;
+	}
+
+	return true;
+}
+
+static uint32_t getConstant(const SpirvModule &module, uint32_t id) {
+	if (id >= module.ids.size()) {
+		return 1;
+	}
+
+	const SpirvId &constant = module.ids[id];
+
+	if (constant.opcode == SPIRV_OP_SPEC_CONSTANT && constant.specId < module.specializationCount) {
+		return module.pSpecialization[constant.specId];
+	}
+
+	if (constant.opcode == SPIRV_OP_CONSTANT || constant.opcode == SPIRV_OP_SPEC_CONSTANT) {
+		return module.operand(id, 0);
+	}
+
+	// e.g. OpSpecConstantOp, not used for array sizes here
+	printf("SPIR-V reflection can't evaluate constant %u!\n", id);
+	return 1;
+}
+
+// Size in bytes with the explicit layout of blocks, matrixStride comes from
+// the member that holds a matrix.
+static uint32_t getTypeSize(const SpirvModule &module, uint32_t type, uint32_t matrixStride = 0) {
+	switch (module.opcode(type)) {
+		case SPIRV_OP_TYPE_INT:
+		case SPIRV_OP_TYPE_FLOAT:
+			return module.operand(type, 0) / 8;
+
+		case SPIRV_OP_TYPE_VECTOR:
+			return module.operand(type, 1) * getTypeSize(module, module.operand(type, 0));
+
+		case SPIRV_OP_TYPE_MATRIX: {
+			uint32_t columnSize = matrixStride > 0 ? matrixStride : getTypeSize(module, module.operand(type, 0));
+			return module.operand(type, 1) * columnSize;
+		}
+
+		case SPIRV_OP_TYPE_ARRAY: {
+			uint32_t length = getConstant(module, module.operand(type, 1));
+			uint32_t stride = module.ids[type].arrayStride;
+
+			if (stride == 0) {
+				stride = getTypeSize(module, module.operand(type, 0), matrixStride);
+			}
+
+			return length * stride;
+		}
+
+		case SPIRV_OP_TYPE_STRUCT: {
+			const SpirvId &structure = module.ids[type];
+			uint32_t size = 0;
+
+			for (uint32_t member = 0; member < structure.operandCount; member++) {
+				uint32_t memberOffset = member < structure.memberOffsets.size() ? structure.memberOffsets[member] : 0;
+				uint32_t memberMatrixStride = member < structure.memberMatrixStrides.size() ? structure.memberMatrixStrides[member] : 0;
+
+				size = std::max(size, memberOffset + getTypeSize(module, structure.pOperands[member], memberMatrixStride));
+			}
+
+			return size;
+		}
+
+		default:
+			// runtime arrays add nothing to the fixed size
+			return 0;
+	}
+}
+
+static VkDescriptorType getDescriptorType(const SpirvModule &module, uint32_t type, uint32_t storageClass) {
+	switch (module.opcode(type)) {
+		case SPIRV_OP_TYPE_SAMPLED_IMAGE:
+			return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+		case SPIRV_OP_TYPE_SAMPLER:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+
+		case SPIRV_OP_TYPE_IMAGE: {
+			uint32_t dim = module.operand(type, 1);
+			// 1 with a sampler, 2 for storage images
+			bool storage = module.operand(type, 5) == 2;
+
+			if (dim == SPIRV_DIM_SUBPASS_DATA) {
+				return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			}
+
+			if (dim == SPIRV_DIM_BUFFER) {
+				return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			}
+
+			return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+
+		case SPIRV_OP_TYPE_STRUCT:
+			// SPIR-V 1.0 marks storage buffers as BufferBlock in the Uniform class
+			if (storageClass == SPIRV_STORAGE_CLASS_STORAGE_BUFFER || module.ids[type].bufferBlock) {
+				return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			}
+
+			return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+		default:
+			return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	}
+}
+
+static VkFormat getInputFormat(const SpirvModule &module, uint32_t type) {
+	uint32_t components = 1;
+
+	if (module.opcode(type) == SPIRV_OP_TYPE_VECTOR) {
+		components = module.operand(type, 1);
+		type = module.operand(type, 0);
+	}
+
+	if (components < 1 || components > 4 || module.operand(type, 0) != 32) {
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+	const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+	const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+	switch (module.opcode(type)) {
+		case SPIRV_OP_TYPE_FLOAT:
+			return floatFormats[components - 1];
+		case SPIRV_OP_TYPE_INT:
+			// second operand is the signedness
+			return module.operand(type, 1) ? intFormats[components - 1] : uintFormats[components - 1];
+		default:
+			return VK_FORMAT_UNDEFINED;
+	}
+}
+
+static void addBinding(ShaderReflection *pReflection, const ReflectedBinding &binding) {
+	auto it = std::lower_bound(pReflection->bindings.begin(), pReflection->bindings.end(), binding, [](const ReflectedBinding &a, const ReflectedBinding &b) {
+		return a.set < b.set || (a.set == b.set && a.binding < b.binding);
+	});
+
+	if (it == pReflection->bindings.end() || it->set != binding.set || it->binding != binding.binding) {
+		pReflection->bindings.insert(it, binding);
+		return;
+	}
+
+	if (it->type != binding.type) {
+		printf("Descriptor set %u binding %u is declared with different types!\n", binding.set, binding.binding);
+	}
+
+	it->stages |= binding.stages;
+
+	// a runtime sized array stays unbounded
+	if (it->count != 0) {
+		it->count = binding.count == 0 ? 0 : std::max(it->count, binding.count);
+	}
+}
+
+uint32_t ShaderReflection::getSetCount() const {
+	return bindings.empty() ? 0 : bindings.back().set + 1;
+}
+
+bool SpirvReflection::reflect(const std::vector<uint32_t> &spirv, const uint32_t *pSpecialization, uint32_t specializationCount, ShaderReflection *pReflection) {
+	SpirvModule module;
+	module.pSpecialization = pSpecialization;
+	module.specializationCount = pSpecialization != nullptr ? specializationCount : 0;
+
+	if (!parseModule(spirv, &module)) {
+		return false;
+	}
+
+	for (uint32_t variableId : module.variables) {
+		const SpirvId &variable = module.ids[variableId];
+
+		if (module.opcode(variable.type) != SPIRV_OP_TYPE_POINTER) {
+			continue;
+		}
+
+		uint32_t storageClass = variable.pOperands[0];
+		uint32_t type = module.operand(variable.type, 1);
+
+		switch (storageClass) {
+			case SPIRV_STORAGE_CLASS_PUSH_CONSTANT: {
+				// ranges are multiples of 4 bytes
+				uint32_t size = (getTypeSize(module, type) + 3) & ~3u;
+
+				pReflection->pushConstantSize = std::max(pReflection->pushConstantSize, size);
+				pReflection->pushConstantStages |= module.stage;
+				break;
+			}
+
+			case SPIRV_STORAGE_CLASS_INPUT:
+				if (module.stage == VK_SHADER_STAGE_VERTEX_BIT && !variable.builtIn && variable.location < SPIRV_MAX_INPUT_LOCATIONS) {
+					pReflection->inputLocations |= 1u << variable.location;
+					pReflection->inputFormats[variable.location] = getInputFormat(module, type);
+				}
+				break;
+
+			case SPIRV_STORAGE_CLASS_UNIFORM_CONSTANT:
+			case SPIRV_STORAGE_CLASS_UNIFORM:
+			case SPIRV_STORAGE_CLASS_STORAGE_BUFFER: {
+				if (variable.set == SPIRV_UNSET || variable.binding == SPIRV_UNSET) {
+					break;
+				}
+
+				ReflectedBinding binding;
+				binding.set = variable.set;
+				binding.binding = variable.binding;
+				binding.stages = module.stage;
+
+				if (module.opcode(type) == SPIRV_OP_TYPE_ARRAY) {
+					binding.count = getConstant(module, module.operand(type, 1));
+					type = module.operand(type, 0);
+				} else if (module.opcode(type) == SPIRV_OP_TYPE_RUNTIME_ARRAY) {
+					binding.count = 0;
+					type = module.operand(type, 0);
+				}
+
+				binding.type = getDescriptorType(module, type, storageClass);
+
+				if (binding.type == VK_DESCRIPTOR_TYPE_MAX_ENUM) {
+					printf("Descriptor set %u binding %u has an unsupported type!\n", binding.set, binding.binding);
+					break;
+				}
+
+				addBinding(pReflection, binding);
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool SpirvReflection::reflectShader(ShaderRD *pShader, uint32_t variant, const uint32_t *pSpecialization, uint32_t specializationCount, ShaderReflection *pReflection) {
+	bool success;
+
+	if (pShader->isCompute()) {
+		success = reflect(pShader->getComputeCode(variant), pSpecialization, specializationCount, pReflection);
+	} else {
+		success = reflect(pShader->getVertexCode(variant), pSpecialization, specializationCount, pReflection) &&
+				reflect(pShader->getFragmentCode(variant), pSpecialization, specializationCount, pReflection);
+	}
+
+	if (!success) {
+		printf("Failed to reflect %s, invalid SPIR-V!\n", pShader->getName());
+	}
+
+	return success;
+}
@@ -0,0 +1,57 @@
+#ifndef SPIRV_REFLECTION_H
+#define SPIRV_REFLECTION_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class ShaderRD;
+
+// Vertex input locations tracked by the reflection.
+const uint32_t SPIRV_MAX_INPUT_LOCATIONS = 16;
+
+// A descriptor binding declared by a shader.
+struct ReflectedBinding {
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	// array size, 0 for runtime sized arrays
+	uint32_t count = 1;
+	VkShaderStageFlags stages = 0;
+};
+
+// The interface of one or more shaders, what their pipeline layout and vertex
+// input state have to provide. Stages and shaders reflected into the same
+// object are merged, bindings used by several stages get all of them.
+struct ShaderReflection {
+	// sorted by set and binding
+	std::vector<ReflectedBinding> bindings;
+
+	// a single range starting at offset 0
+	uint32_t pushConstantSize = 0;
+	VkShaderStageFlags pushConstantStages = 0;
+
+	// vertex stage inputs, a bit per location
+	uint32_t inputLocations = 0;
+	VkFormat inputFormats[SPIRV_MAX_INPUT_LOCATIONS] = {};
+
+	uint32_t getSetCount() const;
+};
+
+// Reads descriptor bindings, push constants and vertex inputs straight from
+// the decorations and variables of a SPIR-V module.
+class SpirvReflection {
+public:
+	// Adds one stage to pReflection. Array sizes given by specialization
+	// constants use pSpecialization[SpecId] when it has that many values.
+	// Returns false when the code isn't valid SPIR-V.
+	static bool reflect(const std::vector<uint32_t> &spirv, const uint32_t *pSpecialization, uint32_t specializationCount, ShaderReflection *pReflection);
+
+	// Adds every stage of a variant. Resources stay declared when a variant
+	// doesn't use them, so the base variant describes all of them as long as
+	// bindings aren't behind feature defines.
+	static bool reflectShader(ShaderRD *pShader, uint32_t variant, const uint32_t *pSpecialization, uint32_t specializationCount, ShaderReflection *pReflection);
+};
+
+#endif // !SPIRV_REFLECTION_H
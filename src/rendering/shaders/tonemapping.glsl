@@ -2,11 +2,6 @@
 
 #version 450
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec3 inColor;
-layout(location = 3) in vec2 inTexCoord;
-
 vec2 positions[3] = vec2[](
     vec2(-1.0, -1.0),
     vec2(-1.0, 3.0),
@@ -21,6 +16,12 @@ void main() {
 
 #version 450
 
+// TonemapOperator, the compute post-processing has tonemapped already
+layout(constant_id = 0) const uint OPERATOR = 0;
+
+const uint OPERATOR_ACES = 0;
+const uint OPERATOR_NONE = 1;
+
 layout(set = 0, binding = 0, input_attachment_index = 0) uniform subpassInput inputColor;
 
 layout(location = 0) out vec4 fragColor;
@@ -46,5 +47,11 @@ vec3 aces(vec3 color) {
 
 void main() {
 	vec4 color = subpassLoad(inputColor);
+
+	if (OPERATOR == OPERATOR_NONE) {
+		fragColor = vec4(color.rgb, 1.0);
+		return;
+	}
+
 	fragColor = vec4(aces(color.rgb), 1.0);
 }
@@ -0,0 +1,100 @@
+#[VERTEX]
+
+#version 450
+
+layout(location = 0) out vec2 outUV;
+
+vec2 positions[3] = vec2[](
+    vec2(-1.0, -1.0),
+    vec2(-1.0, 3.0),
+    vec2(3.0, -1.0)
+);
+
+void main() {
+    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    outUV = positions[gl_VertexIndex] * 0.5 + 0.5;
+}
+
+#[FRAGMENT]
+
+#version 450
+
+// UpscaleFilter, a specialization constant so switching needs no recompile
+layout(constant_id = 0) const uint FILTER = 0;
+
+const uint FILTER_BILINEAR = 0;
+const uint FILTER_EDGE_AWARE = 1;
+
+// how strongly a luminance difference to the nearest texel lowers a tap's weight
+const float EDGE_SHARPNESS = 8.0;
+
+// the scene was rendered into the top left of it
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform PushConstants {
+	// rendered part of the scene color in texels
+	vec2 renderSize;
+	// one over the size of the scene color
+	vec2 texelSize;
+} constants;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 fragColor;
+
+float luminance(vec3 color) {
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Bilinear weights, lowered for taps across an edge from the nearest texel
+// so edges stay sharp instead of blurring over two output texels.
+vec3 edgeAware(vec2 position) {
+	vec2 texel = position - 0.5;
+	vec2 f = fract(texel);
+	ivec2 base = ivec2(floor(texel));
+	ivec2 maxTexel = ivec2(constants.renderSize) - 1;
+
+	vec3 colors[4];
+	colors[0] = texelFetch(sceneColor, clamp(base, ivec2(0), maxTexel), 0).rgb;
+	colors[1] = texelFetch(sceneColor, clamp(base + ivec2(1, 0), ivec2(0), maxTexel), 0).rgb;
+	colors[2] = texelFetch(sceneColor, clamp(base + ivec2(0, 1), ivec2(0), maxTexel), 0).rgb;
+	colors[3] = texelFetch(sceneColor, clamp(base + ivec2(1, 1), ivec2(0), maxTexel), 0).rgb;
+
+	float weights[4] = float[](
+		(1.0 - f.x) * (1.0 - f.y),
+		f.x * (1.0 - f.y),
+		(1.0 - f.x) * f.y,
+		f.x * f.y
+	);
+
+	uint nearest = (f.x < 0.5 ? 0 : 1) + (f.y < 0.5 ? 0 : 2);
+	float reference = luminance(colors[nearest]);
+
+	vec3 color = vec3(0.0);
+	float total = 0.0;
+
+	for (uint i = 0; i < 4; i++) {
+		float l = luminance(colors[i]);
+		// relative, HDR luminance has no fixed range
+		float difference = abs(l - reference) / (l + reference + 1e-4);
+		float weight = weights[i] / (1.0 + EDGE_SHARPNESS * difference);
+
+		color += colors[i] * weight;
+		total += weight;
+	}
+
+	return color / total;
+}
+
+void main() {
+	vec2 position = inUV * constants.renderSize;
+
+	if (FILTER == FILTER_EDGE_AWARE) {
+		fragColor = vec4(edgeAware(position), 1.0);
+		return;
+	}
+
+	// clamped to the rendered part, the rest of the image is stale
+	position = clamp(position, vec2(0.5), constants.renderSize - 0.5);
+	fragColor = vec4(textureLod(sceneColor, position * constants.texelSize, 0.0).rgb, 1.0);
+}
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cstdio>
+
+#include "simd_kernels.h"
+
+bool SimdKernels::isSupported(SimdKernel kernel) {
+	switch (kernel) {
+		case SIMD_KERNEL_SCALAR:
+			return true;
+#ifdef SIMD_KERNELS_X86
+		case SIMD_KERNEL_SSE:
+			return __builtin_cpu_supports("sse2");
+		case SIMD_KERNEL_AVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+SimdKernel SimdKernels::getBest(SimdKernel lastKernel) {
+	for (int kernel = lastKernel; kernel > SIMD_KERNEL_SCALAR; kernel--) {
+		if (isSupported(SimdKernel(kernel))) {
+			return SimdKernel(kernel);
+		}
+	}
+
+	return SIMD_KERNEL_SCALAR;
+}
+
+const char *SimdKernels::getName(SimdKernel kernel) {
+	switch (kernel) {
+		case SIMD_KERNEL_SCALAR:
+			return "scalar";
+		case SIMD_KERNEL_SSE:
+			return "SSE";
+		case SIMD_KERNEL_AVX2:
+			return "AVX2";
+		default:
+			return "unknown";
+	}
+}
+
+bool SimdKernels::benchmark(const char *pItemName, uint32_t itemCount, int iterations, SimdKernel lastKernel,
+		const std::function<void(SimdKernel)> &run, const std::function<uint32_t()> &countMismatches) {
+	bool success = true;
+
+	for (int kernel = SIMD_KERNEL_SCALAR; kernel <= lastKernel; kernel++) {
+		if (!isSupported(SimdKernel(kernel))) {
+			printf("  %-8s not supported\n", getName(SimdKernel(kernel)));
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < iterations; i++) {
+			run(SimdKernel(kernel));
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		double milliseconds = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+		uint32_t mismatches = countMismatches();
+
+		printf("  %-8s %8.3f ms  %6.2f ns/%s  %s\n", getName(SimdKernel(kernel)), milliseconds, milliseconds * 1e6 / itemCount, pItemName,
+				mismatches == 0 ? "matches scalar" : "MISMATCH");
+
+		if (mismatches > 0) {
+			printf("  %u %ss differ from the scalar reference!\n", mismatches, pItemName);
+			success = false;
+		}
+	}
+
+	return success;
+}
@@ -0,0 +1,35 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstdint>
+#include <functional>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// Instruction sets CPU kernels can be written for, ordered from least to most
+// capable. Each module implements a prefix of them, up to its last kernel.
+enum SimdKernel {
+	SIMD_KERNEL_SCALAR,
+	SIMD_KERNEL_SSE,
+	SIMD_KERNEL_AVX2,
+	SIMD_KERNEL_MAX,
+};
+
+class SimdKernels {
+public:
+	static bool isSupported(SimdKernel kernel);
+	// The most capable kernel up to lastKernel the CPU supports.
+	static SimdKernel getBest(SimdKernel lastKernel);
+	static const char *getName(SimdKernel kernel);
+
+	// Times run() for every kernel up to lastKernel, then counts the items of
+	// its output that differ from the scalar reference with countMismatches().
+	// pItemName is singular, e.g. "sphere".
+	static bool benchmark(const char *pItemName, uint32_t itemCount, int iterations, SimdKernel lastKernel,
+			const std::function<void(SimdKernel)> &run, const std::function<uint32_t()> &countMismatches);
+};
+
+#endif // !SIMD_KERNELS_H
@@ -1,6 +1,9 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <cstddef>
+#include <cstdint>
+
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan.h>
 
@@ -14,4 +17,18 @@ struct AllocatedImage {
 	VkImage image;
 };
 
+// FNV-1a, for small keys compared as raw bytes. Pass the previous result as
+// the seed to hash several ranges. 64 bit on every platform and stable across
+// runs, unlike std::hash, so it can key files on disk too.
+inline uint64_t hashBytes(const void *pData, size_t size, uint64_t seed = 14695981039346656037ull) {
+	const uint8_t *pBytes = static_cast<const uint8_t *>(pData);
+	uint64_t hash = seed;
+
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ pBytes[i]) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
 #endif // !TYPES_H
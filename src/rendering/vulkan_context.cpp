@@ -1,9 +1,14 @@
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <iterator>
 #include <limits>
 #include <set>
 
+#include "../cpu_profiler.h"
 #include "vulkan_context.h"
 
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkDebugUtilsMessengerEXT *pDebugMessenger) {
@@ -70,6 +75,12 @@ void VulkanContext::_createInstance(std::vector<const char *> extensions, bool u
 	if (useValidation)
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
+	// Vulkan 1.0 instance, extension features are queried through this
+	_hasProperties2 = _checkInstanceExtensionSupport(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
+	if (_hasProperties2)
+		extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
 	VkInstanceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	createInfo.pApplicationInfo = &appInfo;
@@ -125,6 +136,22 @@ bool VulkanContext::_checkValidationLayerSupport() {
 	return true;
 }
 
+bool VulkanContext::_checkInstanceExtensionSupport(const char *pExtension) {
+	uint32_t extensionCount;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+	for (const VkExtensionProperties &availableExtension : availableExtensions) {
+		if (strcmp(pExtension, availableExtension.extensionName) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 VkPhysicalDevice VulkanContext::_pickPhysicalDevice(VkSurfaceKHR surface) {
 	uint32_t deviceCount = 0;
 	vkEnumeratePhysicalDevices(_instance, &deviceCount, nullptr);
@@ -150,11 +177,12 @@ VkPhysicalDevice VulkanContext::_pickPhysicalDevice(VkSurfaceKHR surface) {
 
 bool VulkanContext::_isDeviceSuitable(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface) {
 	QueueFamilyIndices indices = _findQueueFamilies(physicalDevice, surface);
-	bool extensionsSupported = _checkDeviceExtensionSupport(physicalDevice);
+	bool extensionsSupported = _checkDeviceExtensionSupport(physicalDevice, _getRequiredDeviceExtensions());
 
-	bool swapChainAdequate = false;
+	// nothing is presented in headless mode
+	bool swapChainAdequate = _headless;
 
-	if (extensionsSupported) {
+	if (extensionsSupported && !_headless) {
 		SwapChainSupportDetails swapChainSupport = _querySwapChainSupport(physicalDevice, surface);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -162,17 +190,19 @@ bool VulkanContext::_isDeviceSuitable(VkPhysicalDevice physicalDevice, VkSurface
 	VkPhysicalDeviceFeatures supportedFeatures;
 	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
 
-	return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+	// the material indexes the texture table with a push constant
+	return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy && supportedFeatures.shaderSampledImageArrayDynamicIndexing &&
+			_queryTimelineSemaphore(physicalDevice);
 }
 
-bool VulkanContext::_checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice) {
+bool VulkanContext::_checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice, const std::vector<const char *> &extensions) {
 	uint32_t extensionCount;
 	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
 
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
 
-	for (const char *extension : deviceExtensions) {
+	for (const char *extension : extensions) {
 		bool isExtensionSupported = false;
 
 		for (const VkExtensionProperties &availableExtension : availableExtensions) {
@@ -190,6 +220,84 @@ bool VulkanContext::_checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice
 	return true;
 }
 
+std::vector<const char *> VulkanContext::_getRequiredDeviceExtensions() {
+	std::vector<const char *> extensions = _headless ? std::vector<const char *>() : deviceExtensions;
+	extensions.insert(extensions.end(), timelineSemaphoreExtensions.begin(), timelineSemaphoreExtensions.end());
+
+	return extensions;
+}
+
+bool VulkanContext::_queryDescriptorIndexing(VkPhysicalDevice physicalDevice) {
+	if (!_hasProperties2 || !_checkDeviceExtensionSupport(physicalDevice, descriptorIndexingExtensions)) {
+		return false;
+	}
+
+	PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(_instance, "vkGetPhysicalDeviceFeatures2KHR");
+	PFN_vkGetPhysicalDeviceProperties2KHR getProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(_instance, "vkGetPhysicalDeviceProperties2KHR");
+
+	if (getFeatures2 == nullptr || getProperties2 == nullptr) {
+		return false;
+	}
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	VkPhysicalDeviceFeatures2KHR features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+	features.pNext = &indexingFeatures;
+
+	getFeatures2(physicalDevice, &features);
+
+	// new textures are written while earlier frames using the table are in flight
+	if (!indexingFeatures.descriptorBindingPartiallyBound || !indexingFeatures.descriptorBindingSampledImageUpdateAfterBind || !indexingFeatures.descriptorBindingUpdateUnusedWhilePending) {
+		return false;
+	}
+
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+	indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+	VkPhysicalDeviceProperties2KHR properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+	properties.pNext = &indexingProperties;
+
+	getProperties2(physicalDevice, &properties);
+
+	// a combined image sampler counts as both a sampler and a sampled image
+	_maxBindlessTextures = std::min({
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+			indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+	});
+
+	return true;
+}
+
+bool VulkanContext::_queryTimelineSemaphore(VkPhysicalDevice physicalDevice) {
+	// the extension is checked with the other required ones, the feature
+	// can only be queried through VK_KHR_get_physical_device_properties2
+	if (!_hasProperties2) {
+		return false;
+	}
+
+	PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(_instance, "vkGetPhysicalDeviceFeatures2KHR");
+
+	if (getFeatures2 == nullptr) {
+		return false;
+	}
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+	VkPhysicalDeviceFeatures2KHR features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+	features.pNext = &timelineFeatures;
+
+	getFeatures2(physicalDevice, &features);
+
+	return timelineFeatures.timelineSemaphore;
+}
+
 QueueFamilyIndices VulkanContext::_findQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface) {
 	QueueFamilyIndices indices;
 
@@ -198,6 +306,16 @@ QueueFamilyIndices VulkanContext::_findQueueFamilies(VkPhysicalDevice physicalDe
 	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
 
+	// usually the async compute family of discrete GPUs
+	for (uint32_t j = 0; j < queueFamilyCount; j++) {
+		VkQueueFlags flags = queueFamilies[j].queueFlags;
+
+		if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+			indices.computeFamily = j;
+			break;
+		}
+	}
+
 	int i = 0;
 	for (const VkQueueFamilyProperties &queueFamily : queueFamilies) {
 		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
@@ -205,7 +323,13 @@ QueueFamilyIndices VulkanContext::_findQueueFamilies(VkPhysicalDevice physicalDe
 		}
 
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+
+		if (surface != VK_NULL_HANDLE) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+		} else {
+			// headless, the graphics queue "presents" by finishing the frame
+			presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		}
 
 		if (presentSupport) {
 			indices.presentFamily = i;
@@ -250,6 +374,10 @@ VkDevice VulkanContext::_createDevice(VkPhysicalDevice physicalDevice, VkSurface
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
 
+	if (_useAsyncCompute(indices)) {
+		uniqueQueueFamilies.insert(indices.computeFamily.value());
+	}
+
 	float queuePriority = 1.0f;
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
 		VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -260,16 +388,45 @@ VkDevice VulkanContext::_createDevice(VkPhysicalDevice physicalDevice, VkSurface
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+
+	std::vector<const char *> extensions = _getRequiredDeviceExtensions();
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	timelineFeatures.timelineSemaphore = VK_TRUE;
+
+	// otherwise the renderer falls back to a small fixed size texture table
+	_descriptorIndexing = _queryDescriptorIndexing(physicalDevice);
+
+	if (_descriptorIndexing) {
+		extensions.insert(extensions.end(), descriptorIndexingExtensions.begin(), descriptorIndexingExtensions.end());
+
+		indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+
+		timelineFeatures.pNext = &indexingFeatures;
+	}
 
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &timelineFeatures;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	if (_useValidation) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -281,9 +438,101 @@ VkDevice VulkanContext::_createDevice(VkPhysicalDevice physicalDevice, VkSurface
 	VkDevice device;
 	VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, nullptr, &device), "Failed to create device!");
 
+	_enabledFeatures = deviceFeatures;
+
 	return device;
 }
 
+void VulkanContext::_createPipelineCache() {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+
+	// one file per device, a driver rejects data from other devices anyway
+	char fileName[64];
+	snprintf(fileName, sizeof(fileName), "pipeline_cache_%04x_%04x.bin", properties.vendorID, properties.deviceID);
+	_pipelineCachePath = fileName;
+
+	std::vector<uint8_t> data;
+	std::ifstream file(_pipelineCachePath, std::ios::binary);
+
+	if (file.is_open()) {
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	if (!data.empty() && !_isPipelineCacheCompatible(data)) {
+		printf("Ignoring incompatible pipeline cache %s\n", _pipelineCachePath.c_str());
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.data();
+
+	VK_CHECK(vkCreatePipelineCache(_device, &createInfo, nullptr, &_pipelineCache), "Failed to create pipeline cache!");
+
+	printf("Pipeline cache: loaded %zu bytes from %s\n", data.size(), _pipelineCachePath.c_str());
+}
+
+bool VulkanContext::_isPipelineCacheCompatible(const std::vector<uint8_t> &data) {
+	// VkPipelineCacheHeaderVersionOne, read field by field, the data is unaligned
+	const size_t headerSize = 16 + VK_UUID_SIZE;
+
+	if (data.size() < headerSize) {
+		return false;
+	}
+
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+
+	if (header[0] < headerSize || header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+		return false;
+	}
+
+	if (header[2] != properties.vendorID || header[3] != properties.deviceID) {
+		return false;
+	}
+
+	// changes with driver updates
+	return memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void VulkanContext::savePipelineCache() {
+	if (_pipelineCache == VK_NULL_HANDLE) {
+		return;
+	}
+
+	size_t size = 0;
+	VK_CHECK(vkGetPipelineCacheData(_device, _pipelineCache, &size, nullptr), "Failed to get pipeline cache size!");
+
+	std::vector<uint8_t> data(size);
+	VK_CHECK(vkGetPipelineCacheData(_device, _pipelineCache, &size, data.data()), "Failed to get pipeline cache data!");
+
+	// write a temporary file and rename it, a crash never leaves a truncated cache
+	std::string temporaryPath = _pipelineCachePath + ".tmp";
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char *>(data.data()), size);
+
+		if (!file.good()) {
+			printf("Failed to write pipeline cache %s\n", temporaryPath.c_str());
+			return;
+		}
+	}
+
+	if (rename(temporaryPath.c_str(), _pipelineCachePath.c_str()) != 0) {
+		printf("Failed to replace pipeline cache %s\n", _pipelineCachePath.c_str());
+		remove(temporaryPath.c_str());
+		return;
+	}
+
+	printf("Pipeline cache: saved %zu bytes to %s\n", size, _pipelineCachePath.c_str());
+}
+
 void VulkanContext::_createSwapChain(Window *pWindow) {
 	SwapChainSupportDetails swapchainSupport = _querySwapChainSupport(_physicalDevice, pWindow->surface);
 
@@ -348,8 +597,19 @@ void VulkanContext::_createSwapChain(Window *pWindow) {
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
+	// lets the driver reuse its resources, images already acquired from the
+	// old one can still be presented
+	createInfo.oldSwapchain = pWindow->swapchain;
+
+	VkSwapchainKHR swapchain;
+	VK_CHECK(vkCreateSwapchainKHR(_device, &createInfo, nullptr, &swapchain), "Failed to create swapchain!");
 
-	VK_CHECK(vkCreateSwapchainKHR(_device, &createInfo, nullptr, &pWindow->swapchain), "Failed to create swapchain!");
+	// retired, nothing uses its images anymore
+	if (pWindow->swapchain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(_device, pWindow->swapchain, nullptr);
+	}
+
+	pWindow->swapchain = swapchain;
 
 	vkGetSwapchainImagesKHR(_device, pWindow->swapchain, &imageCount, nullptr);
 
@@ -365,33 +625,213 @@ void VulkanContext::_createSwapChain(Window *pWindow) {
 
 	free(swapchainImages);
 
+	pWindow->swapchainExtent = extent;
+	pWindow->format = surfaceFormat.format;
+}
+
+void VulkanContext::_createOffscreenImages(Window *pWindow) {
+	// same formats a surface usually offers, pipelines don't notice the difference
+	VkFormat format = _findSupportedFormat({ VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+
+	VkExtent2D extent = {
+		static_cast<uint32_t>(pWindow->width),
+		static_cast<uint32_t>(pWindow->height)
+	};
+
+	pWindow->swapchainImages.resize(HEADLESS_IMAGE_COUNT);
+
+	for (uint32_t i = 0; i < HEADLESS_IMAGE_COUNT; i++) {
+		SwapChainImageResource *pImage = &pWindow->swapchainImages[i];
+
+		// transfer source to read back what was rendered
+		pImage->image = _createImage(extent.width, extent.height, format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, &pImage->memory);
+		pImage->view = _createImageView(pImage->image, format, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	pWindow->swapchainExtent = extent;
+	pWindow->format = format;
+}
+
+void VulkanContext::_createAttachments(Window *pWindow) {
+	uint32_t imageCount = static_cast<uint32_t>(pWindow->swapchainImages.size());
+	VkExtent2D extent = pWindow->swapchainExtent;
+
 	// Resources
 
-	VkFormat colorFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-	_colorImage = _createImage(extent.width, extent.height, colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, &_colorImageMemory);
-	_colorImageView = _createImageView(_colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+	// sampled by the upscale pass, a usage that may cost compression, so
+	// only when needed
+	VkImageUsageFlags colorUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+	if (_dynamicResolution) {
+		colorUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
+
+	_colorImage = _createImage(extent.width, extent.height, _colorFormat, colorUsage, &_colorImageMemory);
+	_colorImageView = _createImageView(_colorImage, _colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
 
-	VkFormat depthFormat = _findDepthFormat();
-	_depthImage = _createImage(extent.width, extent.height, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, &_depthImageMemory);
-	_depthImageView = _createImageView(_depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	if (_postProcessing) {
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			_sceneColorImages[i] = _createImage(extent.width, extent.height, _colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, &_sceneColorImageMemory[i]);
+			_sceneColorImageViews[i] = _createImageView(_sceneColorImages[i], _colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+
+		// only ever in tile memory, the scene passes don't care about its contents
+		_standInImage = _createImage(extent.width, extent.height, pWindow->format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, &_standInImageMemory);
+		_standInImageView = _createImageView(_standInImage, pWindow->format, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	if (_dynamicResolution || _postProcessing) {
+		_upscaleColorImage = _createImage(extent.width, extent.height, _colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, &_upscaleColorImageMemory);
+		_upscaleColorImageView = _createImageView(_upscaleColorImage, _colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	// sampled when building the Hi-Z pyramid
+	_depthImage = _createImage(extent.width, extent.height, _depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, &_depthImageMemory);
+	_depthImageView = _createImageView(_depthImage, _depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
 	// Framebuffers
 
+	for (size_t i = 0; i < imageCount; i++) {
+		VkImageView attachmentViews[] = {
+			pWindow->swapchainImages[i].view,
+			_colorImageView,
+			_depthImageView,
+		};
+
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = pWindow->renderPasses[RENDER_PASS_TYPE_MAIN];
+		framebufferInfo.attachmentCount = 3;
+		framebufferInfo.pAttachments = attachmentViews;
+		framebufferInfo.width = extent.width;
+		framebufferInfo.height = extent.height;
+		framebufferInfo.layers = 1;
+
+		VK_CHECK(vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &pWindow->swapchainImages[i].framebuffer), "Failed to create framebuffer!");
+
+		pWindow->swapchainImages[i].upscaleFramebuffer = VK_NULL_HANDLE;
+
+		if (_dynamicResolution || _postProcessing) {
+			attachmentViews[1] = _upscaleColorImageView;
+			framebufferInfo.renderPass = pWindow->renderPasses[RENDER_PASS_TYPE_UPSCALE];
+
+			VK_CHECK(vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &pWindow->swapchainImages[i].upscaleFramebuffer), "Failed to create framebuffer!");
+		}
+	}
+
+	if (_postProcessing) {
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			VkImageView attachmentViews[] = {
+				_standInImageView,
+				_sceneColorImageViews[i],
+				_depthImageView,
+			};
+
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = pWindow->renderPasses[RENDER_PASS_TYPE_MAIN_SCALED];
+			framebufferInfo.attachmentCount = 3;
+			framebufferInfo.pAttachments = attachmentViews;
+			framebufferInfo.width = extent.width;
+			framebufferInfo.height = extent.height;
+			framebufferInfo.layers = 1;
+
+			VK_CHECK(vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_sceneFramebuffers[i]), "Failed to create framebuffer!");
+		}
+	}
+
+	_swapchainGeneration++;
+}
+
+void VulkanContext::_destroyAttachments(Window *pWindow) {
+	vkDestroyImageView(_device, _colorImageView, nullptr);
+	vkDestroyImage(_device, _colorImage, nullptr);
+	vkFreeMemory(_device, _colorImageMemory, nullptr);
+
+	vkDestroyImageView(_device, _depthImageView, nullptr);
+	vkDestroyImage(_device, _depthImage, nullptr);
+	vkFreeMemory(_device, _depthImageMemory, nullptr);
+
+	if (_upscaleColorImage != VK_NULL_HANDLE) {
+		vkDestroyImageView(_device, _upscaleColorImageView, nullptr);
+		vkDestroyImage(_device, _upscaleColorImage, nullptr);
+		vkFreeMemory(_device, _upscaleColorImageMemory, nullptr);
+
+		_upscaleColorImage = VK_NULL_HANDLE;
+		_upscaleColorImageView = VK_NULL_HANDLE;
+	}
+
+	if (_standInImage != VK_NULL_HANDLE) {
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			vkDestroyFramebuffer(_device, _sceneFramebuffers[i], nullptr);
+
+			vkDestroyImageView(_device, _sceneColorImageViews[i], nullptr);
+			vkDestroyImage(_device, _sceneColorImages[i], nullptr);
+			vkFreeMemory(_device, _sceneColorImageMemory[i], nullptr);
+
+			_sceneFramebuffers[i] = VK_NULL_HANDLE;
+			_sceneColorImages[i] = VK_NULL_HANDLE;
+			_sceneColorImageViews[i] = VK_NULL_HANDLE;
+		}
+
+		vkDestroyImageView(_device, _standInImageView, nullptr);
+		vkDestroyImage(_device, _standInImage, nullptr);
+		vkFreeMemory(_device, _standInImageMemory, nullptr);
+
+		_standInImage = VK_NULL_HANDLE;
+		_standInImageView = VK_NULL_HANDLE;
+	}
+
+	for (uint32_t i = 0; i < pWindow->swapchainImages.size(); i++) {
+		vkDestroyFramebuffer(_device, pWindow->swapchainImages[i].framebuffer, nullptr);
+
+		if (pWindow->swapchainImages[i].upscaleFramebuffer != VK_NULL_HANDLE) {
+			vkDestroyFramebuffer(_device, pWindow->swapchainImages[i].upscaleFramebuffer, nullptr);
+		}
+		vkDestroyImageView(_device, pWindow->swapchainImages[i].view, nullptr);
+
+		if (_headless) {
+			vkDestroyImage(_device, pWindow->swapchainImages[i].image, nullptr);
+			vkFreeMemory(_device, pWindow->swapchainImages[i].memory, nullptr);
+		}
+	}
+
+	pWindow->swapchainImages.clear();
+}
+
+void VulkanContext::_createRenderPasses(Window *pWindow) {
+	for (int i = 0; i < RENDER_PASS_TYPE_MAX; i++) {
+		pWindow->renderPasses[i] = _createRenderPass(pWindow->format, _colorFormat, _depthFormat, (RenderPassType)i);
+	}
+}
+
+void VulkanContext::_destroyRenderPasses(Window *pWindow) {
+	for (int i = 0; i < RENDER_PASS_TYPE_MAX; i++) {
+		vkDestroyRenderPass(_device, pWindow->renderPasses[i], nullptr);
+		pWindow->renderPasses[i] = VK_NULL_HANDLE;
+	}
+}
+
+VkRenderPass VulkanContext::_createRenderPass(VkFormat finalColorFormat, VkFormat colorFormat, VkFormat depthFormat, RenderPassType type) {
+	bool tileOptimized = _renderPassConfig == RENDER_PASS_CONFIG_TILE_OPTIMIZED;
+
 	VkAttachmentDescription finalColorAttachment{};
-	finalColorAttachment.format = surfaceFormat.format;
+	finalColorAttachment.format = finalColorFormat;
 	finalColorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	finalColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	finalColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	finalColorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	finalColorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	finalColorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	finalColorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// the present layout needs VK_KHR_swapchain, offscreen images are read back instead
+	finalColorAttachment.finalLayout = _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentDescription colorAttachment{};
 	colorAttachment.format = colorFormat;
 	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	// only read as an input attachment by the tonemap subpass
+	colorAttachment.storeOp = tileOptimized ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -407,6 +847,40 @@ void VulkanContext::_createSwapChain(Window *pWindow) {
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	switch (type) {
+		case RENDER_PASS_TYPE_EARLY:
+			// nothing is presented, depth is kept and read by the pyramid build
+			finalColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			finalColorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			// the late pass continues on it
+			colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			break;
+		case RENDER_PASS_TYPE_LATE:
+		case RENDER_PASS_TYPE_LATE_SCALED:
+			colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			depthAttachment.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			break;
+		case RENDER_PASS_TYPE_UPSCALE:
+			// every texel is written by the upsample, ImGui needs no depth
+			colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			break;
+		default:
+			break;
+	}
+
+	if (type == RENDER_PASS_TYPE_MAIN_SCALED || type == RENDER_PASS_TYPE_LATE_SCALED) {
+		// the upscale pass presents, the scene is sampled from the HDR color
+		finalColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		finalColorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+
 	VkAttachmentReference finalColorAttachmentRef{};
 	finalColorAttachmentRef.attachment = 0;
 	finalColorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -436,23 +910,38 @@ void VulkanContext::_createSwapChain(Window *pWindow) {
 	drawSubpass.pColorAttachments = &colorAttachmentRef;
 	drawSubpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-	VkSubpassDependency dependencies[2] = {};
+	// dependencies are identical for every type, compatibility requires it
+	VkSubpassDependency dependencies[3] = {};
 
+	// previous pass and pyramid build are done with the attachments
 	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependencies[0].dstSubpass = 0;
-	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[0].srcAccessMask = 0;
-	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	// dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	// stays framebuffer-global, the pyramid build reads depth across regions
+
+	// the tonemap subpass only reads the texel it writes, so a tile can move
+	// on without waiting for the rest of the framebuffer
 	dependencies[1].srcSubpass = 0;
 	dependencies[1].dstSubpass = 1;
 	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	// dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	dependencies[1].dstAccessMask = tileOptimized ? VK_ACCESS_INPUT_ATTACHMENT_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
+	dependencies[1].dependencyFlags = tileOptimized ? VK_DEPENDENCY_BY_REGION_BIT : 0;
+
+	// depth is read by the pyramid build after the early pass, the store op
+	// happens in the late fragment tests. A scaled pass' HDR color is
+	// sampled by the upscale pass.
+	dependencies[2].srcSubpass = 0;
+	dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[2].srcStageMask = tileOptimized ? VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT : VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[2].srcStageMask |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
 	VkAttachmentDescription attachments[] = {
 		finalColorAttachment,
@@ -460,6 +949,8 @@ void VulkanContext::_createSwapChain(Window *pWindow) {
 		depthAttachment,
 	};
 
+	memcpy(_renderPassAttachments[type], attachments, sizeof(attachments));
+
 	VkSubpassDescription subpasses[] = { drawSubpass, tonemapSubpass };
 
 	VkRenderPassCreateInfo renderPassInfo{};
@@ -468,51 +959,24 @@ void VulkanContext::_createSwapChain(Window *pWindow) {
 	renderPassInfo.pAttachments = attachments;
 	renderPassInfo.subpassCount = 2;
 	renderPassInfo.pSubpasses = subpasses;
-	renderPassInfo.dependencyCount = 2;
+	renderPassInfo.dependencyCount = 3;
 	renderPassInfo.pDependencies = dependencies;
 
-	VK_CHECK(vkCreateRenderPass(_device, &renderPassInfo, nullptr, &pWindow->renderPass), "Failed to create renderpass!");
-
-	for (size_t i = 0; i < imageCount; i++) {
-		VkImageView attachmentViews[] = {
-			pWindow->swapchainImages[i].view,
-			_colorImageView,
-			_depthImageView,
-		};
-
-		VkFramebufferCreateInfo framebufferInfo{};
-		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferInfo.renderPass = pWindow->renderPass;
-		framebufferInfo.attachmentCount = 3;
-		framebufferInfo.pAttachments = attachmentViews;
-		framebufferInfo.width = extent.width;
-		framebufferInfo.height = extent.height;
-		framebufferInfo.layers = 1;
-
-		VK_CHECK(vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &pWindow->swapchainImages[i].framebuffer), "Failed to create framebuffer!");
-	}
+	VkRenderPass renderPass;
+	VK_CHECK(vkCreateRenderPass(_device, &renderPassInfo, nullptr, &renderPass), "Failed to create renderpass!");
 
-	pWindow->swapchainExtent = extent;
+	return renderPass;
 }
 
 void VulkanContext::_cleanupSwapChain(Window *pWindow) {
-	vkDestroyImageView(_device, _colorImageView, nullptr);
-	vkDestroyImage(_device, _colorImage, nullptr);
-	vkFreeMemory(_device, _colorImageMemory, nullptr);
-
-	vkDestroyImageView(_device, _depthImageView, nullptr);
-	vkDestroyImage(_device, _depthImage, nullptr);
-	vkFreeMemory(_device, _depthImageMemory, nullptr);
+	_destroyAttachments(pWindow);
 
-	for (uint32_t i = 0; i < pWindow->swapchainImages.size(); i++) {
-		vkDestroyFramebuffer(_device, pWindow->swapchainImages[i].framebuffer, nullptr);
-		vkDestroyImageView(_device, pWindow->swapchainImages[i].view, nullptr);
+	if (pWindow->swapchain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(_device, pWindow->swapchain, nullptr);
+		pWindow->swapchain = VK_NULL_HANDLE;
 	}
 
-	pWindow->swapchainImages.clear();
-
-	vkDestroySwapchainKHR(_device, pWindow->swapchain, nullptr);
-	vkDestroyRenderPass(_device, pWindow->renderPass, nullptr);
+	_destroyRenderPasses(pWindow);
 }
 
 void VulkanContext::_recreateSwapChain(Window *pWindow) {
@@ -526,8 +990,42 @@ void VulkanContext::_recreateSwapChain(Window *pWindow) {
 
 	vkDeviceWaitIdle(_device);
 
-	_cleanupSwapChain(pWindow);
-	_createSwapChain(pWindow);
+	auto start = std::chrono::steady_clock::now();
+
+	// the swapchain itself is kept until its replacement exists
+	_destroyAttachments(pWindow);
+
+	VkFormat format = pWindow->format;
+
+	if (_headless) {
+		_createOffscreenImages(pWindow);
+	} else {
+		_createSwapChain(pWindow);
+	}
+
+	// pipelines only need a compatible render pass, the old ones stay valid
+	// as long as the formats match. The renderer rebuilds its own when
+	// renderPassRecreations changes.
+	if (pWindow->format != format) {
+		printf("Swapchain format changed, recreating the render passes\n");
+
+		_destroyRenderPasses(pWindow);
+		_createRenderPasses(pWindow);
+		_swapchainStatistics.renderPassRecreations++;
+	}
+
+	_createAttachments(pWindow);
+
+	pWindow->resized = false;
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	_swapchainStatistics.recreations++;
+	_swapchainStatistics.totalMilliseconds += milliseconds;
+	_swapchainStatistics.maxMilliseconds = std::max(_swapchainStatistics.maxMilliseconds, milliseconds);
+}
+
+bool VulkanContext::_isResizeSettled(Window *pWindow) {
+	return std::chrono::steady_clock::now() - pWindow->resizeTime >= std::chrono::milliseconds(SWAPCHAIN_RESIZE_DEBOUNCE_MS);
 }
 
 VkImage VulkanContext::_createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkDeviceMemory *pMemory) {
@@ -599,7 +1097,13 @@ VkFormat VulkanContext::_findDepthFormat() {
 	return _findSupportedFormat(
 			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 			VK_IMAGE_TILING_OPTIMAL,
-			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+}
+
+uint32_t VulkanContext::_getFormatSize(VkFormat format) {
+	// the 8 bit surface formats and the depth aspect, stencil is never loaded
+	// or stored
+	return format == VK_FORMAT_R16G16B16A16_SFLOAT ? 8 : 4;
 }
 
 VkFormat VulkanContext::_findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
@@ -618,7 +1122,12 @@ VkFormat VulkanContext::_findSupportedFormat(const std::vector<VkFormat> &candid
 	return VK_FORMAT_MAX_ENUM;
 }
 
-void VulkanContext::_createCommandPool() {
+bool VulkanContext::_useAsyncCompute(const QueueFamilyIndices &indices) {
+	// only the post-processing chain runs on the compute queue
+	return _allowAsyncCompute && _postProcessing && indices.computeFamily.has_value();
+}
+
+void VulkanContext::_createCommandPools() {
 	VkCommandPoolCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	createInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
@@ -626,20 +1135,25 @@ void VulkanContext::_createCommandPool() {
 	createInfo.pNext = nullptr;
 
 	VK_CHECK(vkCreateCommandPool(_device, &createInfo, nullptr, &_commandPool), "Failed to create command pool!");
+
+	// only the post-processing chain records compute command buffers
+	if (!_postProcessing) {
+		return;
+	}
+
+	// a pool of its own even on the graphics family, each is recorded from one thread
+	createInfo.queueFamilyIndex = _computeQueueFamily;
+
+	VK_CHECK(vkCreateCommandPool(_device, &createInfo, nullptr, &_computeCommandPool), "Failed to create compute command pool!");
 }
 
 void VulkanContext::_createSyncObjects() {
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 		if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_syncObjects[i].presentSemaphore) != VK_SUCCESS ||
-				vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_syncObjects[i].renderSemaphore) != VK_SUCCESS ||
-				vkCreateFence(_device, &fenceInfo, nullptr, &_syncObjects[i].renderFence) != VK_SUCCESS) {
+				vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_syncObjects[i].renderSemaphore) != VK_SUCCESS) {
 			printf("Failed to create sync objects!\n");
 		}
 	}
@@ -655,19 +1169,53 @@ void VulkanContext::windowCreate(VkSurfaceKHR surface, uint32_t width, uint32_t
 
 	_graphicsQueueFamily = indices.graphicsFamily.value();
 
+	_graphicsTimeline = new QueueTimeline(_device, _graphicsQueue);
+
+	// compute work of a frame can overlap the graphics work of the next
+	if (_useAsyncCompute(indices)) {
+		_computeQueueFamily = indices.computeFamily.value();
+		vkGetDeviceQueue(_device, _computeQueueFamily, 0, &_computeQueue);
+
+		_computeTimeline = new QueueTimeline(_device, _computeQueue);
+		_asyncCompute = true;
+	} else {
+		_computeQueueFamily = _graphicsQueueFamily;
+		_computeQueue = _graphicsQueue;
+		_computeTimeline = _graphicsTimeline;
+	}
+
+	if (_usePipelineCache) {
+		_createPipelineCache();
+	}
+
 	_window = {};
 	_window.surface = surface;
 	_window.width = width;
 	_window.height = height;
 
-	_createSwapChain(&_window);
+	_colorFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+	_depthFormat = _findDepthFormat();
+
+	if (_headless) {
+		_createOffscreenImages(&_window);
+	} else {
+		_createSwapChain(&_window);
+	}
+
+	_createRenderPasses(&_window);
+	_createAttachments(&_window);
 
-	_createCommandPool();
+	_createCommandPools();
 	_createSyncObjects();
 
 	_initialized = true;
 }
 
+void VulkanContext::headlessCreate(uint32_t width, uint32_t height) {
+	_headless = true;
+	windowCreate(VK_NULL_HANDLE, width, height);
+}
+
 void VulkanContext::windowResize(uint32_t width, uint32_t height) {
 	if (width == _window.width && height == _window.height) {
 		return;
@@ -676,50 +1224,116 @@ void VulkanContext::windowResize(uint32_t width, uint32_t height) {
 	_window.width = width;
 	_window.height = height;
 	_window.resized = true;
+	_window.resizeTime = std::chrono::steady_clock::now();
 }
 
 void VulkanContext::recreateSwapchain() {
 	_recreateSwapChain(&_window);
 }
 
-void VulkanContext::submit(uint32_t currentFrame, uint32_t imageIndex, VkCommandBuffer commandBuffer) {
-	VkSemaphore waitSemaphores[] = { _syncObjects[currentFrame].presentSemaphore };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	VkSemaphore signalSemaphores[] = { _syncObjects[currentFrame].renderSemaphore };
+void VulkanContext::setRenderPassConfig(RenderPassConfig config) {
+	_renderPassConfig = config;
+}
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+void VulkanContext::setDynamicResolution(bool enabled) {
+	_dynamicResolution = enabled;
+}
 
-	VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _syncObjects[currentFrame].renderFence), "Failed to submit draw command buffer!");
+void VulkanContext::setPostProcessing(bool enabled) {
+	_postProcessing = enabled;
+}
+
+void VulkanContext::setAsyncCompute(bool enabled) {
+	_allowAsyncCompute = enabled;
+}
+
+AttachmentTraffic VulkanContext::getAttachmentTraffic(RenderPassType type, VkExtent2D extent) {
+	uint64_t texelCount = static_cast<uint64_t>(extent.width) * extent.height;
+
+	AttachmentTraffic traffic;
+
+	for (uint32_t i = 0; i < RENDER_PASS_ATTACHMENT_COUNT; i++) {
+		const VkAttachmentDescription *pAttachment = &_renderPassAttachments[type][i];
+		uint64_t size = texelCount * _getFormatSize(pAttachment->format);
+
+		if (pAttachment->loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+			traffic.loads++;
+			traffic.loadBytes += size;
+		}
+
+		if (pAttachment->storeOp == VK_ATTACHMENT_STORE_OP_STORE) {
+			traffic.stores++;
+			traffic.storeBytes += size;
+		}
+	}
+
+	return traffic;
+}
+
+VkResult VulkanContext::acquireNextImage(uint32_t currentFrame, uint32_t *pImageIndex) {
+	if (_headless) {
+		// an image per frame in flight, the frame's timeline value guards it
+		*pImageIndex = currentFrame;
+		return VK_SUCCESS;
+	}
+
+	PROFILE_ZONE("Acquire");
+	return vkAcquireNextImageKHR(_device, _window.swapchain, UINT64_MAX, _syncObjects[currentFrame].presentSemaphore, VK_NULL_HANDLE, pImageIndex);
+}
+
+uint64_t VulkanContext::submit(uint32_t currentFrame, uint32_t imageIndex, VkCommandBuffer commandBuffer, const std::vector<SemaphoreWait> &waits) {
+	if (_headless) {
+		uint64_t value = _graphicsTimeline->submit(&commandBuffer, 1, waits);
+
+		if (_window.resized && _isResizeSettled(&_window)) {
+			_recreateSwapChain(&_window);
+		}
+
+		return value;
+	}
+
+	// the swapchain only works with binary semaphores
+	std::vector<SemaphoreWait> frameWaits = waits;
+	frameWaits.push_back({ _syncObjects[currentFrame].presentSemaphore, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT });
+
+	uint64_t value = _graphicsTimeline->submit(&commandBuffer, 1, frameWaits, _syncObjects[currentFrame].renderSemaphore);
 
 	VkSwapchainKHR swapChains[] = { _window.swapchain };
 
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.pWaitSemaphores = &_syncObjects[currentFrame].renderSemaphore;
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = swapChains;
 	presentInfo.pImageIndices = &imageIndex;
 
-	VkResult result = vkQueuePresentKHR(_presentQueue, &presentInfo);
+	VkResult result;
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _window.resized) {
-		_window.resized = false;
+	{
+		PROFILE_ZONE("Present");
+
+		// submits from other threads go through the timeline's lock too
+		if (_presentQueue == _graphicsQueue) {
+			result = _graphicsTimeline->present(&presentInfo);
+		} else {
+			result = vkQueuePresentKHR(_presentQueue, &presentInfo);
+		}
+	}
+
+	// out of date images can't be presented, otherwise the old swapchain is
+	// scaled until the size settles
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || ((result == VK_SUBOPTIMAL_KHR || _window.resized) && _isResizeSettled(&_window))) {
 		_recreateSwapChain(&_window);
-	} else if (result != VK_SUCCESS) {
+	} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
 		printf("Failed to present swapchain image!\n");
 	}
+
+	return value;
 }
 
-VulkanContext::VulkanContext(std::vector<const char *> extensions, bool useValidation) {
+VulkanContext::VulkanContext(std::vector<const char *> extensions, bool useValidation, bool usePipelineCache) {
+	_usePipelineCache = usePipelineCache;
 	_createInstance(extensions, useValidation);
 }
 
@@ -728,13 +1342,32 @@ VulkanContext::~VulkanContext() {
 		_cleanupSwapChain(&_window);
 
 		vkDestroyCommandPool(_device, _commandPool, nullptr);
+		vkDestroyCommandPool(_device, _computeCommandPool, nullptr);
+
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			vkDestroySemaphore(_device, _syncObjects[i].presentSemaphore, nullptr);
+			vkDestroySemaphore(_device, _syncObjects[i].renderSemaphore, nullptr);
+		}
+
+		if (_computeTimeline != _graphicsTimeline) {
+			delete _computeTimeline;
+		}
+
+		delete _graphicsTimeline;
+
+		if (_pipelineCache != VK_NULL_HANDLE) {
+			vkDestroyPipelineCache(_device, _pipelineCache, nullptr);
+		}
+
 		vkDestroyDevice(_device, nullptr);
 
 		if (_useValidation) {
 			DestroyDebugUtilsMessengerEXT(_instance, _debugMessenger, nullptr);
 		}
 
-		vkDestroySurfaceKHR(_instance, _window.surface, nullptr);
+		if (_window.surface != VK_NULL_HANDLE) {
+			vkDestroySurfaceKHR(_instance, _window.surface, nullptr);
+		}
 	}
 
 	vkDestroyInstance(_instance, nullptr);
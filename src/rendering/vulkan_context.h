@@ -1,12 +1,16 @@
 #ifndef VULKAN_CONTEXT_H
 #define VULKAN_CONTEXT_H
 
+#include <chrono>
 #include <cstdint>
 #include <optional>
+#include <string>
 #include <vector>
 
 #include <vulkan/vulkan.h>
 
+#include "queue_timeline.h"
+
 #define VK_CHECK(x, msg)                         \
 	{                                            \
 		VkResult err = x;                        \
@@ -25,9 +29,30 @@ const std::vector<const char *> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
+// required in headless mode too, frames and uploads are tracked with them
+const std::vector<const char *> timelineSemaphoreExtensions = {
+	VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME
+};
+
+// Offscreen images standing in for the swapchain in headless mode, one per
+// frame in flight.
+const uint32_t HEADLESS_IMAGE_COUNT = MAX_FRAMES_IN_FLIGHT;
+
+// A resize is applied once the size hasn't changed for this long, dragging a
+// window edge doesn't recreate the swapchain every frame.
+const uint32_t SWAPCHAIN_RESIZE_DEBOUNCE_MS = 100;
+
+// optional, enabled together when the device supports them
+const std::vector<const char *> descriptorIndexingExtensions = {
+	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+	VK_KHR_MAINTENANCE3_EXTENSION_NAME
+};
+
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	// compute without graphics, runs beside the graphics queue
+	std::optional<uint32_t> computeFamily;
 
 	bool isComplete() {
 		return graphicsFamily.has_value() && presentFamily.has_value();
@@ -40,10 +65,59 @@ struct SwapChainSupportDetails {
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+// Render passes sharing attachments and subpasses, so they are compatible
+// with the same framebuffers and pipelines.
+enum RenderPassType {
+	RENDER_PASS_TYPE_MAIN,
+	// occlusion culling, keeps depth for the Hi-Z pyramid
+	RENDER_PASS_TYPE_EARLY,
+	// occlusion culling, continues on top of the early pass
+	RENDER_PASS_TYPE_LATE,
+	// dynamic resolution and post-processing, MAIN and LATE keeping the HDR
+	// color for a later pass to sample, the tonemap subpass is left empty
+	RENDER_PASS_TYPE_MAIN_SCALED,
+	RENDER_PASS_TYPE_LATE_SCALED,
+	// dynamic resolution and post-processing, draws the scene or the post
+	// result into the second HDR color, then ImGui and tonemapping as in MAIN
+	RENDER_PASS_TYPE_UPSCALE,
+	RENDER_PASS_TYPE_MAX,
+};
+
+// Final color, HDR color and depth.
+const uint32_t RENDER_PASS_ATTACHMENT_COUNT = 3;
+
+// Store ops and subpass dependencies of every render pass type.
+enum RenderPassConfig {
+	// attachments only read within the pass stay in tile memory on tilers,
+	// framebuffer-local dependencies between the subpasses
+	RENDER_PASS_CONFIG_TILE_OPTIMIZED,
+	// stores every attachment, framebuffer-global dependencies, to compare
+	RENDER_PASS_CONFIG_LEGACY,
+};
+
+// Attachment memory traffic of a render pass over the whole framebuffer,
+// what a tiler moves between memory and tile memory.
+struct AttachmentTraffic {
+	uint32_t loads = 0;
+	uint32_t stores = 0;
+	uint64_t loadBytes = 0;
+	uint64_t storeBytes = 0;
+};
+
+// Swapchain recreations so far, to measure resize hitches.
+struct SwapchainStatistics {
+	uint32_t recreations = 0;
+	// recreations that also rebuilt the render passes, the surface format changed
+	uint32_t renderPassRecreations = 0;
+	double totalMilliseconds = 0.0;
+	double maxMilliseconds = 0.0;
+};
+
+// Binary semaphores for the swapchain, which can't use timeline semaphores.
+// Frame completion is tracked on the graphics timeline instead of a fence.
 struct SyncObject {
 	VkSemaphore presentSemaphore;
 	VkSemaphore renderSemaphore;
-	VkFence renderFence;
 };
 
 class VulkanContext {
@@ -61,12 +135,42 @@ private:
 
 	uint32_t _graphicsQueueFamily;
 
+	QueueTimeline *_graphicsTimeline = nullptr;
+
+	// the graphics queue, family and timeline without async compute
+	VkQueue _computeQueue;
+	uint32_t _computeQueueFamily;
+	QueueTimeline *_computeTimeline = nullptr;
+
+	// use a compute only family when there is one
+	bool _allowAsyncCompute = true;
+	bool _asyncCompute = false;
+
+	VkPhysicalDeviceFeatures _enabledFeatures{};
+
+	// VK_KHR_get_physical_device_properties2, to query extension features
+	bool _hasProperties2 = false;
+
+	bool _descriptorIndexing = false;
+	uint32_t _maxBindlessTextures = 0;
+
+	bool _usePipelineCache;
+	VkPipelineCache _pipelineCache = VK_NULL_HANDLE;
+	std::string _pipelineCachePath;
+
 	bool _initialized = false;
 
+	// no surface and no swapchain, frames end in offscreen images
+	bool _headless = false;
+
 	typedef struct {
 		VkImage image;
 		VkImageView view;
 		VkFramebuffer framebuffer;
+		// with the upscale color instead of the HDR color, dynamic resolution only
+		VkFramebuffer upscaleFramebuffer;
+		// only offscreen images own their memory
+		VkDeviceMemory memory;
 	} SwapChainImageResource;
 
 	struct Window {
@@ -74,65 +178,159 @@ private:
 		VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 		VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
 		VkSurfaceKHR surface = VK_NULL_HANDLE;
-		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkRenderPass renderPasses[RENDER_PASS_TYPE_MAX] = {};
 		VkExtent2D swapchainExtent;
+		// of the swapchain images, the render passes are built for it
+		VkFormat format = VK_FORMAT_UNDEFINED;
 
 		int width = 0;
 		int height = 0;
 		bool resized = false;
+		std::chrono::steady_clock::time_point resizeTime;
 	};
 
 	Window _window;
 
+	RenderPassConfig _renderPassConfig = RENDER_PASS_CONFIG_TILE_OPTIMIZED;
+	bool _dynamicResolution = false;
+	bool _postProcessing = false;
+	// of each render pass type, for the traffic estimate
+	VkAttachmentDescription _renderPassAttachments[RENDER_PASS_TYPE_MAX][RENDER_PASS_ATTACHMENT_COUNT];
+
+	// bumped whenever swapchain sized resources are recreated
+	uint32_t _swapchainGeneration = 0;
+	SwapchainStatistics _swapchainStatistics;
+
 	VkCommandPool _commandPool;
+	// on the compute queue family, VK_NULL_HANDLE without post-processing
+	VkCommandPool _computeCommandPool = VK_NULL_HANDLE;
 
+	VkFormat _colorFormat;
 	VkImage _colorImage;
 	VkDeviceMemory _colorImageMemory;
 	VkImageView _colorImageView;
 
+	VkFormat _depthFormat;
 	VkImage _depthImage;
 	VkDeviceMemory _depthImageMemory;
 	VkImageView _depthImageView;
 
+	// full size HDR color the scaled scene is upsampled into
+	VkImage _upscaleColorImage = VK_NULL_HANDLE;
+	VkDeviceMemory _upscaleColorImageMemory;
+	VkImageView _upscaleColorImageView = VK_NULL_HANDLE;
+
+	// post-processing, an HDR color per frame in flight, the compute queue
+	// reads one while the next frame renders into the other
+	VkImage _sceneColorImages[MAX_FRAMES_IN_FLIGHT] = {};
+	VkDeviceMemory _sceneColorImageMemory[MAX_FRAMES_IN_FLIGHT];
+	VkImageView _sceneColorImageViews[MAX_FRAMES_IN_FLIGHT] = {};
+	// in place of the swapchain image, the scene passes never store it
+	VkImage _standInImage = VK_NULL_HANDLE;
+	VkDeviceMemory _standInImageMemory;
+	VkImageView _standInImageView = VK_NULL_HANDLE;
+	VkFramebuffer _sceneFramebuffers[MAX_FRAMES_IN_FLIGHT] = {};
+
 	SyncObject _syncObjects[MAX_FRAMES_IN_FLIGHT];
 
 	// instance
 	void _createInstance(std::vector<const char *> extensions, bool useValidation = false);
 	bool _checkValidationLayerSupport();
+	bool _checkInstanceExtensionSupport(const char *pExtension);
 
 	// physical device
 	VkPhysicalDevice _pickPhysicalDevice(VkSurfaceKHR surface);
 	bool _isDeviceSuitable(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
-	bool _checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice);
+	bool _checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice, const std::vector<const char *> &extensions);
+	std::vector<const char *> _getRequiredDeviceExtensions();
+	bool _queryDescriptorIndexing(VkPhysicalDevice physicalDevice);
+	bool _queryTimelineSemaphore(VkPhysicalDevice physicalDevice);
 
 	QueueFamilyIndices _findQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
+	bool _useAsyncCompute(const QueueFamilyIndices &indices);
 	SwapChainSupportDetails _querySwapChainSupport(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
 
 	// device
 	VkDevice _createDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
 
+	// pipeline cache
+	void _createPipelineCache();
+	bool _isPipelineCacheCompatible(const std::vector<uint8_t> &data);
+
 	// swapchain
 	void _createSwapChain(Window *pWindow);
+	void _createOffscreenImages(Window *pWindow);
+	void _createAttachments(Window *pWindow);
+	void _destroyAttachments(Window *pWindow);
 	void _cleanupSwapChain(Window *pWindow);
 	void _recreateSwapChain(Window *pWindow);
+	bool _isResizeSettled(Window *pWindow);
+
+	void _createRenderPasses(Window *pWindow);
+	void _destroyRenderPasses(Window *pWindow);
+	VkRenderPass _createRenderPass(VkFormat finalColorFormat, VkFormat colorFormat, VkFormat depthFormat, RenderPassType type);
 
 	VkImage _createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkDeviceMemory *pMemory);
 	VkImageView _createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
 
 	uint32_t _findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 	VkFormat _findDepthFormat();
+	uint32_t _getFormatSize(VkFormat format);
 	VkFormat _findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
-	void _createCommandPool();
+	void _createCommandPools();
 	void _createSyncObjects();
 
 public:
 	void windowCreate(VkSurfaceKHR surface, uint32_t width, uint32_t height);
 	void windowResize(uint32_t width, uint32_t height);
 
+	// Renders into offscreen images of a fixed size instead of a window, for
+	// machines without a display, e.g. with a software ICD like lavapipe.
+	// The instance needs no surface extensions.
+	void headlessCreate(uint32_t width, uint32_t height);
+
+	// Rebuilds the swapchain sized resources right away. Render passes and
+	// the pipelines built against them are kept unless the format changed.
 	void recreateSwapchain();
 
-	void submit(uint32_t currentFrame, uint32_t imageIndex, VkCommandBuffer commandBuffer);
+	// Set before windowCreate() or headlessCreate().
+	void setRenderPassConfig(RenderPassConfig config);
+	RenderPassConfig getRenderPassConfig() { return _renderPassConfig; }
+
+	// Creates the upscale color and framebuffers and makes the HDR color
+	// sampleable. Set before windowCreate() or headlessCreate().
+	void setDynamicResolution(bool enabled);
+	bool hasDynamicResolution() { return _dynamicResolution; }
+
+	// Creates an HDR color and framebuffer per frame in flight, which don't
+	// depend on a swapchain image, and the upscale color and framebuffers.
+	// Set before windowCreate() or headlessCreate().
+	void setPostProcessing(bool enabled);
+	bool hasPostProcessing() { return _postProcessing; }
+
+	// Whether a compute only queue family is used when the device has one,
+	// only with post-processing. Set before windowCreate() or headlessCreate().
+	void setAsyncCompute(bool enabled);
+
+	// Loads and stores one begin of the render pass causes at the current
+	// extent, clears and discarded contents aren't counted.
+	AttachmentTraffic getAttachmentTraffic(RenderPassType type) { return getAttachmentTraffic(type, _window.swapchainExtent); }
+	// Over a smaller render area, e.g. of a scaled pass.
+	AttachmentTraffic getAttachmentTraffic(RenderPassType type, VkExtent2D extent);
+
+	// Index of the image the frame renders into. Signals the frame's present
+	// semaphore, which submit() waits on.
+	VkResult acquireNextImage(uint32_t currentFrame, uint32_t *pImageIndex);
+	// Submits and presents the frame. Returns its value on the graphics
+	// timeline, reached once the frame has finished on the GPU.
+	// The waits are added to the swapchain's.
+	uint64_t submit(uint32_t currentFrame, uint32_t imageIndex, VkCommandBuffer commandBuffer, const std::vector<SemaphoreWait> &waits = {});
+
+	// Writes the pipeline cache back to disk, call once all pipelines exist.
+	void savePipelineCache();
+
+	bool isHeadless() { return _headless; }
 
 	VkInstance getInstance() { return _instance; }
 	VkPhysicalDevice getPhysicalDevice() { return _physicalDevice; }
@@ -143,19 +341,60 @@ public:
 
 	uint32_t getGraphicsQueueFamily() { return _graphicsQueueFamily; }
 
-	VkRenderPass getRenderPass() { return _window.renderPass; }
+	// Every graphics queue submission should go through it.
+	QueueTimeline *getGraphicsTimeline() { return _graphicsTimeline; }
+
+	// A queue of a family without graphics, false when compute work goes to
+	// the graphics queue.
+	bool hasAsyncCompute() { return _asyncCompute; }
+
+	// the graphics ones without async compute
+	VkQueue getComputeQueue() { return _computeQueue; }
+	uint32_t getComputeQueueFamily() { return _computeQueueFamily; }
+	QueueTimeline *getComputeTimeline() { return _computeTimeline; }
+
+	VkPhysicalDeviceFeatures getEnabledFeatures() { return _enabledFeatures; }
+
+	// Partially bound, update after bind sampled images for the texture table.
+	bool hasDescriptorIndexing() { return _descriptorIndexing; }
+	// Combined image samplers one update after bind set can hold.
+	uint32_t getMaxBindlessTextures() { return _maxBindlessTextures; }
+
+	// VK_NULL_HANDLE when disabled
+	VkPipelineCache getPipelineCache() { return _pipelineCache; }
+
+	VkRenderPass getRenderPass(RenderPassType type = RENDER_PASS_TYPE_MAIN) { return _window.renderPasses[type]; }
+	// VK_NULL_HANDLE in headless mode
 	VkSwapchainKHR getSwapchain() { return _window.swapchain; }
 	VkExtent2D getSwapchainExtent() { return _window.swapchainExtent; }
-	VkFramebuffer getFramebuffer(uint32_t currentFrame) { return _window.swapchainImages[currentFrame].framebuffer; }
+	uint32_t getSwapchainGeneration() { return _swapchainGeneration; }
+	SwapchainStatistics getSwapchainStatistics() { return _swapchainStatistics; }
+	VkFramebuffer getFramebuffer(uint32_t imageIndex, RenderPassType type = RENDER_PASS_TYPE_MAIN) {
+		const SwapChainImageResource &image = _window.swapchainImages[imageIndex];
+		return type == RENDER_PASS_TYPE_UPSCALE ? image.upscaleFramebuffer : image.framebuffer;
+	}
 
 	VkCommandPool getCommandPool() { return _commandPool; }
+	VkCommandPool getComputeCommandPool() { return _computeCommandPool; }
 
 	SyncObject getSyncObject(uint32_t index) { return _syncObjects[index]; }
 
 	VkImage getColorImage() { return _colorImage; }
 	VkImageView getColorImageView() { return _colorImageView; }
 
-	VulkanContext(std::vector<const char *> extensions, bool useValidation);
+	VkImage getDepthImage() { return _depthImage; }
+	VkImageView getDepthImageView() { return _depthImageView; }
+
+	// VK_NULL_HANDLE without dynamic resolution or post-processing
+	VkImageView getUpscaleColorImageView() { return _upscaleColorImageView; }
+
+	// Post-processing only. The scene passes of a frame render into the
+	// framebuffer of its frame slot, only UPSCALE uses the swapchain image.
+	VkFramebuffer getSceneFramebuffer(uint32_t currentFrame) { return _sceneFramebuffers[currentFrame]; }
+	VkImage getSceneColorImage(uint32_t currentFrame) { return _sceneColorImages[currentFrame]; }
+	VkImageView getSceneColorImageView(uint32_t currentFrame) { return _sceneColorImageViews[currentFrame]; }
+
+	VulkanContext(std::vector<const char *> extensions, bool useValidation, bool usePipelineCache = true);
 	~VulkanContext();
 };
 
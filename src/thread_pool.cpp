@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#include "cpu_profiler.h"
+
+void ThreadPool::_worker() {
+	PROFILE_THREAD("Worker");
+
+	while (true) {
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this] { return _quit || !_tasks.empty(); });
+
+			if (_quit && _tasks.empty()) {
+				return;
+			}
+
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+		}
+
+		task();
+	}
+}
+
+bool ThreadPool::_runPendingTask() {
+	std::function<void()> task;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_tasks.empty()) {
+			return false;
+		}
+
+		task = std::move(_tasks.front());
+		_tasks.pop_front();
+	}
+
+	task();
+	return true;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+	if (_threads.empty()) {
+		task();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_tasks.push_back(std::move(task));
+	}
+
+	_condition.notify_one();
+}
+
+void ThreadPool::parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)> &function) {
+	if (count == 0) {
+		return;
+	}
+
+	batchSize = std::max(batchSize, 1u);
+	uint32_t batchCount = (count + batchSize - 1) / batchSize;
+
+	if (batchCount == 1 || _threads.empty()) {
+		function(0, count);
+		return;
+	}
+
+	std::mutex mutex;
+	std::condition_variable done;
+	uint32_t remaining = batchCount - 1;
+
+	for (uint32_t i = 1; i < batchCount; i++) {
+		uint32_t begin = i * batchSize;
+		uint32_t end = std::min(begin + batchSize, count);
+
+		submit([&, begin, end] {
+			function(begin, end);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--remaining == 0) {
+				done.notify_one();
+			}
+		});
+	}
+
+	function(0, std::min(batchSize, count));
+
+	// help out instead of sleeping while work is queued
+	while (_runPendingTask()) {
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return remaining == 0; });
+}
+
+uint32_t ThreadPool::getThreadCount() {
+	return static_cast<uint32_t>(_threads.size());
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	if (threadCount == 0) {
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		_threads.emplace_back(&ThreadPool::_worker, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+
+	_condition.notify_all();
+
+	for (std::thread &thread : _threads) {
+		thread.join();
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+private:
+	std::vector<std::thread> _threads;
+
+	std::deque<std::function<void()>> _tasks;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _quit = false;
+
+	void _worker();
+	bool _runPendingTask();
+
+public:
+	void submit(std::function<void()> task);
+
+	// Splits [0, count) into ranges of at most batchSize and blocks until
+	// every range is done, the calling thread takes part in the work.
+	void parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)> &function);
+
+	uint32_t getThreadCount();
+
+	// threadCount 0 uses one worker per hardware thread except the caller's
+	ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+};
+
+#endif // !THREAD_POOL_H
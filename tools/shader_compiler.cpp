@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "../src/rendering/shaders/glsl_compiler.h"
+
+// Build time GLSL to SPIR-V compiler used by shader_gen.py, with the same
+// glslang settings as the runtime compilation of the development mode.
+//
+// usage: shader_compiler <vert|frag|comp> <input.glsl> <output.spv> [-DNAME...]
+int main(int argc, char *argv[]) {
+	if (argc < 4) {
+		printf("usage: %s <vert|frag|comp> <input.glsl> <output.spv> [-DNAME...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	ShaderStage stage;
+
+	if (strcmp(argv[1], "vert") == 0) {
+		stage = SHADER_STAGE_VERTEX;
+	} else if (strcmp(argv[1], "frag") == 0) {
+		stage = SHADER_STAGE_FRAGMENT;
+	} else if (strcmp(argv[1], "comp") == 0) {
+		stage = SHADER_STAGE_COMPUTE;
+	} else {
+		printf("Unknown shader stage %s!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	std::ifstream input(argv[2], std::ios::binary);
+
+	if (!input.is_open()) {
+		printf("Failed to open %s!\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	std::string source((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+	// variant defines
+	std::string preamble;
+
+	for (int i = 4; i < argc; i++) {
+		if (strncmp(argv[i], "-D", 2) != 0) {
+			printf("Unknown argument %s!\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		preamble += "#define " + std::string(argv[i] + 2) + "\n";
+	}
+
+	std::vector<uint32_t> spirv;
+	std::string log;
+
+	GlslCompiler::initialize();
+	bool compiled = GlslCompiler::compile(source.c_str(), stage, preamble, &spirv, &log);
+	GlslCompiler::finalize();
+
+	if (!compiled) {
+		printf("%s\n", log.c_str());
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream output(argv[3], std::ios::binary | std::ios::trunc);
+	output.write(reinterpret_cast<const char *>(spirv.data()), spirv.size() * sizeof(uint32_t));
+
+	if (!output.good()) {
+		printf("Failed to write %s!\n", argv[3]);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}